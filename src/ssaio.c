@@ -0,0 +1,298 @@
+#include <ssutil.h>
+#include <ssaio.h>
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#endif
+/* the probe of supported operations and `IORING_OP_READ' came with the headers of 5.6;
+   older ones fall back to `pread' */
+#if defined(IO_URING_OP_SUPPORTED)
+#define HAVE_IOURING 1
+#else
+#define HAVE_IOURING 0
+#endif
+
+/* const or default parameters */
+#define AIODEFDEPTH  64  /* default number of requests in flight */
+#define AIOPROBEOPS  256 /* number of operations asked about by the probe */
+
+/* private function prototypes */
+static void ssaioclear(SSAIO *aio);
+static int ssaiosetup(SSAIO *aio);
+#if HAVE_IOURING
+static int ssaioprobe(SSAIO *aio);
+#endif
+static void ssaioteardown(SSAIO *aio);
+static int ssaioreaduring(SSAIO *aio, SSAIOREQ *reqs, int num);
+static int ssaiopread(SSAIOREQ *req, uint32_t done);
+static void ssaiothreadinit(void);
+static void ssaiothreaddel(void *p);
+
+/* private macros */
+#define AIOLOADACQ(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define AIOSTOREREL(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+static pthread_once_t aiothreadonce = PTHREAD_ONCE_INIT;
+static pthread_key_t aiothreadkey;
+
+/*-----------------------------------------------------------------------------
+ * APIs
+ */
+SSAIO *ssaionew(uint32_t depth, int opts) {
+  SSAIO *aio = NULL;
+  SSMALLOC(aio, sizeof(SSAIO));
+  if (aio == NULL) return NULL;
+  ssaioclear(aio);
+  aio->depth = (depth > 0) ? depth : AIODEFDEPTH;
+  /* seccomp filters and old kernels refuse io_uring, which leaves the `pread' fallback */
+  if (!(opts & SSAIONOURING) && ssaiosetup(aio) != 0) {
+    ssaioteardown(aio);
+    aio->depth = (depth > 0) ? depth : AIODEFDEPTH;
+  }
+  return aio;
+}
+
+void ssaiodel(SSAIO *aio) {
+  assert(aio);
+  ssaioteardown(aio);
+  SSFREE(aio);
+}
+
+SSAIO *ssaiothread(void) {
+  if (pthread_once(&aiothreadonce, ssaiothreadinit) != 0) return NULL;
+  SSAIO *aio = pthread_getspecific(aiothreadkey);
+  if (aio == NULL) {
+    aio = ssaionew(0, 0);
+    if (aio && pthread_setspecific(aiothreadkey, aio) != 0) {
+      ssaiodel(aio);
+      return NULL;
+    }
+  }
+  return aio;
+}
+
+int ssaiouring(SSAIO *aio) {
+  assert(aio);
+  return aio->rfd >= 0;
+}
+
+int ssaioread(SSAIO *aio, SSAIOREQ *reqs, int num) {
+  assert(aio && reqs && num >= 0);
+  int err = 0, i;
+  for (i = 0; i < num; i++) {
+    reqs[i].res = -1;
+  }
+  if (aio->rfd >= 0) return ssaioreaduring(aio, reqs, num);
+  for (i = 0; i < num; i++) {
+    if (ssaiopread(reqs + i, 0) != 0) err = -1;
+  }
+  return err;
+}
+
+/*-----------------------------------------------------------------------------
+ * private functions
+ */
+static void ssaioclear(SSAIO *aio) {
+  aio->rfd = -1;
+  aio->depth = 0;
+  aio->sqmap = NULL;
+  aio->sqmapsiz = 0;
+  aio->cqmap = NULL;
+  aio->cqmapsiz = 0;
+  aio->sqes = NULL;
+  aio->sqessiz = 0;
+  aio->sqtail = NULL;
+  aio->sqmask = 0;
+  aio->sqarray = NULL;
+  aio->cqhead = NULL;
+  aio->cqtail = NULL;
+  aio->cqmask = 0;
+  aio->cqes = NULL;
+}
+
+static int ssaiosetup(SSAIO *aio) {
+#if HAVE_IOURING
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int rfd = syscall(__NR_io_uring_setup, aio->depth, &p);
+  if (rfd < 0) return -1;
+  aio->rfd = rfd;
+  aio->depth = p.sq_entries;
+  aio->sqmapsiz = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+  aio->cqmapsiz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (aio->cqmapsiz > aio->sqmapsiz) aio->sqmapsiz = aio->cqmapsiz;
+    aio->cqmapsiz = aio->sqmapsiz;
+  }
+  aio->sqmap = mmap(NULL, aio->sqmapsiz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    rfd, IORING_OFF_SQ_RING);
+  if (aio->sqmap == MAP_FAILED) {
+    aio->sqmap = NULL;
+    return -1;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    aio->cqmap = aio->sqmap;
+  } else {
+    aio->cqmap = mmap(NULL, aio->cqmapsiz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      rfd, IORING_OFF_CQ_RING);
+    if (aio->cqmap == MAP_FAILED) {
+      aio->cqmap = NULL;
+      return -1;
+    }
+  }
+  aio->sqessiz = p.sq_entries * sizeof(struct io_uring_sqe);
+  aio->sqes = mmap(NULL, aio->sqessiz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   rfd, IORING_OFF_SQES);
+  if (aio->sqes == MAP_FAILED) {
+    aio->sqes = NULL;
+    return -1;
+  }
+  aio->sqtail = (uint32_t *)(aio->sqmap + p.sq_off.tail);
+  aio->sqmask = *(uint32_t *)(aio->sqmap + p.sq_off.ring_mask);
+  aio->sqarray = (uint32_t *)(aio->sqmap + p.sq_off.array);
+  aio->cqhead = (uint32_t *)(aio->cqmap + p.cq_off.head);
+  aio->cqtail = (uint32_t *)(aio->cqmap + p.cq_off.tail);
+  aio->cqmask = *(uint32_t *)(aio->cqmap + p.cq_off.ring_mask);
+  aio->cqes = aio->cqmap + p.cq_off.cqes;
+  return ssaioprobe(aio);
+#else
+  (void)aio;
+  return -1;
+#endif
+}
+
+#if HAVE_IOURING
+static int ssaioprobe(SSAIO *aio) {
+  /* rings of kernels before 5.6 set up fine but fail every `IORING_OP_READ', and they lack
+     the probe as well, so a failed probe leaves the `pread' fallback too */
+  struct io_uring_probe *probe;
+  size_t psiz = sizeof(*probe) + sizeof(struct io_uring_probe_op) * AIOPROBEOPS;
+  SSMALLOC(probe, psiz);
+  if (probe == NULL) return -1;
+  memset(probe, 0, psiz);
+  int r = syscall(__NR_io_uring_register, aio->rfd, IORING_REGISTER_PROBE, probe, AIOPROBEOPS);
+  int ok = r >= 0 && probe->last_op >= IORING_OP_READ &&
+    (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+  SSFREE(probe);
+  return ok ? 0 : -1;
+}
+#endif
+
+static void ssaioteardown(SSAIO *aio) {
+  uint32_t depth = aio->depth;
+  if (aio->sqes) munmap(aio->sqes, aio->sqessiz);
+  if (aio->cqmap && aio->cqmap != aio->sqmap) munmap(aio->cqmap, aio->cqmapsiz);
+  if (aio->sqmap) munmap(aio->sqmap, aio->sqmapsiz);
+  if (aio->rfd >= 0) close(aio->rfd);
+  ssaioclear(aio);
+  aio->depth = depth;
+}
+
+static int ssaioreaduring(SSAIO *aio, SSAIOREQ *reqs, int num) {
+#if HAVE_IOURING
+  struct io_uring_sqe *sqes = aio->sqes;
+  struct io_uring_cqe *cqes = aio->cqes;
+  int err = 0, next = 0;
+  uint32_t inflight = 0, pending = 0;
+  while (next < num || inflight > 0) {
+    /* fill the free slots of the submission ring, whose tail only this thread moves */
+    uint32_t tail = *aio->sqtail;
+    while (next < num && inflight < aio->depth) {
+      uint32_t sidx = tail & aio->sqmask;
+      struct io_uring_sqe *sqe = sqes + sidx;
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = reqs[next].fd;
+      sqe->addr = (uintptr_t)reqs[next].buf;
+      sqe->len = reqs[next].siz;
+      sqe->off = reqs[next].off;
+      sqe->user_data = next;
+      aio->sqarray[sidx] = sidx;
+      tail++;
+      pending++;
+      inflight++;
+      next++;
+    }
+    AIOSTOREREL(aio->sqtail, tail);
+    int r;
+    SSSYS_NOINTR(r, syscall(__NR_io_uring_enter, aio->rfd, pending, 1,
+                            IORING_ENTER_GETEVENTS, NULL, 0));
+    if (r < 0 && pending < 1) {
+      /* the kernel may still fill the buffers of requests in flight, so they are reaped
+         below before returning, and the rest are read here */
+      for (; next < num; next++) {
+        if (ssaiopread(reqs + next, 0) != 0) err = -1;
+      }
+      sched_yield();
+    } else if (r < 0) {
+      /* the kernel took none of the pending entries, so they and the rest are read here */
+      uint32_t i;
+      for (i = tail - pending; i != tail; i++) {
+        SSAIOREQ *req = reqs + sqes[i & aio->sqmask].user_data;
+        if (ssaiopread(req, 0) != 0) err = -1;
+      }
+      AIOSTOREREL(aio->sqtail, tail - pending);
+      inflight -= pending;
+      pending = 0;
+      for (; next < num; next++) {
+        if (ssaiopread(reqs + next, 0) != 0) err = -1;
+      }
+      continue;
+    }
+    pending -= ((uint32_t)r < pending) ? (uint32_t)r : pending;
+    uint32_t head = *aio->cqhead;
+    while (head != AIOLOADACQ(aio->cqtail)) {
+      struct io_uring_cqe *cqe = cqes + (head & aio->cqmask);
+      SSAIOREQ *req = reqs + cqe->user_data;
+      req->res = cqe->res;
+      if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) {
+        /* a ring refusing the operation for this file is bypassed */
+        if (ssaiopread(req, 0) != 0) err = -1;
+      } else if (cqe->res >= 0 && (uint32_t)cqe->res < req->siz) {
+        /* a short read before the end of the file is finished synchronously */
+        if (ssaiopread(req, cqe->res) != 0) err = -1;
+      } else if (cqe->res < 0) {
+        err = -1;
+      }
+      head++;
+      inflight--;
+    }
+    AIOSTOREREL(aio->cqhead, head);
+  }
+  return err;
+#else
+  (void)aio;
+  (void)reqs;
+  (void)num;
+  return -1;
+#endif
+}
+
+static int ssaiopread(SSAIOREQ *req, uint32_t done) {
+  /* `done' bytes are already read; the rest is read with `pread' */
+  while (done < req->siz) {
+    ssize_t r;
+    SSSYS_NOINTR(r, pread(req->fd, (char *)req->buf + done, req->siz - done, req->off + done));
+    if (r < 0) {
+      req->res = -errno;
+      return -1;
+    }
+    if (r == 0) break;
+    done += r;
+  }
+  req->res = done;
+  return done < req->siz ? -1 : 0;
+}
+
+static void ssaiothreadinit(void) {
+  pthread_key_create(&aiothreadkey, ssaiothreaddel);
+}
+
+static void ssaiothreaddel(void *p) {
+  ssaiodel(p);
+}
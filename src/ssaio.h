@@ -0,0 +1,80 @@
+#ifndef SSAIO_H_
+#define SSAIO_H_
+
+#if defined(__cplusplus)
+#define SSAIO_CLINKAGEBEGIN extern "C" {
+#define SSAIO_CLINKAGEEND }
+#else
+#define SSAIO_CLINKAGEBEGIN
+#define SSAIO_CLINKAGEEND
+#endif
+SSAIO_CLINKAGEBEGIN
+
+#include <stdint.h>
+
+typedef struct {  /* read request of a batch */
+  int fd;         /* file descriptor to read from */
+  void *buf;      /* region into which the data is read */
+  uint32_t siz;   /* size of the region */
+  uint64_t off;   /* offset in the file */
+  int res;        /* bytes read, or a negated errno value */
+} SSAIOREQ;
+
+typedef struct {
+  int rfd;                    /* file descriptor of the io_uring, or -1 for `pread' */
+  uint32_t depth;             /* number of requests in flight at most */
+  char *sqmap;                /* mapped submission ring */
+  uint64_t sqmapsiz;          /* size of the mapped submission ring */
+  char *cqmap;                /* mapped completion ring, which may be `sqmap' */
+  uint64_t cqmapsiz;          /* size of the mapped completion ring */
+  void *sqes;                 /* mapped submission entries */
+  uint64_t sqessiz;           /* size of the mapped submission entries */
+  uint32_t *sqtail;           /* tail of the submission ring */
+  uint32_t sqmask;            /* mask of submission ring indices */
+  uint32_t *sqarray;          /* indices of submission entries */
+  uint32_t *cqhead;           /* head of the completion ring */
+  uint32_t *cqtail;           /* tail of the completion ring */
+  uint32_t cqmask;            /* mask of completion ring indices */
+  void *cqes;                 /* completion entries */
+} SSAIO;
+
+enum { /* enumeration for options of `ssaionew' */
+  SSAIONOURING = 1 << 0 /* use `pread' even where io_uring is available */
+};
+
+/* Create an asynchronous read object.
+   `depth' specifies the number of requests kept in flight at most. If it is not more than 0,
+   the default number is specified.
+   `opts' specifies options by bitwise-or: `SSAIONOURING' forces the `pread' fallback.
+   The return value is the new object, or `NULL' on failure. An io_uring is set up with raw
+   system calls where the kernel allows it, and `pread' is used otherwise.
+   The object must not be shared by threads; see `ssaiothread'. */
+SSAIO *ssaionew(uint32_t depth, int opts);
+
+/* Delete an asynchronous read object.
+   `aio' specifies the object. */
+void ssaiodel(SSAIO *aio);
+
+/* Get the asynchronous read object of the calling thread.
+   The return value is the object, which is created on the first call of each thread and
+   deleted when the thread exits, or `NULL' on failure. */
+SSAIO *ssaiothread(void);
+
+/* Check whether an asynchronous read object uses io_uring.
+   `aio' specifies the object.
+   The return value is true if io_uring is used, or false if `pread' is. */
+int ssaiouring(SSAIO *aio);
+
+/* Read a batch of regions.
+   `aio' specifies the object.
+   `reqs' specifies the array of requests whose `fd', `buf', `siz' and `off' are set. `res' of
+   each is assigned the number of bytes read, which is less than `siz' only at the end of the
+   file, or a negated errno value.
+   `num' specifies the number of requests.
+   Requests are submitted up to the depth of the object at a time and the call returns when
+   all of them are complete.
+   The return value is 0 if every request read `siz' bytes, or -1 otherwise. */
+int ssaioread(SSAIO *aio, SSAIOREQ *reqs, int num);
+
+SSAIO_CLINKAGEEND
+#endif
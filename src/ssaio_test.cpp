@@ -0,0 +1,86 @@
+#include <ssaio.h>
+
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define AIOTESTPATH "./ssaiotest.dat"
+#define AIOTESTSIZ  (1024 * 1024)
+
+class SSAIOTestFixture : public testing::TestWithParam<int> {
+protected:
+  void SetUp() {
+    data.resize(AIOTESTSIZ);
+    for (size_t i = 0; i < data.size(); i++)
+      data[i] = 'a' + rand() % 26;
+    fd = open(AIOTESTPATH, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_TRUE(fd >= 0);
+    ASSERT_EQ((ssize_t)data.size(), write(fd, data.data(), data.size()));
+    aio = ssaionew(8, GetParam());
+    ASSERT_TRUE(aio != NULL);
+  }
+  void TearDown() {
+    ssaiodel(aio);
+    close(fd);
+    unlink(AIOTESTPATH);
+  }
+  string data;
+  int fd;
+  SSAIO *aio;
+};
+
+TEST_P(SSAIOTestFixture, backend) {
+  if (GetParam() & SSAIONOURING) {
+    ASSERT_FALSE(ssaiouring(aio));
+  }
+}
+
+TEST_P(SSAIOTestFixture, read_batch) {
+  /* more requests than the depth, in random order */
+  const int num = 100;
+  vector<SSAIOREQ> reqs(num);
+  vector<string> bufs(num);
+  for (int i = 0; i < num; i++) {
+    uint32_t siz = 1 + rand() % 8192;
+    bufs[i].resize(siz);
+    reqs[i].fd = fd;
+    reqs[i].buf = &bufs[i][0];
+    reqs[i].siz = siz;
+    reqs[i].off = rand() % (AIOTESTSIZ - siz);
+  }
+  ASSERT_EQ(0, ssaioread(aio, &reqs[0], num));
+  for (int i = 0; i < num; i++) {
+    ASSERT_EQ((int)reqs[i].siz, reqs[i].res);
+    ASSERT_EQ(data.substr(reqs[i].off, reqs[i].siz), bufs[i]);
+  }
+  ASSERT_EQ(0, ssaioread(aio, &reqs[0], 0));
+}
+
+TEST_P(SSAIOTestFixture, read_past_end) {
+  char buf[16];
+  SSAIOREQ reqs[2];
+  reqs[0].fd = fd;
+  reqs[0].buf = buf;
+  reqs[0].siz = sizeof(buf);
+  reqs[0].off = AIOTESTSIZ - 4;
+  reqs[1].fd = -1;
+  reqs[1].buf = buf;
+  reqs[1].siz = sizeof(buf);
+  reqs[1].off = 0;
+  ASSERT_EQ(-1, ssaioread(aio, reqs, 2));
+  ASSERT_EQ(4, reqs[0].res);
+  ASSERT_EQ(data.substr(AIOTESTSIZ - 4), string(buf, 4));
+  ASSERT_EQ(-EBADF, reqs[1].res);
+}
+
+INSTANTIATE_TEST_CASE_P(SSAIO, SSAIOTestFixture, testing::Values(0, (int)SSAIONOURING));
+
+TEST(SSAIOThreadTest, per_thread) {
+  SSAIO *aio = ssaiothread();
+  ASSERT_TRUE(aio != NULL);
+  ASSERT_EQ(aio, ssaiothread());
+}
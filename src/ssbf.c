@@ -66,6 +66,8 @@ int ssbfadd(SSBF *bf, const void *buf, int siz) {
     return -1;
   }
   unsigned int i;
+  if (bf->nfuncs < 1)
+    ssbfsetbits(bf->map, bf->mapsiz * CHAR_BIT, SSBFDEFNHASH, ssbfhash(buf, siz));
   for (i = 0; i < bf->nfuncs; i++) {
     uint64_t v = bf->funcs[i]((const char*)buf, siz);
     uint64_t n = v % (bf->mapsiz * CHAR_BIT);
@@ -82,12 +84,62 @@ int ssbfhas(SSBF *bf, const void *buf, int siz) {
     return -1;
   }
   unsigned int i;
-  for (i = 0; i < bf->nfuncs; i++) {
+  int ret = 1;
+  if (bf->nfuncs < 1)
+    ret = ssbftestbits(bf->map, bf->mapsiz * CHAR_BIT, SSBFDEFNHASH, ssbfhash(buf, siz));
+  for (i = 0; i < bf->nfuncs && ret; i++) {
     uint64_t v = bf->funcs[i]((const char*)buf, siz);
     uint64_t n = v % (bf->mapsiz * CHAR_BIT);
-    if (!GET_BIT(bf->map, n)) return 0;
+    if (!GET_BIT(bf->map, n)) ret = 0;
   }
   pthread_rwlock_unlock(&bf->mtx);
+  return ret;
+}
+
+uint64_t ssbfhash(const void *buf, int siz) {
+  /* MurmurHash64A */
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const unsigned char *p = buf;
+  uint64_t h = 0x9747b28cULL ^ (siz * m);
+  while (siz >= 8) {
+    uint64_t k;
+    memcpy(&k, p, sizeof(k));
+    k *= m;
+    k ^= k >> 47;
+    k *= m;
+    h ^= k;
+    h *= m;
+    p += 8;
+    siz -= 8;
+  }
+  if (siz > 0) {
+    while (siz-- > 0)
+      h ^= (uint64_t)p[siz] << (8 * siz);
+    h *= m;
+  }
+  h ^= h >> 47;
+  h *= m;
+  h ^= h >> 47;
+  return h;
+}
+
+void ssbfsetbits(char *bits, uint64_t nbits, int nhash, uint64_t hash) {
+  /* double hashing: probe i is h1 + i * h2 */
+  uint64_t h1 = hash, h2 = (hash >> 32) | (hash << 32);
+  int i;
+  for (i = 0; i < nhash; i++) {
+    uint64_t n = (h1 + i * h2) % nbits;
+    SET_BIT(bits, n);
+  }
+}
+
+int ssbftestbits(const char *bits, uint64_t nbits, int nhash, uint64_t hash) {
+  uint64_t h1 = hash, h2 = (hash >> 32) | (hash << 32);
+  int i;
+  for (i = 0; i < nhash; i++) {
+    uint64_t n = (h1 + i * h2) % nbits;
+    if (!GET_BIT(bits, n)) return 0;
+  }
   return 1;
 }
 #undef SET_BIT
@@ -27,6 +27,8 @@ typedef struct {
   int ecode;
 } SSBF;
 
+#define SSBFDEFNHASH 7 /* default number of probes, the best for 10 bits per element */
+
 enum { /* enumeration for open modes */
   SSBFOREADER = 1 << 0, /* open as a reader */
   SSBFOWRITER = 1 << 1, /* open as a writer */
@@ -46,7 +48,7 @@ void ssbfdel(SSBF *bf);
 /* Open a bloom-filter object.
    `bf' specifies the bloom-filter object.
    `path' specifies the path of the bloom-filter file.
-   `omode' specifies the open mode: `SSBFOREADER' as a reader, `SSBOWRITER' as a writer.
+   `omode' specifies the open mode: `SSBFOREADER' as a reader, `SSBFOWRITER' as a writer.
    If the mode is `SSBFOWRITER', the following may be added by bitwise-or: `SSBFOCREAT', which
    means it creates a new database if not exist.
    The return value is 0 for success, otherwise -1. */
@@ -73,5 +75,27 @@ int ssbfadd(SSBF *bf, const void *buf, int siz);
    0 if the value is not contained in the filter (100% confidence), -1 if error occurred. */
 int ssbfhas(SSBF *bf, const void *buf, int siz);
 
+/* Get the hash value of a region for bloom-filters.
+   `buf' specifies the pointer to the region.
+   `siz' specifies the size of the region.
+   The return value is the 64-bit hash value. Probes are derived from it, so an element is
+   hashed only once however many probes are used. */
+uint64_t ssbfhash(const void *buf, int siz);
+
+/* Set the bits of an element in a bit array.
+   `bits' specifies the bit array.
+   `nbits' specifies the number of bits of the array.
+   `nhash' specifies the number of probes.
+   `hash' specifies the hash value of the element given by `ssbfhash'. */
+void ssbfsetbits(char *bits, uint64_t nbits, int nhash, uint64_t hash);
+
+/* Check the bits of an element in a bit array.
+   `bits' specifies the bit array.
+   `nbits' specifies the number of bits of the array.
+   `nhash' specifies the number of probes.
+   `hash' specifies the hash value of the element given by `ssbfhash'.
+   The return value is 1 if the element may be contained in the array, or 0 if not. */
+int ssbftestbits(const char *bits, uint64_t nbits, int nhash, uint64_t hash);
+
 SSBF_CLINKAGEEND
 #endif
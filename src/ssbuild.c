@@ -0,0 +1,841 @@
+#include <ssutil.h>
+#include <ssftbl.h>
+#include <ssbuild.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* const or default parameters */
+#define BLDDEFMEMBUDGET (256ULL << 20)   /* default bytes of records held in memory */
+#define BLDDEFTHNUM     2                /* default number of sorting threads */
+#define BLDMINBUFSIZ    (1ULL << 16)     /* minimum bytes of records in a buffer */
+#define BLDMINIOBUFSIZ  (1ULL << 16)     /* minimum size of the buffer of a run */
+#define BLDMAXIOBUFSIZ  (1ULL << 20)     /* maximum size of the buffer of a run */
+#define BLDMAXFANIN     128              /* maximum number of runs merged at once */
+#define BLDFILEMODE     00644            /* permission of created files */
+#define BLDRUNSUFFIX    "-run-%06u.tmp"  /* suffix of the temporary file of a run */
+#define BLDOUTSUFFIX    "-%06u"          /* suffix of a numbered output table */
+#define BLDTMPSUFFIX    ".tmp"           /* suffix of an output table until the build ends */
+#define BLDFILESUFFIX   ".sstbl"         /* suffix of table files, added by SSFTBL */
+#define BLDNUMLEN       16               /* room for a formatted suffix */
+
+typedef struct {                         /* type of structure for a record in a buffer */
+  const char *kbuf;                      /* key, set once the buffer is full */
+  uint64_t off;                          /* offset of the key in the data */
+  uint32_t ksiz;                         /* size of the key */
+  uint32_t vsiz;                         /* size of the value following the key */
+} SSBUILDREC;
+
+typedef struct {                         /* type of structure for a buffer of records */
+  char *data;                            /* keys and values in the order they were put */
+  uint64_t dsiz;                         /* bytes used in `data' */
+  uint64_t dcap;                         /* bytes allocated for `data' */
+  SSBUILDREC *recs;                      /* records in the order they were put */
+  uint32_t rnum;                         /* number of records */
+  uint32_t rcap;                         /* number of records allocated */
+  uint32_t seq;                          /* number of the run the buffer is spilled to */
+} SSBUILDBUF;
+
+typedef struct {                         /* type of structure for a run being merged */
+  int fd;                                /* file descriptor */
+  char *buf;                             /* read buffer */
+  size_t bcap;                           /* bytes allocated for `buf' */
+  size_t rp;                             /* offset of the next record in `buf' */
+  size_t rsiz;                           /* bytes read into `buf' */
+  int eof;                               /* whether the file is read to the end */
+  const char *kbuf;                      /* key of the current record */
+  int ksiz;                              /* size of the key */
+  const char *vbuf;                      /* value of the current record */
+  int vsiz;                              /* size of the value */
+  uint32_t seq;                          /* number of the run, larger for newer records */
+} SSBUILDRUN;
+
+typedef struct {                         /* type of structure for a run being written */
+  int fd;                                /* file descriptor */
+  char *buf;                             /* write buffer */
+  size_t bsiz;                           /* bytes allocated for `buf' */
+  size_t wsiz;                           /* bytes waiting in `buf' */
+} SSBUILDRUNW;
+
+typedef struct {                         /* type of structure for the output being written */
+  SSFTBL *tbl;                           /* table being written, or NULL */
+  uint64_t fsiz;                         /* bytes of records in `tbl' */
+} SSBUILDOUT;
+
+/* private function prototypes */
+static void ssbuildclear(SSBUILD *bld);
+static SSBUILDBUF *ssbuildbufnew(void);
+static void ssbuildbufdel(SSBUILDBUF *buf);
+static uint64_t ssbuildbufsiz(SSBUILDBUF *buf);
+static uint32_t ssbuildbufsort(SSBUILDBUF *buf);
+static int ssbuildreccmp(const void *a, const void *b);
+static int ssbuildqueue(SSBUILD *bld, SSBUILDBUF *buf);
+static void *ssbuildsorter(void *arg);
+static int ssbuildspill(SSBUILD *bld, SSBUILDBUF *buf, int *ep);
+static char *ssbuildrunpath(SSBUILD *bld, uint32_t seq);
+static char *ssbuildoutpath(SSBUILD *bld, uint32_t seq, const char *suffix);
+static int ssbuildfinishout(SSBUILD *bld, int err);
+static int ssbuildrunwopen(SSBUILD *bld, SSBUILDRUNW *w, uint32_t seq, int *ep);
+static int ssbuildrunwput(SSBUILDRUNW *w, const char *kbuf, int ksiz, const char *vbuf,
+                          int vsiz, int *ep);
+static int ssbuildrunwflush(SSBUILDRUNW *w, int *ep);
+static int ssbuildrunwclose(SSBUILDRUNW *w, int *ep);
+static int ssbuildmergeall(SSBUILD *bld, SSBUILDOUT *out);
+static int ssbuildmerge(SSBUILD *bld, const uint32_t *ids, uint32_t rnum, SSBUILDOUT *out,
+                        SSBUILDRUNW *w);
+static int ssbuildrunnext(SSBUILD *bld, SSBUILDRUN *run);
+static int ssbuildruncmp(const SSBUILDRUN *a, const SSBUILDRUN *b);
+static void ssbuildheapdown(SSBUILDRUN **heap, uint32_t num, uint32_t i);
+static int ssbuildemit(SSBUILD *bld, SSBUILDOUT *out, const void *kbuf, int ksiz,
+                       const void *vbuf, int vsiz);
+static int ssbuildopenout(SSBUILD *bld, SSBUILDOUT *out);
+static int ssbuildcloseout(SSBUILD *bld, SSBUILDOUT *out);
+static void ssbuildsetecode(SSBUILD *bld, int ecode);
+
+/*-----------------------------------------------------------------------------
+ * APIs
+ */
+SSBUILD *ssbuildnew(void) {
+  SSBUILD *bld;
+  SSMALLOC(bld, sizeof(SSBUILD));
+  if (bld == NULL) return NULL;
+  ssbuildclear(bld);
+  pthread_mutex_init(&bld->mtx, NULL);
+  pthread_cond_init(&bld->cond, NULL);
+  return bld;
+}
+
+void ssbuilddel(SSBUILD *bld) {
+  assert(bld);
+  if (bld->open) ssbuildclose(bld);
+  pthread_cond_destroy(&bld->cond);
+  pthread_mutex_destroy(&bld->mtx);
+  SSFREE(bld);
+}
+
+int ssbuildtune(SSBUILD *bld, uint64_t membudget, uint32_t thnum, uint64_t maxfsiz) {
+  assert(bld);
+  if (bld->open) {
+    ssbuildsetecode(bld, SSEINVALID);
+    return -1;
+  }
+  bld->membudget = (membudget > 0) ? membudget : BLDDEFMEMBUDGET;
+  bld->thnum = (thnum > 0) ? thnum : BLDDEFTHNUM;
+  bld->maxfsiz = maxfsiz;
+  return 0;
+}
+
+int ssbuildtunetbl(SSBUILD *bld, uint64_t blksiz, int cmethod, int opts) {
+  assert(bld);
+  if (bld->open) {
+    ssbuildsetecode(bld, SSEINVALID);
+    return -1;
+  }
+  bld->blksiz = blksiz;
+  bld->cmethod = cmethod;
+  bld->opts = opts;
+  return 0;
+}
+
+int ssbuildopen(SSBUILD *bld, const char *path) {
+  assert(bld && path);
+  if (bld->open) {
+    ssbuildsetecode(bld, SSEINVALID);
+    return -1;
+  }
+  /* the buffer being filled and one per sorting thread share the budget */
+  bld->cbufsiz = bld->membudget / (bld->thnum + 1);
+  if (bld->cbufsiz < BLDMINBUFSIZ) bld->cbufsiz = BLDMINBUFSIZ;
+  /* runs are merged `fanin' at a time, each read through a buffer carved from the budget,
+     which also bounds the open file descriptors */
+  uint64_t fanin = bld->membudget / BLDMINIOBUFSIZ;
+  fanin = (fanin > 3) ? fanin - 1 : 2;
+  bld->fanin = (fanin < BLDMAXFANIN) ? fanin : BLDMAXFANIN;
+  bld->iobufsiz = bld->membudget / (bld->fanin + 1);
+  if (bld->iobufsiz < BLDMINIOBUFSIZ) bld->iobufsiz = BLDMINIOBUFSIZ;
+  if (bld->iobufsiz > BLDMAXIOBUFSIZ) bld->iobufsiz = BLDMAXIOBUFSIZ;
+  bld->path = strdup(path);
+  bld->cbuf = ssbuildbufnew();
+  SSMALLOC(bld->queue, sizeof(SSBUILDBUF *) * bld->thnum);
+  SSMALLOC(bld->ths, sizeof(pthread_t) * bld->thnum);
+  if (bld->path == NULL || bld->cbuf == NULL || bld->queue == NULL || bld->ths == NULL) {
+    ssbuildsetecode(bld, SSEMISC);
+    goto err;
+  }
+  bld->qhead = 0;
+  bld->qnum = 0;
+  bld->busy = 0;
+  bld->runnum = 0;
+  bld->mrunnum = 0;
+  bld->onum = 0;
+  bld->stop = 0;
+  bld->wecode = SSESUCCESS;
+  for (bld->thstarted = 0; bld->thstarted < bld->thnum; bld->thstarted++) {
+    if (pthread_create(&bld->ths[bld->thstarted], NULL, ssbuildsorter, bld) != 0) {
+      ssbuildsetecode(bld, SSETHREAD);
+      goto err;
+    }
+  }
+  bld->open = 1;
+  return 0;
+err:
+  /* closing stops the threads started so far and writes no table */
+  bld->open = 1;
+  bld->wecode = bld->ecode;
+  ssbuildclose(bld);
+  return -1;
+}
+
+int ssbuildput(SSBUILD *bld, const void *kbuf, int ksiz, const void *vbuf, int vsiz) {
+  assert(bld && kbuf && ksiz > 0 && vbuf && vsiz > 0);
+  if (!bld->open) {
+    ssbuildsetecode(bld, SSEINVALID);
+    return -1;
+  }
+  SSBUILDBUF *buf = bld->cbuf;
+  uint64_t rsiz = (uint64_t)ksiz + vsiz;
+  if (buf->dsiz + rsiz > buf->dcap) {
+    uint64_t dcap = (buf->dcap > 0) ? buf->dcap * 2 : BLDMINBUFSIZ;
+    while (dcap < buf->dsiz + rsiz) dcap *= 2;
+    char *data;
+    SSREALLOC(data, buf->data, dcap);
+    if (data == NULL) {
+      ssbuildsetecode(bld, SSEMISC);
+      return -1;
+    }
+    buf->data = data;
+    buf->dcap = dcap;
+  }
+  if (buf->rnum >= buf->rcap) {
+    uint32_t rcap = (buf->rcap > 0) ? buf->rcap * 2 : 1024;
+    SSBUILDREC *recs;
+    SSREALLOC(recs, buf->recs, sizeof(SSBUILDREC) * rcap);
+    if (recs == NULL) {
+      ssbuildsetecode(bld, SSEMISC);
+      return -1;
+    }
+    buf->recs = recs;
+    buf->rcap = rcap;
+  }
+  SSBUILDREC *rec = buf->recs + buf->rnum++;
+  rec->kbuf = NULL;
+  rec->off = buf->dsiz;
+  rec->ksiz = ksiz;
+  rec->vsiz = vsiz;
+  memcpy(buf->data + buf->dsiz, kbuf, ksiz);
+  memcpy(buf->data + buf->dsiz + ksiz, vbuf, vsiz);
+  buf->dsiz += rsiz;
+  if (ssbuildbufsiz(buf) < bld->cbufsiz) return 0;
+  /* the full buffer is handed to a sorting thread and a fresh one takes the records */
+  SSBUILDBUF *nbuf = ssbuildbufnew();
+  if (nbuf == NULL) {
+    ssbuildsetecode(bld, SSEMISC);
+    return -1;
+  }
+  if (ssbuildqueue(bld, buf) != 0) {
+    ssbuildbufdel(nbuf);
+    return -1;
+  }
+  bld->cbuf = nbuf;
+  return 0;
+}
+
+int ssbuildclose(SSBUILD *bld) {
+  assert(bld);
+  if (!bld->open) {
+    ssbuildsetecode(bld, SSEINVALID);
+    return -1;
+  }
+  int err = 0;
+  uint32_t i;
+  SSBUILDBUF *cbuf = bld->cbuf;
+  /* the last buffer joins the runs only if some were spilled */
+  if (cbuf && cbuf->rnum > 0 && bld->runnum > 0) {
+    if (ssbuildqueue(bld, cbuf) == 0) {
+      cbuf = NULL;
+    } else {
+      err = -1;
+    }
+  }
+  pthread_mutex_lock(&bld->mtx);
+  while ((bld->qnum > 0 || bld->busy > 0) && bld->wecode == SSESUCCESS)
+    pthread_cond_wait(&bld->cond, &bld->mtx);
+  bld->stop = 1;
+  pthread_cond_broadcast(&bld->cond);
+  pthread_mutex_unlock(&bld->mtx);
+  for (i = 0; i < bld->thstarted; i++) {
+    pthread_join(bld->ths[i], NULL);
+  }
+  /* buffers left in the queue by a failed thread are never spilled */
+  for (i = 0; i < bld->qnum; i++) {
+    ssbuildbufdel(bld->queue[(bld->qhead + i) % bld->thnum]);
+  }
+  if (bld->wecode != SSESUCCESS) {
+    ssbuildsetecode(bld, bld->wecode);
+    err = -1;
+  }
+  if (!err) {
+    SSBUILDOUT out = {NULL, 0};
+    /* a single output is written even if no record was put */
+    if (bld->maxfsiz == 0 && ssbuildopenout(bld, &out) != 0) err = -1;
+    if (!err && bld->runnum > 0) {
+      if (ssbuildmergeall(bld, &out) != 0) err = -1;
+    } else if (!err && cbuf) {
+      uint32_t rnum = ssbuildbufsort(cbuf);
+      for (i = 0; i < rnum && !err; i++) {
+        SSBUILDREC *rec = cbuf->recs + i;
+        if (ssbuildemit(bld, &out, rec->kbuf, rec->ksiz, rec->kbuf + rec->ksiz,
+                        rec->vsiz) != 0) err = -1;
+      }
+    }
+    if (out.tbl) {
+      if (!err) {
+        if (ssbuildcloseout(bld, &out) != 0) err = -1;
+      } else {
+        /* the error is already set, and the output is removed anyway */
+        ssftblclose(out.tbl);
+        ssftbldel(out.tbl);
+      }
+    }
+  }
+  if (ssbuildfinishout(bld, err) != 0) err = -1;
+  for (i = 0; i < bld->runnum + bld->mrunnum; i++) {
+    char *rpath = ssbuildrunpath(bld, i);
+    if (unlink(rpath) != 0 && errno != ENOENT && !err) {
+      ssbuildsetecode(bld, SSEUNLINK);
+      err = -1;
+    }
+    SSFREE(rpath);
+  }
+  if (cbuf) ssbuildbufdel(cbuf);
+  if (bld->queue) SSFREE(bld->queue);
+  if (bld->ths) SSFREE(bld->ths);
+  if (bld->path) SSFREE(bld->path);
+  int ecode = bld->ecode;
+  uint64_t membudget = bld->membudget, maxfsiz = bld->maxfsiz, blksiz = bld->blksiz;
+  uint32_t thnum = bld->thnum, runnum = bld->runnum, mrunnum = bld->mrunnum;
+  uint32_t fanin = bld->fanin, onum = bld->onum;
+  int cmethod = bld->cmethod, opts = bld->opts;
+  ssbuildclear(bld);
+  bld->ecode = ecode;
+  bld->membudget = membudget;
+  bld->thnum = thnum;
+  bld->maxfsiz = maxfsiz;
+  bld->blksiz = blksiz;
+  bld->cmethod = cmethod;
+  bld->opts = opts;
+  bld->fanin = fanin;
+  bld->runnum = runnum;
+  bld->mrunnum = mrunnum;
+  bld->onum = onum;
+  return err;
+}
+
+/*-----------------------------------------------------------------------------
+ * private functions
+ */
+static void ssbuildclear(SSBUILD *bld) {
+  assert(bld);
+  bld->path = NULL;
+  bld->membudget = BLDDEFMEMBUDGET;
+  bld->thnum = BLDDEFTHNUM;
+  bld->maxfsiz = 0;
+  bld->blksiz = 0;
+  bld->cmethod = 0;
+  bld->opts = 0;
+  bld->cbuf = NULL;
+  bld->cbufsiz = 0;
+  bld->fanin = 0;
+  bld->iobufsiz = 0;
+  bld->queue = NULL;
+  bld->qhead = 0;
+  bld->qnum = 0;
+  bld->busy = 0;
+  bld->runnum = 0;
+  bld->mrunnum = 0;
+  bld->onum = 0;
+  bld->ths = NULL;
+  bld->thstarted = 0;
+  bld->open = 0;
+  bld->stop = 1;
+  bld->wecode = SSESUCCESS;
+  bld->ecode = SSESUCCESS;
+}
+
+static SSBUILDBUF *ssbuildbufnew(void) {
+  SSBUILDBUF *buf;
+  SSMALLOC(buf, sizeof(SSBUILDBUF));
+  if (buf == NULL) return NULL;
+  buf->data = NULL;
+  buf->dsiz = 0;
+  buf->dcap = 0;
+  buf->recs = NULL;
+  buf->rnum = 0;
+  buf->rcap = 0;
+  buf->seq = 0;
+  return buf;
+}
+
+static void ssbuildbufdel(SSBUILDBUF *buf) {
+  assert(buf);
+  if (buf->recs) SSFREE(buf->recs);
+  if (buf->data) SSFREE(buf->data);
+  SSFREE(buf);
+}
+
+static uint64_t ssbuildbufsiz(SSBUILDBUF *buf) {
+  /* records are charged with their index entries, which dominate for small records */
+  return buf->dsiz + (uint64_t)buf->rnum * sizeof(SSBUILDREC);
+}
+
+static uint32_t ssbuildbufsort(SSBUILDBUF *buf) {
+  /* sort the records by key and the order they were put, then keep the last of each key;
+     the return value is the number of records left */
+  uint32_t i, num = 0;
+  for (i = 0; i < buf->rnum; i++) {
+    buf->recs[i].kbuf = buf->data + buf->recs[i].off;
+  }
+  if (buf->rnum > 1) qsort(buf->recs, buf->rnum, sizeof(SSBUILDREC), ssbuildreccmp);
+  for (i = 0; i < buf->rnum; i++) {
+    SSBUILDREC *rec = buf->recs + i, *next = rec + 1;
+    if (i + 1 < buf->rnum && rec->ksiz == next->ksiz &&
+        memcmp(rec->kbuf, next->kbuf, rec->ksiz) == 0) continue;
+    buf->recs[num++] = *rec;
+  }
+  return num;
+}
+
+static int ssbuildreccmp(const void *a, const void *b) {
+  const SSBUILDREC *ra = a, *rb = b;
+  uint32_t min = (ra->ksiz < rb->ksiz) ? ra->ksiz : rb->ksiz;
+  int r = memcmp(ra->kbuf, rb->kbuf, min);
+  if (r != 0) return r;
+  if (ra->ksiz != rb->ksiz) return (ra->ksiz < rb->ksiz) ? -1 : 1;
+  /* offsets grow with the order the records were put */
+  return (ra->off < rb->off) ? -1 : (ra->off > rb->off);
+}
+
+static int ssbuildqueue(SSBUILD *bld, SSBUILDBUF *buf) {
+  /* wait for a free sorting thread so that at most `thnum' full buffers are held */
+  int err = 0;
+  pthread_mutex_lock(&bld->mtx);
+  while (bld->qnum + bld->busy >= bld->thnum && bld->wecode == SSESUCCESS)
+    pthread_cond_wait(&bld->cond, &bld->mtx);
+  if (bld->wecode == SSESUCCESS) {
+    buf->seq = bld->runnum++;
+    bld->queue[(bld->qhead + bld->qnum) % bld->thnum] = buf;
+    bld->qnum++;
+    pthread_cond_broadcast(&bld->cond);
+  } else {
+    ssbuildsetecode(bld, bld->wecode);
+    err = -1;
+  }
+  pthread_mutex_unlock(&bld->mtx);
+  return err;
+}
+
+static void *ssbuildsorter(void *arg) {
+  SSBUILD *bld = arg;
+  pthread_mutex_lock(&bld->mtx);
+  while (1) {
+    while (!bld->stop && bld->qnum == 0)
+      pthread_cond_wait(&bld->cond, &bld->mtx);
+    if (bld->qnum == 0 || bld->wecode != SSESUCCESS) break;
+    SSBUILDBUF *buf = bld->queue[bld->qhead];
+    bld->qhead = (bld->qhead + 1) % bld->thnum;
+    bld->qnum--;
+    bld->busy++;
+    pthread_mutex_unlock(&bld->mtx);
+    int ecode = SSESUCCESS;
+    ssbuildspill(bld, buf, &ecode);
+    ssbuildbufdel(buf);
+    pthread_mutex_lock(&bld->mtx);
+    bld->busy--;
+    if (ecode != SSESUCCESS && bld->wecode == SSESUCCESS) bld->wecode = ecode;
+    pthread_cond_broadcast(&bld->cond);
+  }
+  pthread_mutex_unlock(&bld->mtx);
+  return NULL;
+}
+
+static int ssbuildspill(SSBUILD *bld, SSBUILDBUF *buf, int *ep) {
+  /* sort a buffer and write it to the file of its run */
+  uint32_t rnum = ssbuildbufsort(buf), i;
+  SSBUILDRUNW w;
+  if (ssbuildrunwopen(bld, &w, buf->seq, ep) != 0) return -1;
+  int err = 0;
+  for (i = 0; i < rnum && !err; i++) {
+    SSBUILDREC *rec = buf->recs + i;
+    if (ssbuildrunwput(&w, rec->kbuf, rec->ksiz, rec->kbuf + rec->ksiz, rec->vsiz, ep) != 0)
+      err = -1;
+  }
+  if (ssbuildrunwclose(&w, ep) != 0) err = -1;
+  return err;
+}
+
+static char *ssbuildrunpath(SSBUILD *bld, uint32_t seq) {
+  char *path;
+  SSMALLOC(path, strlen(bld->path) + sizeof(BLDRUNSUFFIX) + BLDNUMLEN);
+  sprintf(path, "%s" BLDRUNSUFFIX, bld->path, seq);
+  return path;
+}
+
+static int ssbuildrunwopen(SSBUILD *bld, SSBUILDRUNW *w, uint32_t seq, int *ep) {
+  char *path = ssbuildrunpath(bld, seq);
+  w->bsiz = bld->iobufsiz;
+  w->wsiz = 0;
+  SSMALLOC(w->buf, w->bsiz);
+  SSSYS_NOINTR(w->fd, open(path, O_WRONLY | O_CREAT | O_TRUNC, BLDFILEMODE));
+  SSFREE(path);
+  if (w->fd < 0 || w->buf == NULL) {
+    if (w->fd >= 0) close(w->fd);
+    if (w->buf) SSFREE(w->buf);
+    *ep = (w->fd < 0) ? SSEOPEN : SSEMISC;
+    return -1;
+  }
+  return 0;
+}
+
+static int ssbuildrunwput(SSBUILDRUNW *w, const char *kbuf, int ksiz, const char *vbuf,
+                          int vsiz, int *ep) {
+  /* records are laid out as the size of the key, the size of the value, the key and the
+     value, with the sizes as variable-length numbers */
+  if (w->wsiz + SSVNUMMAXSIZ * 2 > w->bsiz && ssbuildrunwflush(w, ep) != 0) return -1;
+  w->wsiz += ssvnumput(w->buf + w->wsiz, ksiz);
+  w->wsiz += ssvnumput(w->buf + w->wsiz, vsiz);
+  if (w->wsiz + ksiz + vsiz <= w->bsiz) {
+    memcpy(w->buf + w->wsiz, kbuf, ksiz);
+    memcpy(w->buf + w->wsiz + ksiz, vbuf, vsiz);
+    w->wsiz += ksiz + vsiz;
+    return 0;
+  }
+  /* large records bypass the buffer */
+  if (ssbuildrunwflush(w, ep) != 0) return -1;
+  if (sswrite(w->fd, kbuf, ksiz) != 0 || sswrite(w->fd, vbuf, vsiz) != 0) {
+    *ep = SSEWRITE;
+    return -1;
+  }
+  return 0;
+}
+
+static int ssbuildrunwflush(SSBUILDRUNW *w, int *ep) {
+  size_t wsiz = w->wsiz;
+  w->wsiz = 0;
+  if (wsiz > 0 && sswrite(w->fd, w->buf, wsiz) != 0) {
+    *ep = SSEWRITE;
+    return -1;
+  }
+  return 0;
+}
+
+static int ssbuildrunwclose(SSBUILDRUNW *w, int *ep) {
+  /* the file is closed and the buffer freed even on failure */
+  int err = ssbuildrunwflush(w, ep);
+  SSFREE(w->buf);
+  if (close(w->fd) != 0 && !err) {
+    *ep = SSECLOSE;
+    err = -1;
+  }
+  return err;
+}
+
+static int ssbuildmergeall(SSBUILD *bld, SSBUILDOUT *out) {
+  /* while there are more runs than can be merged at once, merge each group of `fanin'
+     consecutive runs into an intermediate run; the runs are kept oldest first and each group
+     is replaced in place, so newer records still win, and every pass shrinks the runs by a
+     factor of `fanin' */
+  uint32_t *ids, num = bld->runnum, i, j;
+  SSMALLOC(ids, sizeof(uint32_t) * num);
+  if (ids == NULL) {
+    ssbuildsetecode(bld, SSEMISC);
+    return -1;
+  }
+  for (i = 0; i < num; i++) {
+    ids[i] = i;
+  }
+  int err = 0;
+  while (!err && num > bld->fanin) {
+    uint32_t nnum = 0;
+    for (i = 0; i < num && !err; i += bld->fanin) {
+      uint32_t gnum = (num - i < bld->fanin) ? num - i : bld->fanin;
+      if (gnum < 2) {
+        ids[nnum++] = ids[i];
+        continue;
+      }
+      uint32_t seq = bld->runnum + bld->mrunnum++;
+      SSBUILDRUNW w;
+      int ecode = SSESUCCESS;
+      if (ssbuildrunwopen(bld, &w, seq, &ecode) != 0) {
+        ssbuildsetecode(bld, ecode);
+        err = -1;
+        break;
+      }
+      if (ssbuildmerge(bld, ids + i, gnum, NULL, &w) != 0) err = -1;
+      if (ssbuildrunwclose(&w, &ecode) != 0 && !err) {
+        ssbuildsetecode(bld, ecode);
+        err = -1;
+      }
+      /* merged runs are removed at once, so the disk holds about one copy of the input */
+      for (j = 0; j < gnum; j++) {
+        char *rpath = ssbuildrunpath(bld, ids[i + j]);
+        unlink(rpath);
+        SSFREE(rpath);
+      }
+      ids[nnum++] = seq;
+    }
+    num = nnum;
+  }
+  if (!err && ssbuildmerge(bld, ids, num, out, NULL) != 0) err = -1;
+  SSFREE(ids);
+  return err;
+}
+
+static int ssbuildmerge(SSBUILD *bld, const uint32_t *ids, uint32_t rnum, SSBUILDOUT *out,
+                        SSBUILDRUNW *w) {
+  /* merge runs given oldest first into the output tables or into a run, through a heap
+     ordered by key and then newest run first, so the first record of each key popped is the
+     one put last */
+  SSBUILDRUN *runs, **heap;
+  SSMALLOC(runs, sizeof(SSBUILDRUN) * rnum);
+  SSMALLOC(heap, sizeof(SSBUILDRUN *) * rnum);
+  if (runs == NULL || heap == NULL) {
+    if (runs) SSFREE(runs);
+    if (heap) SSFREE(heap);
+    ssbuildsetecode(bld, SSEMISC);
+    return -1;
+  }
+  int err = 0;
+  uint32_t i, num = 0, opened;
+  for (opened = 0; opened < rnum && !err; opened++) {
+    SSBUILDRUN *run = runs + opened;
+    char *path = ssbuildrunpath(bld, ids[opened]);
+    SSSYS_NOINTR(run->fd, open(path, O_RDONLY));
+    SSFREE(path);
+    run->bcap = bld->iobufsiz;
+    SSMALLOC(run->buf, run->bcap);
+    run->rp = 0;
+    run->rsiz = 0;
+    run->eof = 0;
+    run->seq = opened;
+    if (run->fd < 0 || run->buf == NULL) {
+      ssbuildsetecode(bld, (run->fd < 0) ? SSEOPEN : SSEMISC);
+      err = -1;
+      continue;
+    }
+    int r = ssbuildrunnext(bld, run);
+    if (r < 0) {
+      err = -1;
+    } else if (r > 0) {
+      heap[num++] = run;
+    }
+  }
+  for (i = num / 2; i > 0; i--) {
+    ssbuildheapdown(heap, num, i - 1);
+  }
+  char *lkbuf = NULL;
+  int lksiz = -1;
+  size_t lkcap = 0;
+  while (!err && num > 0) {
+    SSBUILDRUN *run = heap[0];
+    if (run->ksiz != lksiz || memcmp(run->kbuf, lkbuf, lksiz) != 0) {
+      if (w) {
+        int ecode = SSESUCCESS;
+        if (ssbuildrunwput(w, run->kbuf, run->ksiz, run->vbuf, run->vsiz, &ecode) != 0) {
+          ssbuildsetecode(bld, ecode);
+          err = -1;
+          break;
+        }
+      } else if (ssbuildemit(bld, out, run->kbuf, run->ksiz, run->vbuf, run->vsiz) != 0) {
+        err = -1;
+        break;
+      }
+      if ((size_t)run->ksiz > lkcap) {
+        lkcap = run->ksiz * 2;
+        char *nbuf;
+        SSREALLOC(nbuf, lkbuf, lkcap);
+        if (nbuf == NULL) {
+          ssbuildsetecode(bld, SSEMISC);
+          err = -1;
+          break;
+        }
+        lkbuf = nbuf;
+      }
+      memcpy(lkbuf, run->kbuf, run->ksiz);
+      lksiz = run->ksiz;
+    }
+    int r = ssbuildrunnext(bld, run);
+    if (r < 0) {
+      err = -1;
+    } else if (r == 0) {
+      heap[0] = heap[--num];
+    }
+    ssbuildheapdown(heap, num, 0);
+  }
+  if (lkbuf) SSFREE(lkbuf);
+  for (i = 0; i < opened; i++) {
+    if (runs[i].fd >= 0) close(runs[i].fd);
+    if (runs[i].buf) SSFREE(runs[i].buf);
+  }
+  SSFREE(heap);
+  SSFREE(runs);
+  return err;
+}
+
+static int ssbuildrunnext(SSBUILD *bld, SSBUILDRUN *run) {
+  /* read the next record of a run; the return value is 1 if it was read, 0 at the end of the
+     run, or -1 on failure */
+  uint64_t ksiz = 0, vsiz = 0;
+  while (1) {
+    size_t avail = run->rsiz - run->rp;
+    const char *rp = run->buf + run->rp;
+    int step = ssvnumget(rp, avail, &ksiz), vstep = 0;
+    if (step > 0) vstep = ssvnumget(rp + step, avail - step, &vsiz);
+    if (step > 0 && vstep > 0) {
+      uint64_t need = step + vstep + ksiz + vsiz;
+      if (need <= avail) {
+        run->kbuf = rp + step + vstep;
+        run->ksiz = ksiz;
+        run->vbuf = run->kbuf + ksiz;
+        run->vsiz = vsiz;
+        run->rp += need;
+        return 1;
+      }
+      if (need > run->bcap) {
+        char *nbuf;
+        SSREALLOC(nbuf, run->buf, need);
+        if (nbuf == NULL) {
+          ssbuildsetecode(bld, SSEMISC);
+          return -1;
+        }
+        run->buf = nbuf;
+        run->bcap = need;
+      }
+    }
+    if (run->eof) {
+      if (avail == 0) return 0;
+      ssbuildsetecode(bld, SSERHEAD);
+      return -1;
+    }
+    /* keep the partial record at the head and fill the rest of the buffer */
+    memmove(run->buf, run->buf + run->rp, avail);
+    run->rp = 0;
+    run->rsiz = avail;
+    ssize_t n;
+    SSSYS_NOINTR(n, read(run->fd, run->buf + run->rsiz, run->bcap - run->rsiz));
+    if (n < 0) {
+      ssbuildsetecode(bld, SSEREAD);
+      return -1;
+    }
+    if (n == 0) run->eof = 1;
+    run->rsiz += n;
+  }
+}
+
+static int ssbuildruncmp(const SSBUILDRUN *a, const SSBUILDRUN *b) {
+  int min = (a->ksiz < b->ksiz) ? a->ksiz : b->ksiz;
+  int r = memcmp(a->kbuf, b->kbuf, min);
+  if (r != 0) return r;
+  if (a->ksiz != b->ksiz) return (a->ksiz < b->ksiz) ? -1 : 1;
+  return (a->seq > b->seq) ? -1 : (a->seq < b->seq);
+}
+
+static void ssbuildheapdown(SSBUILDRUN **heap, uint32_t num, uint32_t i) {
+  while (1) {
+    uint32_t min = i, left = i * 2 + 1, right = left + 1;
+    if (left < num && ssbuildruncmp(heap[left], heap[min]) < 0) min = left;
+    if (right < num && ssbuildruncmp(heap[right], heap[min]) < 0) min = right;
+    if (min == i) break;
+    SSBUILDRUN *swap = heap[i];
+    heap[i] = heap[min];
+    heap[min] = swap;
+    i = min;
+  }
+}
+
+static int ssbuildemit(SSBUILD *bld, SSBUILDOUT *out, const void *kbuf, int ksiz,
+                       const void *vbuf, int vsiz) {
+  if (out->tbl == NULL && ssbuildopenout(bld, out) != 0) return -1;
+  if (ssftblappend(out->tbl, kbuf, ksiz, vbuf, vsiz) != 0) {
+    ssbuildsetecode(bld, out->tbl->ecode);
+    return -1;
+  }
+  out->fsiz += (uint64_t)ksiz + vsiz;
+  if (bld->maxfsiz > 0 && out->fsiz >= bld->maxfsiz) return ssbuildcloseout(bld, out);
+  return 0;
+}
+
+static char *ssbuildoutpath(SSBUILD *bld, uint32_t seq, const char *suffix) {
+  char *path;
+  SSMALLOC(path, strlen(bld->path) + sizeof(BLDOUTSUFFIX) + BLDNUMLEN + strlen(suffix));
+  if (bld->maxfsiz > 0) {
+    sprintf(path, "%s" BLDOUTSUFFIX "%s", bld->path, seq, suffix);
+  } else {
+    sprintf(path, "%s%s", bld->path, suffix);
+  }
+  return path;
+}
+
+static int ssbuildfinishout(SSBUILD *bld, int err) {
+  /* outputs are written under temporary names and renamed only once all of them are complete,
+     so that a failed build leaves none of them, nor a valid but truncated table */
+  uint32_t renamed = 0, i;
+  while (renamed < bld->onum && !err) {
+    char *tfpath = ssbuildoutpath(bld, renamed, BLDTMPSUFFIX BLDFILESUFFIX);
+    char *fpath = ssbuildoutpath(bld, renamed, BLDFILESUFFIX);
+    if (rename(tfpath, fpath) == 0) {
+      renamed++;
+    } else {
+      ssbuildsetecode(bld, SSERENAME);
+      err = -1;
+    }
+    SSFREE(fpath);
+    SSFREE(tfpath);
+  }
+  if (!err) return 0;
+  /* on failure, those renamed already are removed as well */
+  for (i = 0; i < bld->onum; i++) {
+    char *path = ssbuildoutpath(bld, i, i < renamed ? BLDFILESUFFIX
+                                : BLDTMPSUFFIX BLDFILESUFFIX);
+    unlink(path);
+    SSFREE(path);
+  }
+  bld->onum = 0;
+  return -1;
+}
+
+static int ssbuildopenout(SSBUILD *bld, SSBUILDOUT *out) {
+  char *path = ssbuildoutpath(bld, bld->onum, BLDTMPSUFFIX);
+  SSFTBL *tbl = ssftblnew();
+  ssftbltune(tbl, bld->blksiz, bld->cmethod, bld->opts);
+  /* blocks of the output are compressed by as many workers as runs were sorted by */
+  if (bld->thnum > 1) ssftblsetcworkers(tbl, bld->thnum);
+  int err = 0;
+  if (ssftblopen(tbl, path, SSFTBLOWRITER) != 0) {
+    ssbuildsetecode(bld, tbl->ecode);
+    ssftbldel(tbl);
+    err = -1;
+  } else {
+    out->tbl = tbl;
+    out->fsiz = 0;
+    bld->onum++;
+  }
+  SSFREE(path);
+  return err;
+}
+
+static int ssbuildcloseout(SSBUILD *bld, SSBUILDOUT *out) {
+  int err = 0;
+  if (ssftblclose(out->tbl) != 0) {
+    ssbuildsetecode(bld, out->tbl->ecode);
+    err = -1;
+  }
+  ssftbldel(out->tbl);
+  out->tbl = NULL;
+  return err;
+}
+
+static void ssbuildsetecode(SSBUILD *bld, int ecode) {
+  assert(bld);
+  bld->ecode = ecode;
+}
@@ -0,0 +1,103 @@
+#ifndef SSBUILD_H_
+#define SSBUILD_H_
+
+#if defined(__cplusplus)
+#define SSBUILD_CLINKAGEBEGIN extern "C" {
+#define SSBUILD_CLINKAGEEND }
+#else
+#define SSBUILD_CLINKAGEBEGIN
+#define SSBUILD_CLINKAGEEND
+#endif
+SSBUILD_CLINKAGEBEGIN
+
+#include <stdint.h>
+#include <pthread.h>
+
+typedef struct {
+  char *path;              /* path of the output tables without the suffix */
+  uint64_t membudget;      /* bytes of records held in memory before they are spilled */
+  uint32_t thnum;          /* number of sorting threads */
+  uint64_t maxfsiz;        /* bytes of records in one output table, 0 for a single table */
+  uint64_t blksiz;         /* block size of the output tables */
+  int cmethod;             /* compression method of the output tables */
+  int opts;                /* tuning options of the output tables */
+  void *cbuf;              /* buffer of records being filled */
+  uint64_t cbufsiz;        /* bytes of records in a buffer before it is spilled */
+  uint32_t fanin;          /* number of runs merged at once */
+  uint64_t iobufsiz;       /* size of the buffer of a run being written or read */
+  void **queue;            /* full buffers waiting for a sorting thread */
+  uint32_t qhead;          /* index of the oldest buffer in the queue */
+  uint32_t qnum;           /* number of buffers in the queue */
+  uint32_t busy;           /* number of buffers being sorted and written */
+  uint32_t runnum;         /* number of sorted runs spilled to temporary files */
+  uint32_t mrunnum;        /* number of intermediate runs made by merging runs */
+  uint32_t onum;           /* number of output tables written */
+  pthread_t *ths;          /* sorting threads */
+  uint32_t thstarted;      /* number of started sorting threads */
+  pthread_mutex_t mtx;     /* mutex for the queue */
+  pthread_cond_t cond;     /* signaled whenever the queue or `busy' changes */
+  int open;                /* whether the object is open */
+  int stop;                /* whether the sorting threads should exit */
+  int wecode;              /* error code of a failed sorting thread, or `SSESUCCESS' */
+  int ecode;               /* error code */
+} SSBUILD;
+
+/* Create a bulk builder object.
+   The return value is the new object.
+   Records are put in any order and written to table files in the order `ssftblappend'
+   requires. Records are gathered in memory up to a budget; a full buffer is sorted and
+   spilled to a temporary file as a sorted run by one of the sorting threads while the next
+   buffer fills, and on close the runs are merged into the output tables. If every record fits
+   in the budget, they are sorted in memory and no temporary file is made. Of records with the
+   same key, the one put last is kept. */
+SSBUILD *ssbuildnew(void);
+
+/* Delete a bulk builder object.
+   `bld' specifies the object, which is closed first if it is open. */
+void ssbuilddel(SSBUILD *bld);
+
+/* Set the tuning parameters of a bulk builder object.
+   `bld' specifies the object, which must not be open.
+   `membudget' specifies the bytes of keys and values held in memory, or 0 for the default of
+   256 MiB. It is split between the buffer being filled and one buffer per sorting thread.
+   Runs are merged up to 128 at a time, fewer under a small budget, each read through a
+   buffer taken from the budget; more runs are first merged in passes into longer runs.
+   `thnum' specifies the number of sorting threads, or 0 for the default of 2. The same number
+   of workers compress the blocks of the output tables.
+   `maxfsiz' specifies the bytes of keys and values after which an output table is closed and
+   the next one is started, or 0 to write a single table.
+   The return value is 0 for success, or -1 on failure. */
+int ssbuildtune(SSBUILD *bld, uint64_t membudget, uint32_t thnum, uint64_t maxfsiz);
+
+/* Set the tuning parameters of the output tables of a bulk builder object.
+   `bld' specifies the object, which must not be open.
+   `blksiz', `cmethod' and `opts' are given to `ssftbltune'.
+   The return value is 0 for success, or -1 on failure. */
+int ssbuildtunetbl(SSBUILD *bld, uint64_t blksiz, int cmethod, int opts);
+
+/* Open a bulk builder object.
+   `bld' specifies the object.
+   `path' specifies the path of the output table without the suffix. With `maxfsiz' set,
+   output tables are numbered by appending `-000000', `-000001' and so on. Temporary files are
+   made next to it.
+   The return value is 0 for success, or -1 on failure. */
+int ssbuildopen(SSBUILD *bld, const char *path);
+
+/* Store a record into a bulk builder object.
+   `bld' specifies the object.
+   `kbuf' and `ksiz' specify the key, and `vbuf' and `vsiz' specify the value, in any order.
+   Neither may be empty, as with `ssftblappend'.
+   The object must not be shared by threads putting records.
+   The return value is 0 for success, or -1 on failure. */
+int ssbuildput(SSBUILD *bld, const void *kbuf, int ksiz, const void *vbuf, int vsiz);
+
+/* Close a bulk builder object and write the output tables.
+   `bld' specifies the object.
+   Output tables are written with `.tmp' before the suffix and renamed once all of them are
+   complete, so on failure none of them is left.
+   The number of tables written is left in `onum' of the object, which is 0 on failure.
+   The return value is 0 for success, or -1 on failure. */
+int ssbuildclose(SSBUILD *bld);
+
+SSBUILD_CLINKAGEEND
+#endif
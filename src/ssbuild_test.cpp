@@ -0,0 +1,205 @@
+#include <ssbuild.h>
+#include <ssftbl.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+#define BLDTESTPATH "./ssbuildtest"
+
+namespace {
+string out_path(int num, const char *suffix = ".sstbl") {
+  char buf[64];
+  if (num < 0) return string(BLDTESTPATH) + suffix;
+  sprintf(buf, "%s-%06d%s", BLDTESTPATH, num, suffix);
+  return buf;
+}
+
+void remove_outputs() {
+  unlink(out_path(-1).c_str());
+  unlink(out_path(-1, ".tmp.sstbl").c_str());
+  for (int i = 0; i < 1000; i++) {
+    unlink(out_path(i).c_str());
+    unlink(out_path(i, ".tmp.sstbl").c_str());
+  }
+}
+
+/* read every record of a table in order */
+vector<pair<string, string> > read_table(const string &path) {
+  vector<pair<string, string> > recs;
+  SSFTBL *tbl = ssftblnew();
+  if (ssftblopen(tbl, path.substr(0, path.size() - 6).c_str(), SSFTBLOREADER) != 0) {
+    ssftbldel(tbl);
+    return recs;
+  }
+  SSFTBLCUR *cur = ssftblcurnew(tbl);
+  if (ssftblcurfirst(cur) == 0) {
+    do {
+      int ksiz, vsiz;
+      const char *kbuf = (const char *)ssftblcurkey(cur, &ksiz);
+      const char *vbuf = (const char *)ssftblcurval(cur, &vsiz);
+      recs.push_back(make_pair(string(kbuf, ksiz), string(vbuf, vsiz)));
+    } while (ssftblcurnext(cur) == 0);
+  }
+  ssftblcurdel(cur);
+  ssftblclose(tbl);
+  ssftbldel(tbl);
+  return recs;
+}
+
+/* put records in a scrambled order, some keys several times, and return the expected table */
+map<string, string> put_records(SSBUILD *bld, int num) {
+  map<string, string> recs;
+  char kbuf[32], vbuf[64];
+  for (int i = 0; i < num; i++) {
+    int id = (int)(((uint64_t)i * 7919) % (num / 2));
+    int ksiz = sprintf(kbuf, "key%08d", id);
+    int vsiz = sprintf(vbuf, "val%08d_%08d_%016d", id, i, 0);
+    EXPECT_EQ(0, ssbuildput(bld, kbuf, ksiz, vbuf, vsiz));
+    recs[string(kbuf, ksiz)] = string(vbuf, vsiz);
+  }
+  return recs;
+}
+}
+
+class SSBUILDTestFixture : public testing::Test {
+protected:
+  void SetUp() {
+    remove_outputs();
+    bld = ssbuildnew();
+    ASSERT_TRUE(bld != NULL);
+  }
+  void TearDown() {
+    ssbuilddel(bld);
+    remove_outputs();
+  }
+  SSBUILD *bld;
+};
+
+TEST_F(SSBUILDTestFixture, in_memory) {
+  /* records within the budget are sorted without a run */
+  ASSERT_EQ(0, ssbuildopen(bld, BLDTESTPATH));
+  ASSERT_EQ(0, ssbuildput(bld, "b", 1, "1", 1));
+  ASSERT_EQ(0, ssbuildput(bld, "a", 1, "2", 1));
+  ASSERT_EQ(0, ssbuildput(bld, "b", 1, "3", 1));
+  ASSERT_EQ(0, ssbuildput(bld, "0", 1, "4", 1));
+  ASSERT_EQ(0, ssbuildclose(bld));
+  EXPECT_EQ(0U, bld->runnum);
+  EXPECT_EQ(1U, bld->onum);
+  vector<pair<string, string> > recs = read_table(out_path(-1));
+  ASSERT_EQ(3U, recs.size());
+  EXPECT_EQ(make_pair(string("0"), string("4")), recs[0]);
+  EXPECT_EQ(make_pair(string("a"), string("2")), recs[1]);
+  EXPECT_EQ(make_pair(string("b"), string("3")), recs[2]);
+}
+
+TEST_F(SSBUILDTestFixture, empty) {
+  /* closing without records still leaves a readable, empty table */
+  ASSERT_EQ(0, ssbuildopen(bld, BLDTESTPATH));
+  ASSERT_EQ(0, ssbuildclose(bld));
+  EXPECT_EQ(1U, bld->onum);
+  SSFTBL *tbl = ssftblnew();
+  ASSERT_EQ(0, ssftblopen(tbl, BLDTESTPATH, SSFTBLOREADER));
+  EXPECT_EQ(0U, tbl->idxnum);
+  EXPECT_EQ(0, ssftblclose(tbl));
+  ssftbldel(tbl);
+}
+
+TEST_F(SSBUILDTestFixture, spill_and_merge) {
+  /* a small budget spills many runs, which are sorted by four threads */
+  ASSERT_EQ(0, ssbuildtune(bld, 512 * 1024, 4, 0));
+  ASSERT_EQ(0, ssbuildtunetbl(bld, 0, 2, 0));
+  ASSERT_EQ(0, ssbuildopen(bld, BLDTESTPATH));
+  map<string, string> expected = put_records(bld, 100000);
+  ASSERT_EQ(0, ssbuildclose(bld));
+  EXPECT_LT(4U, bld->runnum);
+  EXPECT_EQ(1U, bld->onum);
+  EXPECT_NE(0, access((string(BLDTESTPATH) + "-run-000000.tmp").c_str(), F_OK));
+  vector<pair<string, string> > recs = read_table(out_path(-1));
+  ASSERT_EQ(expected.size(), recs.size());
+  size_t i = 0;
+  for (map<string, string>::iterator it = expected.begin(); it != expected.end(); ++it, ++i) {
+    ASSERT_EQ(it->first, recs[i].first);
+    ASSERT_EQ(it->second, recs[i].second);
+  }
+}
+
+TEST_F(SSBUILDTestFixture, multipass_merge) {
+  /* more runs than are merged at once go through intermediate runs, and the newest value of
+     a key still wins across them */
+  ASSERT_EQ(0, ssbuildtune(bld, 256 * 1024, 3, 0));
+  ASSERT_EQ(0, ssbuildopen(bld, BLDTESTPATH));
+  map<string, string> expected = put_records(bld, 100000);
+  ASSERT_EQ(0, ssbuildclose(bld));
+  EXPECT_LT(bld->fanin, bld->runnum);
+  EXPECT_LT(0U, bld->mrunnum);
+  for (uint32_t i = 0; i < bld->runnum + bld->mrunnum; i++) {
+    char rpath[64];
+    sprintf(rpath, "%s-run-%06u.tmp", BLDTESTPATH, i);
+    EXPECT_NE(0, access(rpath, F_OK)) << rpath;
+  }
+  vector<pair<string, string> > recs = read_table(out_path(-1));
+  ASSERT_EQ(expected.size(), recs.size());
+  size_t i = 0;
+  for (map<string, string>::iterator it = expected.begin(); it != expected.end(); ++it, ++i) {
+    ASSERT_EQ(it->first, recs[i].first);
+    ASSERT_EQ(it->second, recs[i].second);
+  }
+}
+
+TEST_F(SSBUILDTestFixture, split_outputs) {
+  /* each output ends at the size limit and holds the keys following the previous one */
+  ASSERT_EQ(0, ssbuildtune(bld, 256 * 1024, 2, 512 * 1024));
+  ASSERT_EQ(0, ssbuildopen(bld, BLDTESTPATH));
+  map<string, string> expected = put_records(bld, 50000);
+  ASSERT_EQ(0, ssbuildclose(bld));
+  EXPECT_LT(0U, bld->runnum);
+  EXPECT_LT(1U, bld->onum);
+  map<string, string>::iterator it = expected.begin();
+  for (uint32_t n = 0; n < bld->onum; n++) {
+    vector<pair<string, string> > recs = read_table(out_path(n));
+    ASSERT_LT(0U, recs.size());
+    for (size_t i = 0; i < recs.size(); i++, ++it) {
+      ASSERT_TRUE(it != expected.end());
+      ASSERT_EQ(it->first, recs[i].first);
+      ASSERT_EQ(it->second, recs[i].second);
+    }
+  }
+  EXPECT_TRUE(it == expected.end());
+}
+
+TEST_F(SSBUILDTestFixture, failed_output) {
+  /* an output which cannot be made fails the close, and none of the earlier ones is left */
+  string blocker = out_path(2, ".tmp.sstbl");
+  ASSERT_EQ(0, mkdir(blocker.c_str(), 0755));
+  ASSERT_EQ(0, ssbuildtune(bld, 256 * 1024, 2, 512 * 1024));
+  ASSERT_EQ(0, ssbuildopen(bld, BLDTESTPATH));
+  put_records(bld, 50000);
+  EXPECT_EQ(-1, ssbuildclose(bld));
+  EXPECT_NE(SSESUCCESS, bld->ecode);
+  EXPECT_EQ(0U, bld->onum);
+  ASSERT_EQ(0, rmdir(blocker.c_str()));
+  for (int i = 0; i < 4; i++) {
+    EXPECT_NE(0, access(out_path(i).c_str(), F_OK)) << i;
+    EXPECT_NE(0, access(out_path(i, ".tmp.sstbl").c_str(), F_OK)) << i;
+  }
+  for (uint32_t i = 0; i < bld->runnum + bld->mrunnum; i++) {
+    char rpath[64];
+    sprintf(rpath, "%s-run-%06u.tmp", BLDTESTPATH, i);
+    EXPECT_NE(0, access(rpath, F_OK)) << rpath;
+  }
+}
+
+TEST_F(SSBUILDTestFixture, tune_while_open) {
+  ASSERT_EQ(0, ssbuildopen(bld, BLDTESTPATH));
+  EXPECT_EQ(-1, ssbuildtune(bld, 0, 0, 0));
+  EXPECT_EQ(-1, ssbuildopen(bld, BLDTESTPATH));
+  ASSERT_EQ(0, ssbuildclose(bld));
+  EXPECT_EQ(-1, ssbuildput(bld, "a", 1, "b", 1));
+  EXPECT_EQ(-1, ssbuildclose(bld));
+}
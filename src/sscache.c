@@ -0,0 +1,324 @@
+#include <ssutil.h>
+#include <sscache.h>
+
+/* const or default parameters */
+#define CACHEMINBNUM 64 /* initial number of hash buckets in a shard */
+#define CACHEDEFSNUM 16 /* default number of shards */
+#define CACHEMAXSNUM 65536 /* maximum number of shards */
+#define CACHESKROWS  4    /* rows of the frequency sketch */
+#define CACHESKMAX   15   /* saturation of the counters of the sketch */
+#define CACHESKUNIT  4096 /* bytes per expected entry, sizing the sketch */
+#define CACHESKWIDTH 8    /* counters of each row per expected entry */
+#define CACHESKAGE   10   /* accesses per expected entry after which the counters are halved */
+
+/* private function prototypes */
+static uint64_t sscachehash(uint64_t key);
+static SSCACHESHARD *sscacheshard(SSCACHE *cache, uint64_t hash);
+static SSCACHEENT *sscachefind(SSCACHESHARD *shard, uint64_t hash, uint64_t key);
+static void sscacherehash(SSCACHESHARD *shard);
+static void sscacheunlink(SSCACHESHARD *shard, SSCACHEENT *ent);
+static void sscacheappend(SSCACHESHARD *shard, SSCACHEENT *ent);
+static void sscacheremove(SSCACHESHARD *shard, SSCACHEENT *ent);
+static void sscacheunpin(SSCACHEENT *ent);
+static void sscachesketchadd(SSCACHESHARD *shard, uint64_t hash);
+static int sscachesketchget(SSCACHESHARD *shard, uint64_t hash);
+
+/* private macros */
+#define CACHECHARGE(ent) ((uint64_t)(ent)->siz + sizeof(SSCACHEENT))
+
+/*-----------------------------------------------------------------------------
+ * APIs
+ */
+SSCACHE *sscachenew(uint64_t capsiz, uint32_t snum) {
+  SSCACHE *cache = NULL;
+  uint32_t i;
+  SSMALLOC(cache, sizeof(SSCACHE));
+  if (snum < 1) snum = CACHEDEFSNUM;
+  if (snum > CACHEMAXSNUM) snum = CACHEMAXSNUM;
+  cache->snum = 1;
+  while (cache->snum < snum)
+    cache->snum <<= 1;
+  cache->capsiz = capsiz;
+  cache->opts = 0;
+  SSMALLOC(cache->shards, sizeof(SSCACHESHARD) * cache->snum);
+  for (i = 0; i < cache->snum; i++) {
+    SSCACHESHARD *shard = cache->shards + i;
+    shard->bnum = CACHEMINBNUM;
+    shard->buckets = calloc(shard->bnum, sizeof(SSCACHEENT *));
+    shard->head = NULL;
+    shard->tail = NULL;
+    shard->rnum = 0;
+    shard->usiz = 0;
+    shard->capsiz = capsiz / cache->snum;
+    shard->sketch = NULL;
+    shard->swidth = 0;
+    shard->sadds = 0;
+    shard->ssample = 0;
+    if (pthread_mutex_init(&shard->mtx, NULL) != 0) {
+      while (i-- > 0) {
+        pthread_mutex_destroy(&cache->shards[i].mtx);
+        SSFREE(cache->shards[i].buckets);
+      }
+      SSFREE(shard->buckets);
+      SSFREE(cache->shards);
+      SSFREE(cache);
+      return NULL;
+    }
+  }
+  return cache;
+}
+
+int sscachetune(SSCACHE *cache, int opts) {
+  assert(cache);
+  uint32_t i;
+  for (i = 0; i < cache->snum; i++) {
+    SSCACHESHARD *shard = cache->shards + i;
+    if (shard->rnum > 0) return -1;
+    SSFREE(shard->sketch);
+    shard->sketch = NULL;
+    shard->swidth = 0;
+    shard->sadds = 0;
+    shard->ssample = 0;
+    if (!(opts & SSCACHETTINYLFU)) continue;
+    /* rows several times wider than the expected entries keep the noise of collisions low */
+    uint64_t ecnt = shard->capsiz / CACHESKUNIT + 1;
+    uint32_t swidth = 64;
+    while (swidth < ecnt * CACHESKWIDTH && swidth < (1U << 24))
+      swidth <<= 1;
+    shard->sketch = calloc((size_t)swidth * CACHESKROWS, 1);
+    if (shard->sketch == NULL) return -1;
+    shard->swidth = swidth;
+    shard->ssample = ecnt * CACHESKAGE < UINT32_MAX ? ecnt * CACHESKAGE : UINT32_MAX;
+  }
+  cache->opts = opts;
+  return 0;
+}
+
+void sscachedel(SSCACHE *cache) {
+  assert(cache);
+  uint32_t i;
+  for (i = 0; i < cache->snum; i++) {
+    SSCACHESHARD *shard = cache->shards + i;
+    while (shard->head)
+      sscacheremove(shard, shard->head);
+    SSFREE(shard->sketch);
+    SSFREE(shard->buckets);
+    pthread_mutex_destroy(&shard->mtx);
+  }
+  SSFREE(cache->shards);
+  SSFREE(cache);
+}
+
+SSCACHEENT *sscacheget(SSCACHE *cache, uint64_t key) {
+  assert(cache);
+  uint64_t hash = sscachehash(key);
+  SSCACHESHARD *shard = sscacheshard(cache, hash);
+  pthread_mutex_lock(&shard->mtx);
+  if (shard->sketch) sscachesketchadd(shard, hash);
+  SSCACHEENT *ent = sscachefind(shard, hash, key);
+  if (ent) {
+    /* move to the most recently used position */
+    sscacheunlink(shard, ent);
+    sscacheappend(shard, ent);
+    __sync_add_and_fetch(&ent->refcnt, 1);
+  }
+  pthread_mutex_unlock(&shard->mtx);
+  return ent;
+}
+
+SSCACHEENT *sscacheput(SSCACHE *cache, uint64_t key, char *buf, int siz) {
+  assert(cache && buf && siz >= 0);
+  uint64_t hash = sscachehash(key);
+  SSCACHESHARD *shard = sscacheshard(cache, hash);
+  pthread_mutex_lock(&shard->mtx);
+  SSCACHEENT *ent = sscachefind(shard, hash, key);
+  if (ent) {
+    /* another thread loaded the same block first */
+    sscacheunlink(shard, ent);
+    sscacheappend(shard, ent);
+    __sync_add_and_fetch(&ent->refcnt, 1);
+    pthread_mutex_unlock(&shard->mtx);
+    SSFREE(buf);
+    return ent;
+  }
+  SSMALLOC(ent, sizeof(SSCACHEENT));
+  ent->key = key;
+  ent->buf = buf;
+  ent->siz = siz;
+  if (shard->sketch && shard->head && shard->usiz + CACHECHARGE(ent) > shard->capsiz &&
+      sscachesketchget(shard, hash) <= sscachesketchget(shard, sscachehash(shard->head->key))) {
+    /* the victim is used at least as often, so the new entry only lives while pinned */
+    ent->refcnt = 1;
+    ent->prev = NULL;
+    ent->next = NULL;
+    ent->chain = NULL;
+    pthread_mutex_unlock(&shard->mtx);
+    return ent;
+  }
+  ent->refcnt = 2; /* one for the cache, one for the caller */
+  if (shard->rnum >= shard->bnum) sscacherehash(shard);
+  uint32_t bidx = (uint32_t)hash & (shard->bnum - 1);
+  ent->chain = shard->buckets[bidx];
+  shard->buckets[bidx] = ent;
+  sscacheappend(shard, ent);
+  shard->rnum++;
+  shard->usiz += CACHECHARGE(ent);
+  while (shard->usiz > shard->capsiz && shard->head != ent)
+    sscacheremove(shard, shard->head);
+  pthread_mutex_unlock(&shard->mtx);
+  return ent;
+}
+
+void sscacherelease(SSCACHE *cache, SSCACHEENT *ent) {
+  assert(cache && ent);
+  sscacheunpin(ent);
+}
+
+void sscacheremoverange(SSCACHE *cache, uint64_t lo, uint64_t hi) {
+  assert(cache);
+  uint32_t i;
+  for (i = 0; i < cache->snum; i++) {
+    SSCACHESHARD *shard = cache->shards + i;
+    pthread_mutex_lock(&shard->mtx);
+    SSCACHEENT *ent = shard->head;
+    while (ent) {
+      SSCACHEENT *next = ent->next;
+      if (ent->key >= lo && ent->key < hi) sscacheremove(shard, ent);
+      ent = next;
+    }
+    pthread_mutex_unlock(&shard->mtx);
+  }
+}
+
+uint64_t sscachernum(SSCACHE *cache) {
+  assert(cache);
+  uint64_t rnum = 0;
+  uint32_t i;
+  for (i = 0; i < cache->snum; i++) {
+    pthread_mutex_lock(&cache->shards[i].mtx);
+    rnum += cache->shards[i].rnum;
+    pthread_mutex_unlock(&cache->shards[i].mtx);
+  }
+  return rnum;
+}
+
+uint64_t sscacheusiz(SSCACHE *cache) {
+  assert(cache);
+  uint64_t usiz = 0;
+  uint32_t i;
+  for (i = 0; i < cache->snum; i++) {
+    pthread_mutex_lock(&cache->shards[i].mtx);
+    usiz += cache->shards[i].usiz;
+    pthread_mutex_unlock(&cache->shards[i].mtx);
+  }
+  return usiz;
+}
+
+/*-----------------------------------------------------------------------------
+ * private functions
+ */
+static uint64_t sscachehash(uint64_t key) {
+  /* block offsets are multiples of large sizes, so mix the high bits down */
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+static SSCACHESHARD *sscacheshard(SSCACHE *cache, uint64_t hash) {
+  /* the low bits pick the bucket, so stripe on the high bits */
+  return cache->shards + ((uint32_t)(hash >> 40) & (cache->snum - 1));
+}
+
+static SSCACHEENT *sscachefind(SSCACHESHARD *shard, uint64_t hash, uint64_t key) {
+  SSCACHEENT *ent = shard->buckets[(uint32_t)hash & (shard->bnum - 1)];
+  while (ent && ent->key != key)
+    ent = ent->chain;
+  return ent;
+}
+
+static void sscacherehash(SSCACHESHARD *shard) {
+  uint32_t bnum = shard->bnum * 2;
+  SSCACHEENT **buckets = calloc(bnum, sizeof(SSCACHEENT *));
+  if (buckets == NULL) return; /* keep the longer chains */
+  SSCACHEENT *ent;
+  for (ent = shard->head; ent; ent = ent->next) {
+    uint32_t bidx = (uint32_t)sscachehash(ent->key) & (bnum - 1);
+    ent->chain = buckets[bidx];
+    buckets[bidx] = ent;
+  }
+  SSFREE(shard->buckets);
+  shard->buckets = buckets;
+  shard->bnum = bnum;
+}
+
+static void sscacheunlink(SSCACHESHARD *shard, SSCACHEENT *ent) {
+  if (ent->prev) ent->prev->next = ent->next;
+  else shard->head = ent->next;
+  if (ent->next) ent->next->prev = ent->prev;
+  else shard->tail = ent->prev;
+  ent->prev = NULL;
+  ent->next = NULL;
+}
+
+static void sscacheappend(SSCACHESHARD *shard, SSCACHEENT *ent) {
+  ent->prev = shard->tail;
+  ent->next = NULL;
+  if (shard->tail) shard->tail->next = ent;
+  else shard->head = ent;
+  shard->tail = ent;
+}
+
+static void sscacheremove(SSCACHESHARD *shard, SSCACHEENT *ent) {
+  SSCACHEENT **pp = shard->buckets + ((uint32_t)sscachehash(ent->key) & (shard->bnum - 1));
+  while (*pp != ent)
+    pp = &(*pp)->chain;
+  *pp = ent->chain;
+  sscacheunlink(shard, ent);
+  shard->rnum--;
+  shard->usiz -= CACHECHARGE(ent);
+  sscacheunpin(ent);
+}
+
+static void sscachesketchadd(SSCACHESHARD *shard, uint64_t hash) {
+  uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+  uint8_t *cnts[CACHESKROWS];
+  int freq = CACHESKMAX;
+  uint32_t i;
+  for (i = 0; i < CACHESKROWS; i++) {
+    cnts[i] = shard->sketch + (size_t)i * shard->swidth + ((h1 + i * h2) & (shard->swidth - 1));
+    if (*cnts[i] < freq) freq = *cnts[i];
+  }
+  /* only the smallest counters are raised, so keys sharing a counter inflate each other less */
+  for (i = 0; i < CACHESKROWS; i++) {
+    if (*cnts[i] == freq && freq < CACHESKMAX) (*cnts[i])++;
+  }
+  if (++shard->sadds >= shard->ssample) {
+    /* halving ages out blocks that were hot once, so a new working set can get in */
+    size_t j, num = (size_t)shard->swidth * CACHESKROWS;
+    for (j = 0; j < num; j++)
+      shard->sketch[j] >>= 1;
+    shard->sadds /= 2;
+  }
+}
+
+static int sscachesketchget(SSCACHESHARD *shard, uint64_t hash) {
+  uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+  int freq = CACHESKMAX;
+  uint32_t i;
+  for (i = 0; i < CACHESKROWS; i++) {
+    int cnt = shard->sketch[(size_t)i * shard->swidth + ((h1 + i * h2) & (shard->swidth - 1))];
+    if (cnt < freq) freq = cnt;
+  }
+  return freq;
+}
+
+static void sscacheunpin(SSCACHEENT *ent) {
+  int refcnt = __sync_sub_and_fetch(&ent->refcnt, 1);
+  assert(refcnt >= 0);
+  if (refcnt > 0) return;
+  SSFREE(ent->buf);
+  SSFREE(ent);
+}
@@ -0,0 +1,114 @@
+#ifndef SSCACHE_H_
+#define SSCACHE_H_
+
+#if defined(__cplusplus)
+#define SSCACHE_CLINKAGEBEGIN extern "C" {
+#define SSCACHE_CLINKAGEEND }
+#else
+#define SSCACHE_CLINKAGEBEGIN
+#define SSCACHE_CLINKAGEEND
+#endif
+SSCACHE_CLINKAGEBEGIN
+
+#include <stdint.h>
+#include <pthread.h>
+
+typedef struct _SSCACHEENT {
+  uint64_t key;               /* key of the entry */
+  char *buf;                  /* cached data */
+  int siz;                    /* size of cached data */
+  int refcnt;                 /* number of pins, including the cache itself */
+  struct _SSCACHEENT *prev;   /* previous entry in the lru list */
+  struct _SSCACHEENT *next;   /* next entry in the lru list */
+  struct _SSCACHEENT *chain;  /* next entry in the hash chain */
+} SSCACHEENT;
+
+typedef struct {
+  SSCACHEENT **buckets;       /* hash buckets */
+  uint32_t bnum;              /* number of hash buckets */
+  SSCACHEENT *head;           /* least recently used entry */
+  SSCACHEENT *tail;           /* most recently used entry */
+  uint64_t rnum;              /* number of cached entries */
+  uint64_t usiz;              /* bytes charged to the shard */
+  uint64_t capsiz;            /* maximum bytes charged to the shard */
+  uint8_t *sketch;            /* access frequencies of keys for admission, or NULL */
+  uint32_t swidth;            /* number of counters in each row of the sketch */
+  uint32_t sadds;             /* accesses counted since the counters were last halved */
+  uint32_t ssample;           /* accesses after which the counters are halved */
+  pthread_mutex_t mtx;        /* mutex for the shard */
+} SSCACHESHARD;
+
+typedef struct {
+  SSCACHESHARD *shards;       /* lock-striped shards */
+  uint32_t snum;              /* number of shards */
+  uint64_t capsiz;            /* maximum bytes of the whole cache */
+  int opts;                   /* tuning options */
+} SSCACHE;
+
+enum SSCACHETOPTS { /* enumeration for tuning options */
+  SSCACHETTINYLFU = 1 << 0 /* admit a new entry only if it is used more than the victim */
+};
+
+/* Create a block cache object.
+   `capsiz' specifies the capacity of the cache in bytes.
+   `snum' specifies the number of lock-striped shards. If it is not more than 0, the default
+   number is specified. It is rounded up to a power of two, and at most 65536 is used.
+   The return value is the new block cache object, or `NULL' on failure.
+   The object can be shared by any threads because of the mutex in each shard. */
+SSCACHE *sscachenew(uint64_t capsiz, uint32_t snum);
+
+/* Set the tuning options of a block cache object.
+   `cache' specifies the block cache object, which must still be empty.
+   `opts' specifies options by bitwise-or: `SSCACHETTINYLFU' keeps an approximate count of
+   the recent uses of every key, hits and misses alike, and an entry which would evict the
+   least recently used one is admitted only if its key is used more often than the victim's.
+   A single pass over many blocks used once then cannot flush blocks in repeated use.
+   The return value is 0 for success, or -1 on failure. */
+int sscachetune(SSCACHE *cache, int opts);
+
+/* Delete a block cache object.
+   `cache' specifies the block cache object.
+   Entries still pinned by callers stay alive until they are released. */
+void sscachedel(SSCACHE *cache);
+
+/* Retrieve and pin an entry of a block cache object.
+   `cache' specifies the block cache object.
+   `key' specifies the key of the entry.
+   The return value is the pinned entry, or `NULL' if it is not cached.
+   The entry must be released with `sscacherelease' when it is no longer in use. */
+SSCACHEENT *sscacheget(SSCACHE *cache, uint64_t key);
+
+/* Store and pin an entry into a block cache object.
+   `cache' specifies the block cache object.
+   `key' specifies the key of the entry.
+   `buf' specifies the region allocated with `malloc', whose ownership moves to the cache.
+   `siz' specifies the size of the region.
+   If an entry with the same key is already cached, `buf' is freed and the existing entry is
+   pinned instead. The least recently used entries of the shard are evicted when the shard
+   exceeds its share of the capacity. With `SSCACHETTINYLFU', an entry not admitted is still
+   returned pinned, but it is freed on release instead of being cached.
+   The return value is the pinned entry, which must be released with `sscacherelease'. */
+SSCACHEENT *sscacheput(SSCACHE *cache, uint64_t key, char *buf, int siz);
+
+/* Release an entry pinned by `sscacheget' or `sscacheput'.
+   `cache' specifies the block cache object.
+   `ent' specifies the pinned entry. */
+void sscacherelease(SSCACHE *cache, SSCACHEENT *ent);
+
+/* Remove the entries of a block cache object whose keys are in a range.
+   `cache' specifies the block cache object.
+   `lo' specifies the lowest key of the range.
+   `hi' specifies the key at which the range ends exclusively.
+   Entries still pinned by callers stay alive until they are released. */
+void sscacheremoverange(SSCACHE *cache, uint64_t lo, uint64_t hi);
+
+/* Get the number of entries in a block cache object.
+   `cache' specifies the block cache object. */
+uint64_t sscachernum(SSCACHE *cache);
+
+/* Get the bytes charged to a block cache object.
+   `cache' specifies the block cache object. */
+uint64_t sscacheusiz(SSCACHE *cache);
+
+SSCACHE_CLINKAGEEND
+#endif
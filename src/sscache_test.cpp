@@ -0,0 +1,229 @@
+#include <sscache.h>
+
+#include <string>
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+char *dupstr(const string &s) {
+  char *p = (char *)malloc(s.size());
+  memcpy(p, s.data(), s.size());
+  return p;
+}
+}
+
+class SSCACHETestFixture : public testing::Test {
+protected:
+  void SetUp() {
+    /* a single shard holding four 5-byte blocks */
+    cache = sscachenew(4 * (5 + sizeof(SSCACHEENT)), 1);
+    ASSERT_TRUE(cache != NULL);
+    EXPECT_EQ(0, sscachernum(cache));
+  }
+  void TearDown() {
+    sscachedel(cache);
+  }
+  SSCACHE *cache;
+};
+
+TEST_F(SSCACHETestFixture, new_del) {
+  // nothing
+  ;
+}
+
+TEST_F(SSCACHETestFixture, put_get) {
+  SSCACHEENT *e = sscacheput(cache, 1, dupstr("block"), 5);
+  ASSERT_TRUE(e != NULL);
+  sscacherelease(cache, e);
+  EXPECT_EQ(1, sscachernum(cache));
+
+  e = sscacheget(cache, 1);
+  ASSERT_TRUE(e != NULL);
+  EXPECT_EQ("block", string(e->buf, e->siz));
+  sscacherelease(cache, e);
+  EXPECT_EQ(5 + sizeof(SSCACHEENT), sscacheusiz(cache));
+
+  EXPECT_TRUE(sscacheget(cache, 2) == NULL);
+}
+
+TEST_F(SSCACHETestFixture, put_existing) {
+  SSCACHEENT *e1 = sscacheput(cache, 1, dupstr("block"), 5);
+  SSCACHEENT *e2 = sscacheput(cache, 1, dupstr("other"), 5);
+  ASSERT_EQ(e1, e2);
+  EXPECT_EQ("block", string(e2->buf, e2->siz));
+  EXPECT_EQ(1, sscachernum(cache));
+  sscacherelease(cache, e1);
+  sscacherelease(cache, e2);
+}
+
+TEST_F(SSCACHETestFixture, evict_lru) {
+  for (uint64_t i = 0; i < 4; i++)
+    sscacherelease(cache, sscacheput(cache, i, dupstr("block"), 5));
+  /* touch 0 so that 1 becomes the least recently used */
+  sscacherelease(cache, sscacheget(cache, 0));
+  sscacherelease(cache, sscacheput(cache, 4, dupstr("block"), 5));
+  EXPECT_EQ(4, sscachernum(cache));
+  SSCACHEENT *e = sscacheget(cache, 0);
+  ASSERT_TRUE(e != NULL);
+  sscacherelease(cache, e);
+  EXPECT_TRUE(sscacheget(cache, 1) == NULL);
+}
+
+TEST_F(SSCACHETestFixture, pinned_survives_eviction) {
+  SSCACHEENT *pinned = sscacheput(cache, 100, dupstr("pinned"), 5);
+  for (uint64_t i = 0; i < 16; i++)
+    sscacherelease(cache, sscacheput(cache, i, dupstr("block"), 5));
+  EXPECT_TRUE(sscacheget(cache, 100) == NULL);
+  EXPECT_EQ("pinne", string(pinned->buf, pinned->siz));
+  sscacherelease(cache, pinned);
+}
+
+TEST_F(SSCACHETestFixture, remove_range) {
+  for (uint64_t i = 0; i < 4; i++)
+    sscacherelease(cache, sscacheput(cache, i, dupstr("block"), 5));
+  SSCACHEENT *pinned = sscacheget(cache, 2);
+  sscacheremoverange(cache, 1, 3);
+  EXPECT_EQ(2, sscachernum(cache));
+  EXPECT_TRUE(sscacheget(cache, 1) == NULL);
+  EXPECT_TRUE(sscacheget(cache, 2) == NULL);
+  EXPECT_EQ("block", string(pinned->buf, pinned->siz));
+  sscacherelease(cache, pinned);
+  sscacherelease(cache, sscacheget(cache, 0));
+  sscacherelease(cache, sscacheget(cache, 3));
+}
+
+TEST(sscache, byte_capacity) {
+  SSCACHE *cache = sscachenew(1024 * 1024, 4);
+  ASSERT_TRUE(cache != NULL);
+  for (uint64_t i = 0; i < 1024; i++)
+    sscacherelease(cache, sscacheput(cache, i * 65536, (char *)malloc(4096), 4096));
+  EXPECT_TRUE(sscacheusiz(cache) <= 1024 * 1024);
+  EXPECT_TRUE(sscachernum(cache) > 0);
+  EXPECT_TRUE(sscachernum(cache) < 1024);
+  sscachedel(cache);
+}
+
+TEST(sscache, too_many_shards) {
+  /* a shard count beyond the maximum is clamped instead of overflowing the rounding */
+  SSCACHE *cache = sscachenew(1024 * 1024, 0x80000001U);
+  ASSERT_TRUE(cache != NULL);
+  EXPECT_EQ(65536U, cache->snum);
+  sscachedel(cache);
+}
+
+TEST(sscache, tune_nonempty) {
+  SSCACHE *cache = sscachenew(1024 * 1024, 1);
+  ASSERT_TRUE(cache != NULL);
+  sscacherelease(cache, sscacheput(cache, 1, dupstr("block"), 5));
+  EXPECT_EQ(-1, sscachetune(cache, SSCACHETTINYLFU));
+  sscachedel(cache);
+}
+
+TEST(sscache, tinylfu_scan_resistant) {
+  /* 64 hot blocks in a cache of 100 still used during one pass over 10000 blocks used once,
+     which would leave no hot block in an lru cache */
+  const uint64_t siz = 4096;
+  SSCACHE *cache = sscachenew(100 * (siz + sizeof(SSCACHEENT)), 1);
+  ASSERT_TRUE(cache != NULL);
+  ASSERT_EQ(0, sscachetune(cache, SSCACHETTINYLFU));
+  for (int round = 0; round < 4; round++) {
+    for (uint64_t i = 0; i < 64; i++) {
+      SSCACHEENT *e = sscacheget(cache, i);
+      if (e == NULL) e = sscacheput(cache, i, (char *)malloc(siz), siz);
+      sscacherelease(cache, e);
+    }
+  }
+  for (uint64_t i = 1000; i < 11000; i++) {
+    SSCACHEENT *e = sscacheget(cache, i);
+    ASSERT_TRUE(e == NULL);
+    e = sscacheput(cache, i, (char *)malloc(siz), siz);
+    ASSERT_TRUE(e != NULL);
+    ASSERT_EQ(i, e->key);
+    sscacherelease(cache, e);
+    e = sscacheget(cache, i % 64);
+    ASSERT_TRUE(e != NULL) << i;
+    sscacherelease(cache, e);
+  }
+  EXPECT_TRUE(sscacheusiz(cache) <= 100 * (siz + sizeof(SSCACHEENT)));
+  for (uint64_t i = 0; i < 64; i++) {
+    SSCACHEENT *e = sscacheget(cache, i);
+    ASSERT_TRUE(e != NULL) << i;
+    sscacherelease(cache, e);
+  }
+  sscachedel(cache);
+}
+
+TEST(sscache, tinylfu_admits_repeated) {
+  /* a new working set gets in once its blocks are used again */
+  const uint64_t siz = 4096;
+  SSCACHE *cache = sscachenew(16 * (siz + sizeof(SSCACHEENT)), 1);
+  ASSERT_TRUE(cache != NULL);
+  ASSERT_EQ(0, sscachetune(cache, SSCACHETTINYLFU));
+  for (uint64_t base = 0; base < 200; base += 100) {
+    for (int round = 0; round < (base ? 8 : 4); round++) {
+      for (uint64_t i = base; i < base + 16; i++) {
+        SSCACHEENT *e = sscacheget(cache, i);
+        if (e == NULL) e = sscacheput(cache, i, (char *)malloc(siz), siz);
+        sscacherelease(cache, e);
+      }
+    }
+  }
+  int hits = 0;
+  for (uint64_t i = 100; i < 116; i++) {
+    SSCACHEENT *e = sscacheget(cache, i);
+    if (e) {
+      hits++;
+      sscacherelease(cache, e);
+    }
+  }
+  EXPECT_EQ(16, hits);
+  sscachedel(cache);
+}
+
+namespace {
+struct cachethreadarg {
+  SSCACHE *cache;
+  int seed;
+};
+
+void *cachethread(void *p) {
+  cachethreadarg *arg = (cachethreadarg *)p;
+  unsigned int seed = arg->seed;
+  for (int i = 0; i < 10000; i++) {
+    uint64_t key = rand_r(&seed) % 512;
+    SSCACHEENT *e = sscacheget(arg->cache, key);
+    if (e == NULL) {
+      char *buf = (char *)malloc(sizeof(key));
+      memcpy(buf, &key, sizeof(key));
+      e = sscacheput(arg->cache, key, buf, sizeof(key));
+    }
+    if (memcmp(e->buf, &key, sizeof(key)) != 0) return p;
+    sscacherelease(arg->cache, e);
+  }
+  return NULL;
+}
+}
+
+class SSCACHEConcurrentTest : public testing::TestWithParam<int> {};
+
+TEST_P(SSCACHEConcurrentTest, get_put) {
+  SSCACHE *cache = sscachenew(256 * (sizeof(uint64_t) + sizeof(SSCACHEENT)), 8);
+  ASSERT_TRUE(cache != NULL);
+  ASSERT_EQ(0, sscachetune(cache, GetParam()));
+  pthread_t ths[4];
+  cachethreadarg args[4];
+  for (int i = 0; i < 4; i++) {
+    args[i].cache = cache;
+    args[i].seed = i;
+    ASSERT_EQ(0, pthread_create(ths + i, NULL, cachethread, args + i));
+  }
+  for (int i = 0; i < 4; i++) {
+    void *r;
+    pthread_join(ths[i], &r);
+    EXPECT_TRUE(r == NULL);
+  }
+  sscachedel(cache);
+}
+
+INSTANTIATE_TEST_CASE_P(sscache, SSCACHEConcurrentTest, testing::Values(0, (int)SSCACHETTINYLFU));
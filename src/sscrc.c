@@ -0,0 +1,106 @@
+#include <ssutil.h>
+#include <sscrc.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_CRCHW 1
+#else
+#define HAVE_CRCHW 0
+#endif
+
+/* const or default parameters */
+#define CRCPOLY 0x82f63b78 /* reversed polynomial of CRC-32C */
+
+/* private function prototypes */
+static void sscrcinit(void);
+static uint32_t sscrc32csw(uint32_t crc, const unsigned char *p, size_t siz);
+#if HAVE_CRCHW
+static uint32_t sscrc32csse42(uint32_t crc, const unsigned char *p, size_t siz);
+#endif
+
+static pthread_once_t crconce = PTHREAD_ONCE_INIT;
+static uint32_t crctbl[8][256];
+static uint32_t (*crcfunc)(uint32_t, const unsigned char *, size_t) = sscrc32csw;
+
+/*-----------------------------------------------------------------------------
+ * APIs
+ */
+uint32_t sscrc32c(uint32_t crc, const void *buf, size_t siz) {
+  assert(buf || siz == 0);
+  pthread_once(&crconce, sscrcinit);
+  return ~crcfunc(~crc, buf, siz);
+}
+
+int sscrc32chw(void) {
+  pthread_once(&crconce, sscrcinit);
+  return crcfunc != sscrc32csw;
+}
+
+/*-----------------------------------------------------------------------------
+ * private functions
+ */
+static void sscrcinit(void) {
+  uint32_t i, j;
+  for (i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (j = 0; j < 8; j++)
+      c = (c & 1) ? (c >> 1) ^ CRCPOLY : c >> 1;
+    crctbl[0][i] = c;
+  }
+  /* table k advances a byte followed by k zero bytes */
+  for (i = 0; i < 256; i++) {
+    for (j = 1; j < 8; j++)
+      crctbl[j][i] = (crctbl[j-1][i] >> 8) ^ crctbl[0][crctbl[j-1][i] & 0xff];
+  }
+#if HAVE_CRCHW
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2")) crcfunc = sscrc32csse42;
+#endif
+}
+
+static uint32_t sscrc32csw(uint32_t crc, const unsigned char *p, size_t siz) {
+  /* eight table lookups per eight bytes instead of eight dependent ones */
+  while (siz > 0 && ((uintptr_t)p & 7)) {
+    crc = (crc >> 8) ^ crctbl[0][(crc ^ *p++) & 0xff];
+    siz--;
+  }
+  while (siz >= 8) {
+    uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                         (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+    uint32_t hi = (uint32_t)p[4] | (uint32_t)p[5] << 8 |
+      (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+    crc = crctbl[7][lo & 0xff] ^ crctbl[6][(lo >> 8) & 0xff] ^
+      crctbl[5][(lo >> 16) & 0xff] ^ crctbl[4][lo >> 24] ^
+      crctbl[3][hi & 0xff] ^ crctbl[2][(hi >> 8) & 0xff] ^
+      crctbl[1][(hi >> 16) & 0xff] ^ crctbl[0][hi >> 24];
+    p += 8;
+    siz -= 8;
+  }
+  while (siz > 0) {
+    crc = (crc >> 8) ^ crctbl[0][(crc ^ *p++) & 0xff];
+    siz--;
+  }
+  return crc;
+}
+
+#if HAVE_CRCHW
+__attribute__((target("sse4.2")))
+static uint32_t sscrc32csse42(uint32_t crc, const unsigned char *p, size_t siz) {
+  uint64_t c = crc;
+  while (siz > 0 && ((uintptr_t)p & 7)) {
+    c = __builtin_ia32_crc32qi((uint32_t)c, *p++);
+    siz--;
+  }
+  while (siz >= 8) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    c = __builtin_ia32_crc32di(c, v);
+    p += 8;
+    siz -= 8;
+  }
+  while (siz > 0) {
+    c = __builtin_ia32_crc32qi((uint32_t)c, *p++);
+    siz--;
+  }
+  return (uint32_t)c;
+}
+#endif
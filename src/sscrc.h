@@ -0,0 +1,30 @@
+#ifndef SSCRC_H_
+#define SSCRC_H_
+
+#if defined(__cplusplus)
+#define SSCRC_CLINKAGEBEGIN extern "C" {
+#define SSCRC_CLINKAGEEND }
+#else
+#define SSCRC_CLINKAGEBEGIN
+#define SSCRC_CLINKAGEEND
+#endif
+SSCRC_CLINKAGEBEGIN
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Compute the CRC-32C (Castagnoli) checksum of a region.
+   `crc' specifies the checksum of the preceding data, or 0 at the start.
+   `buf' specifies the pointer to the region.
+   `siz' specifies the size of the region.
+   The return value is the checksum of the preceding data and the region. The `crc32'
+   instruction of SSE4.2 is used where the processor has it, and slicing by 8 bytes with
+   tables otherwise. */
+uint32_t sscrc32c(uint32_t crc, const void *buf, size_t siz);
+
+/* Check whether checksums are computed by the processor.
+   The return value is true if the `crc32' instruction is used, or false if tables are. */
+int sscrc32chw(void);
+
+SSCRC_CLINKAGEEND
+#endif
@@ -0,0 +1,42 @@
+#include <sscrc.h>
+
+#include <string>
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+uint32_t crc_bitwise(const string &s) {
+  uint32_t c = 0xffffffff;
+  for (size_t i = 0; i < s.size(); i++) {
+    c ^= (unsigned char)s[i];
+    for (int j = 0; j < 8; j++)
+      c = (c & 1) ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+  }
+  return ~c;
+}
+}
+
+TEST(sscrc, known_values) {
+  EXPECT_EQ(0U, sscrc32c(0, NULL, 0));
+  EXPECT_EQ(0xe3069283U, sscrc32c(0, "123456789", 9));
+  string zeros(32, '\0'), ones(32, '\xff');
+  EXPECT_EQ(0x8a9136aaU, sscrc32c(0, zeros.data(), zeros.size()));
+  EXPECT_EQ(0x62a8ab43U, sscrc32c(0, ones.data(), ones.size()));
+}
+
+TEST(sscrc, unaligned_and_incremental) {
+  string data(4096 + 16, '\0');
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = rand();
+  for (size_t off = 0; off < 16; off++) {
+    for (size_t siz = 0; siz < 100; siz += 7) {
+      string s = data.substr(off, siz * 41);
+      uint32_t crc = sscrc32c(0, s.data(), s.size());
+      ASSERT_EQ(crc_bitwise(s), crc) << off << " " << s.size();
+      size_t half = s.size() / 3;
+      uint32_t part = sscrc32c(0, s.data(), half);
+      ASSERT_EQ(crc, sscrc32c(part, s.data() + half, s.size() - half));
+    }
+  }
+}
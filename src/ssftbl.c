@@ -1,9 +1,11 @@
+#define _GNU_SOURCE /* O_DIRECT */
 #include <ssutil.h>
 #include <compress.h>
+#include <sscache.h>
+#include <ssaio.h>
+#include <sscrc.h>
 #include <ssftbl.h>
 
-#include <tcutil.h> /* for tcmdb */
-
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -17,30 +19,220 @@
 #define FTBLIDXNUM      40                /* number of index entries */
 #define FTBLIDXOFF      44                /* index info offset */
 #define FTBLCMETHODOFF  52                /* compression method */
+#define FTBLFMTVEROFF   56                /* format version */
+#define FTBLOPTSOFF     60                /* tuning options */
+#define FTBLBFOFFOFF    64                /* bloom filter offset, 0 if there is none */
+#define FTBLBFSIZOFF    72                /* bloom filter size */
+#define FTBLBFNHASHOFF  80                /* number of probes of the bloom filter */
+
+/* format versions */
+#define FTBLFMTLEGACY   0                 /* records only, scanned linearly */
+#define FTBLFMTRESTART  1                 /* restart array at the end of each block */
+#define FTBLFMTPREFIX   2                 /* prefix-compressed keys and varint sizes */
+#define FTBLFMTFLATIDX  3                 /* flat index section and footer */
+#define FTBLFMTOPTS     4                 /* tuning options in the header */
+#define FTBLFMTCRC      5                 /* checksum trailer after each block */
+#define FTBLFORMATVER   FTBLFMTCRC        /* version written by writers */
+
+/* footer information, at the end of files since FTBLFMTFLATIDX */
+#define FTBLFOOTERSIZ   32                /* size of the footer */
+#define FTBLFIDXOFFOFF  0                 /* index section offset */
+#define FTBLFIDXSIZOFF  8                 /* index section size */
+#define FTBLFIDXNUMOFF  16                /* number of index entries */
+#define FTBLFFMTVEROFF  20                /* format version */
+#define FTBLFMAGICOFF   24                /* magic string */
+#define FTBLFOOTMAGIC   "SsFtBlIx"        /* magic string of the footer, 8 bytes */
+#define FTBLIDXALIGN    8                 /* alignment of the index section */
+#define FTBLPARTHDSIZ   8                 /* size of the entry count before a partition */
+#define FTBLBFBITS      10                /* bits of the bloom filter per key */
+#define FTBLRUNNUM      256               /* blocks read by one pread of adjacent blocks */
+#define FTBLDIRECTALIGN 4096              /* alignment of offsets, sizes and buffers for O_DIRECT */
+#define FTBLCIDSHIFT    40                /* bits of offsets in keys of a shared cache */
+#define FTBLCIDMAX      ((1U << (64 - FTBLCIDSHIFT)) - 1) /* maximum id of a table in a cache */
+#define FTBLSCANDEPTH   8                 /* default number of blocks read ahead by a scan */
+#define FTBLCRCSIZ      4                 /* size of the CRC-32C trailer of a block */
+#define FTBLWBUFSIZ     (1 << 20)         /* size of the write buffer of a writer */
+#define FTBLPREALLOC    (64 << 20)        /* bytes preallocated ahead of a writer */
+#define FTBLSYNCSIZ     (8 << 20)         /* bytes written before writeback is started */
+#define FTBLCJOBSPERW   2                 /* blocks in flight per compression worker */
+#define FTBLTOPTSALL    (SSFTBLTPARTIDX | SSFTBLTBLKHASH) /* tuning options readers know */
+#define FTBLHASHUTIL    75                /* percentage of the buckets of a block hash used */
+#define FTBLHASHEMPTY   0xffff            /* bucket of a block hash without keys */
+#define FTBLHASHCOLL    0xfffe            /* bucket of a block hash with several intervals */
 
 /* const or default parameters */
 #define FTBLFILEMODE   00644            /* permission of created files */
 #define FTBLFILESUFFIX ".sstbl"         /* suffix of data file */
 #define DEFBLKSIZ      (64 * 1024)      /* default data block size */
-#define DEFBLKCNUM     (4 * 1024)       /* default cache entry num */
-#define FTBLBLKCOUT    256
+#define DEFBLKCSIZ     (256 * 1024 * 1024) /* default cache capacity */
+#define FTBLRSTINTV    16               /* records between restart points */
+#define FTBLCURKSIZ    256              /* size of the inline key buffer of a cursor */
+
+typedef struct {                 /* cursor over the records of a decompressed block */
+  uint32_t fmtver;               /* format version of the block */
+  const char *buf;               /* block data */
+  uint32_t datasiz;              /* size of the record region */
+  const char *rsts;              /* restart array, not aligned */
+  uint32_t rstnum;               /* number of restart points */
+  const char *hbkts;             /* buckets of the block hash, not aligned */
+  uint32_t hbnum;                /* number of buckets, 0 without a block hash */
+  uint32_t off;                  /* offset of the next record */
+  const char *kbuf;              /* key of the current record */
+  int ksiz;                      /* size of the key */
+  const char *vbuf;              /* value of the current record */
+  int vsiz;                      /* size of the value */
+  char *kown;                    /* buffer of keys restored from shared prefixes */
+  int kownsiz;                   /* size of the key buffer */
+  char kfix[FTBLCURKSIZ];        /* inline key buffer for short keys */
+} SSFTBLBLKCUR;
+
+typedef struct {                 /* key of a multiple retrieval resolved to its block */
+  SSFTBLIDXREC rec;              /* index record of the block */
+  const void *kbuf;              /* key data */
+  int ksiz;                      /* key size */
+  int ridx;                      /* index of the record of the caller */
+} SSFTBLMGETITEM;
+
+typedef struct {                 /* keys of a multiple retrieval sharing a block */
+  int start;                     /* first item of the group */
+  int end;                       /* end of the items of the group */
+  const char *buf;               /* decompressed block, NULL until it is loaded */
+  int bufsiz;                    /* size of the block */
+  SSCACHEENT *ce;                /* pinned cache entry of the block */
+} SSFTBLMGETGRP;
+
+typedef struct {                 /* block handed from the prefetch thread to a scan */
+  const char *buf;               /* decompressed block */
+  int bufsiz;                    /* size of the block */
+  SSCACHEENT *ce;                /* pinned cache entry, or NULL */
+  char *own;                     /* block owned by the scan when it bypasses the cache */
+} SSFTBLSCANBLK;
+
+typedef struct {                 /* state shared by a scan and its prefetch thread */
+  SSFTBL *tbl;                   /* table */
+  SSFTBLCUR *cur;                /* block walker, used only by the prefetch thread */
+  const void *ekbuf;             /* end key, or NULL */
+  int eksiz;                     /* size of the end key */
+  int opts;                      /* scan options */
+  SSFTBLSCANBLK *ring;           /* blocks read ahead */
+  uint32_t depth;                /* capacity of the ring */
+  uint32_t head;                 /* index of the oldest block */
+  uint32_t num;                  /* number of blocks in the ring */
+  int done;                      /* whether the prefetch thread has finished */
+  int stop;                      /* whether the scan wants no more blocks */
+  int ecode;                     /* error code of the prefetch thread */
+  pthread_mutex_t mtx;           /* mutex for the ring */
+  pthread_cond_t cond;           /* signaled whenever the ring changes */
+} SSFTBLSCAN;
+
+typedef struct {                 /* block handed from a writer to the compression workers */
+  char *buf;                     /* sealed block, then the compressed block with its checksum */
+  int siz;                       /* size of `buf' */
+  uint32_t seq;                  /* index entry of the block */
+  int done;                      /* whether the block is compressed */
+} SSFTBLCOMPJOB;
+
+typedef struct {                 /* state shared by a writer and its compression workers */
+  int cmethod;                   /* compression method */
+  SSFTBLCOMPJOB *ring;           /* blocks in the order of the file */
+  uint32_t depth;                /* capacity of the ring */
+  uint64_t head;                 /* oldest block not yet written */
+  uint64_t next;                 /* oldest block not yet taken by a worker */
+  uint64_t tail;                 /* number of blocks ever queued */
+  int stop;                      /* whether the workers should exit once the ring is taken */
+  pthread_t *ths;                /* worker threads */
+  uint32_t thnum;                /* number of started worker threads */
+  pthread_mutex_t mtx;           /* mutex for the ring */
+  pthread_cond_t wcond;          /* signaled when a block is queued or the pool stops */
+  pthread_cond_t dcond;          /* signaled when a block is compressed */
+} SSFTBLCOMPPOOL;
 
 /* private function prototypes */
 static void ssftblclear(SSFTBL *tbl);
-static int ssftblopenimpl(SSFTBL *tbl, const char *path, int oflag);
+static int ssftblsetcid(SSFTBL *tbl);
+static void ssftblcidrelease(uint32_t cid);
+static SSCACHE *ssftblnewcache(uint64_t capsiz, uint32_t snum);
+static int ssftblopenimpl(SSFTBL *tbl, const char *path, int oflag, int *fdp);
 static int ssftblappendimpl(SSFTBL *tbl, const void *kbuf, int ksiz, const void *vbuf, int vsiz);
 static int ssftbldumpheader(SSFTBL *tbl);
 static int ssftblloadheader(SSFTBL *tbl);
 static int ssftbldumpindex(SSFTBL *tbl);
+static int ssftbldumppartidx(SSFTBL *tbl);
+static int ssftbldumpbf(SSFTBL *tbl);
+static int ssftblloadbf(SSFTBL *tbl);
+static uint64_t ssftblidxsecsiz(const SSFTBLIDXENT *ents, uint32_t num);
+static void ssftblfillidxsec(char *sec, const SSFTBLIDXENT *ents, uint32_t num);
 static int ssftblloadindex(SSFTBL *tbl);
-static int ssftbldumpblk(SSFTBL *tbl, int fd, char *buf, int bufsiz, int *sp);
-static char *ssftblloadblk(SSFTBL *tbl, int fd, uint64_t doff, int blksiz, int *sp);
-static SSFTBLIDXENT *ssftblindexupperbound(SSFTBL *tbl, const void *kbuf, int ksiz);
-static void *ssftblgetbyscan(SSFTBL *tbl, SSFTBLIDXENT *e, const void *kbuf, int ksiz, int *sp);
+static int ssftblloadlegacyindex(SSFTBL *tbl);
+static void ssftblsetindex(SSFTBL *tbl, const char *sec);
+static int ssftblmap(SSFTBL *tbl);
+static int ssftblsealblk(SSFTBL *tbl);
+static int ssftblputblk(SSFTBL *tbl, int bufsiz);
+static char *ssftblcompblk(int cmethod, const char *buf, int bufsiz, int *sp);
+static int ssftblwriteblk(SSFTBL *tbl, uint32_t seq, char *cbuf, int cbufsiz);
+static SSFTBLCOMPPOOL *ssftblcpoolnew(int cmethod, uint32_t thnum);
+static void ssftblcpooldel(SSFTBLCOMPPOOL *pool);
+static int ssftblcpooldrain(SSFTBL *tbl, uint64_t keep);
+static void *ssftblcompworker(void *arg);
+static int ssftblwrite(SSFTBL *tbl, char *buf, uint64_t siz);
+static int ssftblflush(SSFTBL *tbl, struct iovec *iov, int num);
+static char *ssftblloadblk(SSFTBL *tbl, uint64_t doff, int blksiz, int fill, int *sp);
+static char *ssftblinflate(SSFTBL *tbl, const char *buf, int blksiz, int *sp);
+static void ssftblputcblk(SSFTBL *tbl, uint64_t doff, const char *buf, int blksiz);
+static char *ssftblreadblk(SSFTBL *tbl, int fd, uint64_t off, uint64_t siz, char **bp);
+static int ssftblloadblks(SSFTBL *tbl, SSFTBLMGETITEM *items, SSFTBLMGETGRP *grps, int gnum);
+static int ssftblloadblksaio(SSFTBL *tbl, SSAIO *aio, SSFTBLMGETITEM *items,
+                             SSFTBLMGETGRP *grps, int gnum);
+static uint32_t ssftblindexupperbound(const uint64_t *pfxs, const SSFTBLIDXREC *recs,
+                                      const char *kbufs, uint32_t num,
+                                      const void *kbuf, int ksiz);
+static const SSFTBLIDXREC *ssftblindexsearch(SSFTBL *tbl, const void *kbuf, int ksiz);
+static int ssftblpartsearch(SSFTBL *tbl, const SSFTBLIDXREC *e, const void *kbuf, int ksiz,
+                            SSFTBLIDXREC *rp);
+static int ssftblpinpart(SSFTBL *tbl, const SSFTBLIDXREC *e, const char **bp, uint32_t *np,
+                         SSCACHEENT **cp);
+static int ssftblpinblk(SSFTBL *tbl, const SSFTBLIDXREC *e, const char **bp, int *sp,
+                        SSCACHEENT **cp);
+static void ssftblcurrelease(SSFTBLCUR *cur);
+static int ssftblcursetpart(SSFTBLCUR *cur, uint32_t pidx);
+static int ssftblcursetblk(SSFTBLCUR *cur, uint32_t bidx);
+static int ssftblcurstep(SSFTBLCUR *cur);
+static int ssftblcurlocate(SSFTBLCUR *cur, const void *kbuf, int ksiz);
+static int ssftblcurnextblk(SSFTBLCUR *cur);
+static void *ssftblscanworker(void *arg);
+static int ssftblscanload(SSFTBL *tbl, const SSFTBLIDXREC *e, int opts, SSFTBLSCANBLK *bp);
+static void ssftblscanrelease(SSFTBL *tbl, SSFTBLSCANBLK *b);
+static int ssftblblkcurinit(SSFTBL *tbl, SSFTBLBLKCUR *cur, const char *buf, int bufsiz);
+static int ssftblblkcurnext(SSFTBLBLKCUR *cur);
+static void ssftblblkcurfree(SSFTBLBLKCUR *cur);
+static uint32_t ssftblblkcurseek(SSFTBLBLKCUR *cur, const void *kbuf, int ksiz);
+static uint32_t ssftblblkcurhashseek(SSFTBLBLKCUR *cur, const void *kbuf, int ksiz);
+static int ssftblfindblk(SSFTBL *tbl, const void *kbuf, int ksiz, SSFTBLIDXREC *rp);
+static const char *ssftblgetbyscan(SSFTBL *tbl, const SSFTBLIDXREC *e,
+                                   const void *kbuf, int ksiz, int *sp, void **hp);
+static const char *ssftblblkfind(SSFTBL *tbl, const char *buf, int bufsiz,
+                                 const void *kbuf, int ksiz, int *sp);
+static int ssftblmgetitemcmp(const void *a, const void *b);
 static int ssftblkeycmp(const char *s1, size_t n1, const char *s2, size_t n2);
+static uint64_t ssftblkeypfx(const char *kbuf, int ksiz);
 static void ssftblsetecode(SSFTBL *tbl, int ecode);
 
+/* ids of open tables in the keys of shared caches; 0 is left to private caches */
+static pthread_mutex_t ftblcidmtx = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t *ftblcidfree = NULL;   /* ids released by closed tables */
+static uint32_t ftblcidfnum = 0;       /* number of released ids */
+static uint32_t ftblcidfcap = 0;       /* capacity of the released ids */
+static uint32_t ftblcidnext = 1;       /* next id never used */
+
+/* error code last set by the calling thread, so that a thread working for a caller, such as
+   the prefetch thread of a scan, learns its own failure without reading `ecode' of a reader
+   shared by other threads */
+static __thread int ftbltlecode = SSESUCCESS;
+
 /* private macros */
+#define FTBLCKEY(tbl, doff)             (((uint64_t)(tbl)->cid << FTBLCIDSHIFT) | (doff))
+#define FTBLBLKTAIL(tbl)                ((tbl)->fmtver >= FTBLFMTCRC ? FTBLCRCSIZ : 0)
+#define FTBLWEND(tbl)                   ((tbl)->woff + (tbl)->wbufsiz)
 #define FTKEYCMPGREATER(s1, n1, s2, n2) (ssftblkeycmp(s1, n1, s2, n2)  > 0)
 #define FTKEYCMPEQUAL(s1, n1, s2, n2)   (ssftblkeycmp(s1, n1, s2, n2) == 0)
 #define FTKEYCMPLESS(s1, n1, s2, n2)    (ssftblkeycmp(s1, n1, s2, n2)  < 0)
@@ -62,7 +254,7 @@ void ssftbldel(SSFTBL *tbl) {
   SSFREE(tbl);
 }
 
-int ssftbltune(SSFTBL *tbl, uint64_t blksiz, int cmethod) {
+int ssftbltune(SSFTBL *tbl, uint64_t blksiz, int cmethod, int opts) {
   if (tbl->dfd >= 0) {
     ssftblsetecode(tbl, SSEINVALID);
     return -1;
@@ -70,35 +262,108 @@ int ssftbltune(SSFTBL *tbl, uint64_t blksiz, int cmethod) {
   assert(tbl);
   if (blksiz > 0) tbl->blksiz = blksiz;
   if (cmethod > 0) tbl->cmethod = cmethod;
+  tbl->opts = opts;
+  return 0;
+}
+
+int ssftblsetcache(SSFTBL *tbl, uint64_t capsiz, uint32_t snum) {
+  assert(tbl);
+  tbl->blkcsiz = capsiz;
+  tbl->blkcsnum = snum;
+  return 0;
+}
+
+int ssftblsetccache(SSFTBL *tbl, uint64_t capsiz, uint32_t snum) {
+  assert(tbl);
+  tbl->cblkcsiz = capsiz;
+  tbl->cblkcsnum = snum;
+  return 0;
+}
+
+int ssftblsetsharedcache(SSFTBL *tbl, SSCACHE *cache, SSCACHE *ccache) {
+  assert(tbl);
+  if (tbl->dfd >= 0) {
+    ssftblsetecode(tbl, SSEINVALID);
+    return -1;
+  }
+  tbl->sblkc = cache;
+  tbl->scblkc = ccache;
   return 0;
 }
 
-int ssftblsetcache(SSFTBL *tbl, uint32_t blkcnum) {
+int ssftblsetcworkers(SSFTBL *tbl, uint32_t num) {
   assert(tbl);
-  tbl->blkcnum = (blkcnum > 0) ? blkcnum : 1;
+  if (tbl->dfd >= 0) {
+    ssftblsetecode(tbl, SSEINVALID);
+    return -1;
+  }
+  tbl->cwnum = num;
   return 0;
 }
 
-int ssftblopen(SSFTBL *tbl, const char *path, enum SSFTBLOMODE omode) {
+int ssftblopen(SSFTBL *tbl, const char *path, int omode) {
   if (tbl->dfd >= 0) {
     ssftblsetecode(tbl, SSEINVALID);
     return -1;
   }
   int r = 0;
-  switch (omode) {
+  switch (omode & (SSFTBLOREADER | SSFTBLOWRITER)) {
   case SSFTBLOWRITER:
-    if (ssftblopenimpl(tbl, path, O_WRONLY | O_CREAT | O_TRUNC) != 0) return -1;
+    if (omode & SSFTBLOMMAP) {
+      ssftblsetecode(tbl, SSEINVALID);
+      return -1;
+    }
+    tbl->fmtver = FTBLFORMATVER;
+    if (omode & SSFTBLODIRECT) {
+      ssftblsetecode(tbl, SSEINVALID);
+      return -1;
+    }
+    if (ssftblopenimpl(tbl, path, O_WRONLY | O_CREAT | O_TRUNC, &tbl->dfd) != 0) return -1;
     if (ssftbldumpheader(tbl) != 0) return -1;
+    if (posix_memalign((void **)&tbl->wbuf, FTBLDIRECTALIGN, FTBLWBUFSIZ) != 0) {
+      tbl->wbuf = NULL;
+      ssftblsetecode(tbl, SSEMISC);
+      return -1;
+    }
+    tbl->woff = FTBLHEADERSIZ;
+    tbl->wallocoff = FTBLHEADERSIZ;
+    if (tbl->cwnum > 0 && (tbl->cpool = ssftblcpoolnew(tbl->cmethod, tbl->cwnum)) == NULL) {
+      ssftblsetecode(tbl, SSETHREAD);
+      return -1;
+    }
     tbl->omode = SSFTBLOWRITER;
     tbl->path = strdup(path);
     break;
   case SSFTBLOREADER:
-    if (ssftblopenimpl(tbl, path, O_RDONLY) != 0) return -1;
+    if ((omode & SSFTBLODIRECT) && (omode & SSFTBLOMMAP)) {
+      ssftblsetecode(tbl, SSEINVALID);
+      return -1;
+    }
+    if (ssftblopenimpl(tbl, path, O_RDONLY, &tbl->dfd) != 0) return -1;
+    tbl->bfd = tbl->dfd;
+    /* the header, index and filter are read once through the page cache, blocks bypass it */
+    if ((omode & SSFTBLODIRECT) &&
+        ssftblopenimpl(tbl, path, O_RDONLY | O_DIRECT, &tbl->bfd) != 0) return -1;
     if (ssftblloadheader(tbl) != 0) return -1;
+    if ((omode & SSFTBLOMMAP) && ssftblmap(tbl) != 0) return -1;
     if (ssftblloadindex(tbl) != 0) return -1;
-    tbl->omode = SSFTBLOREADER;
+    if (ssftblloadbf(tbl) != 0) return -1;
+    tbl->omode = omode;
     tbl->path = strdup(path);
-    tbl->blkc = tcmdbnew2(tbl->blkcnum * 2 + 1);
+    if ((tbl->sblkc || tbl->scblkc) && ssftblsetcid(tbl) != 0) return -1;
+    tbl->blkc = tbl->sblkc ? tbl->sblkc : ssftblnewcache(tbl->blkcsiz, tbl->blkcsnum);
+    if (tbl->blkc == NULL) {
+      ssftblsetecode(tbl, SSETHREAD);
+      return -1;
+    }
+    /* mapped and uncompressed tables would only keep a second copy of the same bytes */
+    if ((tbl->scblkc || tbl->cblkcsiz > 0) && !tbl->map && tbl->cmethod != SSCMNONE) {
+      tbl->cblkc = tbl->scblkc ? tbl->scblkc : ssftblnewcache(tbl->cblkcsiz, tbl->cblkcsnum);
+      if (tbl->cblkc == NULL) {
+        ssftblsetecode(tbl, SSETHREAD);
+        return -1;
+      }
+    }
     break;
   default:
     r = -1;
@@ -119,19 +384,14 @@ int ssftblclose(SSFTBL *tbl) {
     tbl->path = NULL;
   }
   if (tbl->dfd >= 0) {
-    if (tbl->omode == SSFTBLOWRITER && tbl->lastappended.kbuf) {
+    if ((tbl->omode & SSFTBLOWRITER) && tbl->lastappended.kbuf) {
       int err = 0;
       assert(tbl->curblkrnum >= 1);
-      int blksiz = 0;
-      uint64_t lastkeydoff = (uint64_t)lseek(tbl->dfd, 0, SEEK_END);
-      if (ssftbldumpblk(tbl, tbl->dfd, tbl->blkbuf, tbl->curblksiz, &blksiz) != 0)
-        err = -1;
-      uint32_t lastkeyblksiz = blksiz;
-      if (tbl->curblkrnum > 1) {
-        tbl->idx[tbl->idxnum-1].doff = lastkeydoff;
-        tbl->idx[tbl->idxnum-1].blksiz = blksiz;
-      }
-      /* record last entry into tbl->idx */
+      if (ssftblputblk(tbl, ssftblsealblk(tbl)) != 0) err = -1;
+      if (tbl->cpool && ssftblcpooldrain(tbl, 0) != 0) err = -1;
+      uint64_t lastkeydoff = tbl->idx[tbl->idxnum-1].doff;
+      uint32_t lastkeyblksiz = tbl->idx[tbl->idxnum-1].blksiz;
+      /* record last entry into tbl->idx, pointing at the last block again */
       SSFTBLIDXENT *e = &tbl->lastappended;
       tbl->idxnum++;
       SSREALLOC(tbl->idx, tbl->idx, sizeof(SSFTBLIDXENT) * tbl->idxnum);
@@ -140,30 +400,65 @@ int ssftblclose(SSFTBL *tbl) {
       tbl->idx[tbl->idxnum-1].ksiz = e->ksiz;
       tbl->idx[tbl->idxnum-1].doff = lastkeydoff;
       tbl->idx[tbl->idxnum-1].blksiz = lastkeyblksiz;
-      /* get index information index */
-      off_t idxoff = lseek(tbl->dfd, 0, SEEK_END);
-      if (idxoff == -1) {
-        ssftblsetecode(tbl, SSESEEK);
-        err = -1;
-      }
-      tbl->idxoff = (uint64_t)idxoff;
-      /* dump header */
-      if (ssftbldumpheader(tbl) != 0) err = -1;
-      /* dump index */
+      /* dump the bloom filter and index, then the header pointing at them */
+      if (ssftbldumpbf(tbl) != 0) err = -1;
       if (ssftbldumpindex(tbl) != 0) err = -1;
       r = err;
     }
-    SSSYS_NOINTR(r, fsync(tbl->dfd));
-    SSSYS_NOINTR(r, close(tbl->dfd));
+    if (tbl->cpool) {
+      ssftblcpooldel(tbl->cpool);
+      tbl->cpool = NULL;
+    }
+    if (tbl->omode & SSFTBLOWRITER) {
+      /* the space preallocated beyond the last write is given back */
+      if (ssftblflush(tbl, NULL, 0) != 0) r = -1;
+      if (tbl->wallocoff > tbl->woff && ftruncate(tbl->dfd, tbl->woff) != 0) {
+        ssftblsetecode(tbl, SSETRUNC);
+        r = -1;
+      }
+      if (tbl->lastappended.kbuf && ssftbldumpheader(tbl) != 0) r = -1;
+    }
+    int sr;
+    SSSYS_NOINTR(sr, fsync(tbl->dfd));
+    if (sr != 0 && (tbl->omode & SSFTBLOWRITER)) {
+      ssftblsetecode(tbl, SSESYNC);
+      r = -1;
+    }
+    if (tbl->bfd >= 0 && tbl->bfd != tbl->dfd) SSSYS_NOINTR(sr, close(tbl->bfd));
+    tbl->bfd = -1;
+    SSSYS_NOINTR(sr, close(tbl->dfd));
+    if (sr != 0) {
+      ssftblsetecode(tbl, SSECLOSE);
+      r = -1;
+    }
     tbl->dfd = -1;
   }
+  if (tbl->map) {
+    munmap(tbl->map, tbl->mapsiz);
+    tbl->map = NULL;
+    tbl->mapsiz = 0;
+  }
   if (tbl->blkbuf) {
     SSFREE(tbl->blkbuf);
     tbl->blkbuf = NULL;
   }
   tbl->blkbufsiz = 0;
+  if (tbl->wbuf) {
+    SSFREE(tbl->wbuf);
+    tbl->wbuf = NULL;
+  }
+  tbl->wbufsiz = 0;
+  tbl->woff = 0;
+  tbl->wsyncoff = 0;
+  tbl->wallocoff = 0;
   tbl->curblkrnum = 0;
   tbl->curblksiz = 0;
+  if (tbl->rsts) {
+    SSFREE(tbl->rsts);
+    tbl->rsts = NULL;
+  }
+  tbl->rstnum = 0;
+  tbl->rstcap = 0;
   if (tbl->lastappended.kbuf) {
     SSFREE(tbl->lastappended.kbuf);
     tbl->lastappended.kbuf = NULL;
@@ -176,18 +471,57 @@ int ssftblclose(SSFTBL *tbl) {
       SSFREE(tbl->idx[i].kbuf);
     SSFREE(tbl->idx);
     tbl->idx = NULL;
-    tbl->idxnum = 0;
   }
+  if (tbl->idxsec) {
+    SSFREE(tbl->idxsec);
+    tbl->idxsec = NULL;
+  }
+  tbl->idxnum = 0;
+  tbl->idxsiz = 0;
+  tbl->idxpfx = NULL;
+  tbl->idxrecs = NULL;
+  tbl->idxkbuf = NULL;
+  if (tbl->khashs) {
+    SSFREE(tbl->khashs);
+    tbl->khashs = NULL;
+  }
+  tbl->khnum = 0;
+  tbl->khcap = 0;
+  if (tbl->bfbuf) {
+    SSFREE(tbl->bfbuf);
+    tbl->bfbuf = NULL;
+  }
+  tbl->bf = NULL;
+  tbl->bfoff = 0;
+  tbl->bfsiz = 0;
+  tbl->bfnhash = 0;
+  /* blocks of this table are dropped from shared caches, whose other tables keep theirs */
   if (tbl->blkc) {
-    tcmdbdel(tbl->blkc);
+    if (tbl->blkc == tbl->sblkc) {
+      sscacheremoverange(tbl->blkc, FTBLCKEY(tbl, 0), FTBLCKEY(tbl, 0) + (1ULL << FTBLCIDSHIFT));
+    } else {
+      sscachedel(tbl->blkc);
+    }
     tbl->blkc = NULL;
   }
+  if (tbl->cblkc) {
+    if (tbl->cblkc == tbl->scblkc) {
+      sscacheremoverange(tbl->cblkc, FTBLCKEY(tbl, 0), FTBLCKEY(tbl, 0) + (1ULL << FTBLCIDSHIFT));
+    } else {
+      sscachedel(tbl->cblkc);
+    }
+    tbl->cblkc = NULL;
+  }
+  if (tbl->cid > 0) {
+    ssftblcidrelease(tbl->cid);
+    tbl->cid = 0;
+  }
   return r;
 }
 
 int ssftblappend(SSFTBL *tbl, const void *kbuf, int ksiz, const void *vbuf, int vsiz) {
   assert(tbl && kbuf && ksiz > 0 && vbuf && vsiz > 0);
-  if (tbl->omode != SSFTBLOWRITER) {
+  if (!(tbl->omode & SSFTBLOWRITER)) {
     ssftblsetecode(tbl, SSEINVALID);
     return -1;
   }
@@ -202,44 +536,330 @@ int ssftblappend(SSFTBL *tbl, const void *kbuf, int ksiz, const void *vbuf, int
 }
 
 void *ssftblget(SSFTBL *tbl, const void *kbuf, int ksiz, int *sp) {
-  if (tbl->idxnum == 0) return NULL;
-  SSFTBLIDXENT *ubound = ssftblindexupperbound(tbl, kbuf, ksiz);
-  SSFTBLIDXENT *first = tbl->idx;
-  SSFTBLIDXENT *last = tbl->idx + tbl->idxnum;
-  assert(first <= ubound && ubound <= last);
-  if (ubound == first)
+  void *h = NULL;
+  int vsiz = 0;
+  const char *vbuf = ssftblgetref(tbl, kbuf, ksiz, &vsiz, &h);
+  if (vbuf == NULL) return NULL;
+  char *ret = NULL;
+  SSMALLOC(ret, vsiz);
+  memcpy(ret, vbuf, vsiz);
+  ssftblrelease(tbl, h);
+  if (sp) *sp = vsiz;
+  return ret;
+}
+
+const void *ssftblgetref(SSFTBL *tbl, const void *kbuf, int ksiz, int *sp, void **hp) {
+  assert(tbl && kbuf && ksiz > 0 && sp && hp);
+  *hp = NULL;
+  SSFTBLIDXREC rec;
+  if (ssftblfindblk(tbl, kbuf, ksiz, &rec) != 0) return NULL;
+  return ssftblgetbyscan(tbl, &rec, kbuf, ksiz, sp, hp);
+}
+
+SSFTBLCUR *ssftblcurnew(SSFTBL *tbl) {
+  assert(tbl);
+  SSFTBLCUR *cur = NULL;
+  SSMALLOC(cur, sizeof(SSFTBLCUR));
+  cur->tbl = tbl;
+  cur->pidx = 0;
+  cur->recs = NULL;
+  cur->bnum = 0;
+  cur->bidx = 0;
+  cur->pce = NULL;
+  cur->bce = NULL;
+  cur->valid = 0;
+  SSFTBLBLKCUR *bc = NULL;
+  SSMALLOC(bc, sizeof(SSFTBLBLKCUR));
+  bc->buf = NULL;
+  bc->kown = bc->kfix;
+  bc->kownsiz = sizeof(bc->kfix);
+  cur->blkcur = bc;
+  return cur;
+}
+
+void ssftblcurdel(SSFTBLCUR *cur) {
+  assert(cur);
+  ssftblcurrelease(cur);
+  SSFREE(cur->blkcur);
+  SSFREE(cur);
+}
+
+int ssftblcurfirst(SSFTBLCUR *cur) {
+  assert(cur);
+  SSFTBL *tbl = cur->tbl;
+  if (tbl->dfd < 0 || !(tbl->omode & SSFTBLOREADER)) {
+    ssftblsetecode(tbl, SSEINVALID);
+    return -1;
+  }
+  ssftblcurrelease(cur);
+  if (tbl->idxnum < 2) {
+    ssftblsetecode(tbl, SSENOREC);
+    return -1;
+  }
+  if (ssftblcursetpart(cur, 0) != 0) return -1;
+  if (ssftblcursetblk(cur, 0) != 0) return -1;
+  return ssftblcurstep(cur);
+}
+
+int ssftblcurjump(SSFTBLCUR *cur, const void *kbuf, int ksiz) {
+  assert(cur && kbuf && ksiz > 0);
+  SSFTBL *tbl = cur->tbl;
+  if (tbl->dfd < 0 || !(tbl->omode & SSFTBLOREADER)) {
+    ssftblsetecode(tbl, SSEINVALID);
+    return -1;
+  }
+  ssftblcurrelease(cur);
+  if (tbl->idxnum < 2) {
+    ssftblsetecode(tbl, SSENOREC);
+    return -1;
+  }
+  if (ssftblcurlocate(cur, kbuf, ksiz) != 0) return -1;
+  if (ssftblcursetblk(cur, cur->bidx) != 0) return -1;
+  ssftblblkcurseek(cur->blkcur, kbuf, ksiz);
+  while (ssftblcurstep(cur) == 0) {
+    SSFTBLBLKCUR *bc = cur->blkcur;
+    if (!FTKEYCMPLESS(bc->kbuf, bc->ksiz, kbuf, ksiz)) return 0;
+  }
+  return -1;
+}
+
+int ssftblcurnext(SSFTBLCUR *cur) {
+  assert(cur);
+  if (!cur->valid) {
+    ssftblsetecode(cur->tbl, SSENOREC);
+    return -1;
+  }
+  return ssftblcurstep(cur);
+}
+
+const void *ssftblcurkey(SSFTBLCUR *cur, int *sp) {
+  assert(cur && sp);
+  if (!cur->valid) {
+    ssftblsetecode(cur->tbl, SSENOREC);
     return NULL;
-  if (ubound == last && FTKEYCMPGREATER(kbuf, ksiz, (last-1)->kbuf, (last-1)->ksiz))
+  }
+  SSFTBLBLKCUR *bc = cur->blkcur;
+  *sp = bc->ksiz;
+  return bc->kbuf;
+}
+
+const void *ssftblcurval(SSFTBLCUR *cur, int *sp) {
+  assert(cur && sp);
+  if (!cur->valid) {
+    ssftblsetecode(cur->tbl, SSENOREC);
     return NULL;
-  SSFTBLIDXENT *e = ubound - 1;
-  assert(first <= e && e < last);
-  return ssftblgetbyscan(tbl, e, kbuf, ksiz, sp);
+  }
+  SSFTBLBLKCUR *bc = cur->blkcur;
+  *sp = bc->vsiz;
+  return bc->vbuf;
+}
+
+int ssftblscan(SSFTBL *tbl, const void *bkbuf, int bksiz, const void *ekbuf, int eksiz,
+               SSFTBLITER iter, void *op, int depth, int opts) {
+  assert(tbl && iter);
+  if (tbl->dfd < 0 || !(tbl->omode & SSFTBLOREADER)) {
+    ssftblsetecode(tbl, SSEINVALID);
+    return -1;
+  }
+  if (tbl->idxnum < 2) return 0;
+  SSFTBLCUR *cur = ssftblcurnew(tbl);
+  cur->bidx = 0;
+  if ((bkbuf ? ssftblcurlocate(cur, bkbuf, bksiz) : ssftblcursetpart(cur, 0)) != 0) {
+    ssftblcurdel(cur);
+    return -1;
+  }
+  SSFTBLSCAN scan;
+  scan.tbl = tbl;
+  scan.cur = cur;
+  scan.ekbuf = ekbuf;
+  scan.eksiz = eksiz;
+  scan.opts = opts;
+  scan.depth = (depth > 0) ? depth : FTBLSCANDEPTH;
+  scan.head = 0;
+  scan.num = 0;
+  scan.done = 0;
+  scan.stop = 0;
+  scan.ecode = SSESUCCESS;
+  SSMALLOC(scan.ring, sizeof(SSFTBLSCANBLK) * scan.depth);
+  pthread_mutex_init(&scan.mtx, NULL);
+  pthread_cond_init(&scan.cond, NULL);
+  pthread_t th;
+  int err = 0, started = 1;
+  if (pthread_create(&th, NULL, ssftblscanworker, &scan) != 0) {
+    started = 0;
+    ssftblsetecode(tbl, SSETHREAD);
+    err = -1;
+    scan.done = 1;
+  }
+  SSFTBLBLKCUR bc;
+  int first = 1, stop = 0;
+  while (!stop) {
+    SSFTBLSCANBLK b;
+    pthread_mutex_lock(&scan.mtx);
+    while (scan.num < 1 && !scan.done)
+      pthread_cond_wait(&scan.cond, &scan.mtx);
+    if (scan.num < 1) {
+      pthread_mutex_unlock(&scan.mtx);
+      break;
+    }
+    b = scan.ring[scan.head];
+    scan.head = (scan.head + 1) % scan.depth;
+    scan.num--;
+    pthread_cond_signal(&scan.cond);
+    pthread_mutex_unlock(&scan.mtx);
+    if (ssftblblkcurinit(tbl, &bc, b.buf, b.bufsiz) != 0) {
+      ssftblscanrelease(tbl, &b);
+      err = -1;
+      break;
+    }
+    if (first && bkbuf) ssftblblkcurseek(&bc, bkbuf, bksiz);
+    first = 0;
+    while (ssftblblkcurnext(&bc) == 0) {
+      if (bkbuf && FTKEYCMPLESS(bc.kbuf, bc.ksiz, bkbuf, bksiz)) continue;
+      if ((ekbuf && !FTKEYCMPLESS(bc.kbuf, bc.ksiz, ekbuf, eksiz)) ||
+          !iter(bc.kbuf, bc.ksiz, bc.vbuf, bc.vsiz, op)) {
+        stop = 1;
+        break;
+      }
+    }
+    if (!stop && bc.off < bc.datasiz) {
+      ssftblsetecode(tbl, SSERHEAD);
+      err = -1;
+      stop = 1;
+    }
+    ssftblblkcurfree(&bc);
+    ssftblscanrelease(tbl, &b);
+  }
+  pthread_mutex_lock(&scan.mtx);
+  scan.stop = 1;
+  pthread_cond_signal(&scan.cond);
+  pthread_mutex_unlock(&scan.mtx);
+  if (started) pthread_join(th, NULL);
+  while (scan.num > 0) {
+    ssftblscanrelease(tbl, scan.ring + scan.head);
+    scan.head = (scan.head + 1) % scan.depth;
+    scan.num--;
+  }
+  if (!err && scan.ecode != SSESUCCESS) {
+    ssftblsetecode(tbl, scan.ecode);
+    err = -1;
+  }
+  pthread_cond_destroy(&scan.cond);
+  pthread_mutex_destroy(&scan.mtx);
+  SSFREE(scan.ring);
+  ssftblcurdel(cur);
+  return err;
+}
+
+int ssftblmultiget(SSFTBL *tbl, SSFTBLMGETREC *recs, int num) {
+  assert(tbl && recs && num >= 0);
+  if (tbl->dfd < 0 || !(tbl->omode & SSFTBLOREADER)) {
+    ssftblsetecode(tbl, SSEINVALID);
+    return -1;
+  }
+  SSFTBLMGETITEM *items = NULL;
+  SSFTBLMGETGRP *grps = NULL;
+  int inum = 0, gnum = 0, fnum = 0, err = 0, i, j;
+  SSMALLOC(items, sizeof(SSFTBLMGETITEM) * (num + 1));
+  for (i = 0; i < num; i++) {
+    recs[i].vbuf = NULL;
+    recs[i].vsiz = 0;
+    SSFTBLMGETITEM *item = items + inum;
+    int fr = ssftblfindblk(tbl, recs[i].kbuf, recs[i].ksiz, &item->rec);
+    if (fr != 0) {
+      if (fr < 0) err = -1;
+      continue;
+    }
+    item->kbuf = recs[i].kbuf;
+    item->ksiz = recs[i].ksiz;
+    item->ridx = i;
+    inum++;
+  }
+  /* in file order, keys of the same block are next to each other and sorted */
+  qsort(items, inum, sizeof(SSFTBLMGETITEM), ssftblmgetitemcmp);
+  SSMALLOC(grps, sizeof(SSFTBLMGETGRP) * (inum + 1));
+  for (i = 0; i < inum; i = j) {
+    for (j = i + 1; j < inum && items[j].rec.doff == items[i].rec.doff; j++);
+    SSFTBLMGETGRP *grp = grps + gnum++;
+    grp->start = i;
+    grp->end = j;
+    grp->buf = NULL;
+    grp->bufsiz = 0;
+    grp->ce = NULL;
+    const SSFTBLIDXREC *e = &items[i].rec;
+    if (tbl->map && tbl->cmethod == SSCMNONE) {
+      if (e->doff + e->blksiz > tbl->mapsiz || e->blksiz <= FTBLBLKTAIL(tbl)) {
+        ssftblsetecode(tbl, SSEREAD);
+        err = -1;
+        continue;
+      }
+      grp->buf = tbl->map + e->doff;
+      grp->bufsiz = e->blksiz - FTBLBLKTAIL(tbl);
+    } else if ((grp->ce = sscacheget(tbl->blkc, FTBLCKEY(tbl, e->doff))) != NULL) {
+      grp->buf = grp->ce->buf;
+      grp->bufsiz = grp->ce->siz;
+    }
+  }
+  if (ssftblloadblks(tbl, items, grps, gnum) != 0) err = -1;
+  for (i = 0; i < gnum; i++) {
+    SSFTBLMGETGRP *grp = grps + i;
+    if (grp->buf == NULL) continue;
+    for (j = grp->start; j < grp->end; j++) {
+      int vsiz;
+      const char *vbuf = ssftblblkfind(tbl, grp->buf, grp->bufsiz,
+                                       items[j].kbuf, items[j].ksiz, &vsiz);
+      if (vbuf == NULL) continue;
+      SSFTBLMGETREC *rec = recs + items[j].ridx;
+      SSMALLOC(rec->vbuf, vsiz);
+      memcpy(rec->vbuf, vbuf, vsiz);
+      rec->vsiz = vsiz;
+      fnum++;
+    }
+    if (grp->ce) sscacherelease(tbl->blkc, grp->ce);
+  }
+  SSFREE(grps);
+  SSFREE(items);
+  return err ? -1 : fnum;
+}
+
+void ssftblrelease(SSFTBL *tbl, void *h) {
+  assert(tbl);
+  if (h == NULL) return; /* the value lives in the mapped region */
+  sscacherelease(tbl->blkc, h);
 }
 
 void *ssftblgetfirstkey(SSFTBL *tbl, int *sp) {
   assert(tbl && sp);
-  if (tbl->dfd < 0 || tbl->omode != SSFTBLOREADER) {
+  if (tbl->dfd < 0 || !(tbl->omode & SSFTBLOREADER)) {
     ssftblsetecode(tbl, SSEINVALID);
     return NULL;
   }
+  if (tbl->idxnum == 0) {
+    ssftblsetecode(tbl, SSENOREC);
+    return NULL;
+  }
   char *ret;
-  SSFTBLIDXENT *e = tbl->idx + 0;
+  const SSFTBLIDXREC *e = tbl->idxrecs + 0;
   SSMALLOC(ret, e->ksiz);
-  memcpy(ret, e->kbuf, e->ksiz);
+  memcpy(ret, tbl->idxkbuf + e->koff, e->ksiz);
   *sp = e->ksiz;
   return ret;
 }
 
 void *ssftblgetlastkey(SSFTBL *tbl, int *sp) {
-  if (tbl->dfd < 0 || tbl->omode != SSFTBLOREADER) {
+  if (tbl->dfd < 0 || !(tbl->omode & SSFTBLOREADER)) {
     ssftblsetecode(tbl, SSEINVALID);
     return NULL;
   }
+  if (tbl->idxnum == 0) {
+    ssftblsetecode(tbl, SSENOREC);
+    return NULL;
+  }
   assert(tbl->idxnum >= 2);
   char *ret;
-  SSFTBLIDXENT *e = tbl->idx + tbl->idxnum - 1;
+  const SSFTBLIDXREC *e = tbl->idxrecs + tbl->idxnum - 1;
   SSMALLOC(ret, e->ksiz);
-  memcpy(ret, e->kbuf, e->ksiz);
+  memcpy(ret, tbl->idxkbuf + e->koff, e->ksiz);
   *sp = e->ksiz;
   return ret;
 }
@@ -251,15 +871,28 @@ static void ssftblclear(SSFTBL *tbl) {
   assert(tbl);
   tbl->path = NULL;
   tbl->dfd = -1;
+  tbl->bfd = -1;
   tbl->blksiz = DEFBLKSIZ;
   tbl->rnum = 0;
+  tbl->fmtver = FTBLFORMATVER;
   tbl->cmethod = SSCMZLIB;
+  tbl->opts = 0;
   tbl->omode = 0;
   tbl->ecode = SSESUCCESS;
   tbl->blkbuf = NULL;
   tbl->blkbufsiz = 0;
+  tbl->wbuf = NULL;
+  tbl->wbufsiz = 0;
+  tbl->woff = 0;
+  tbl->wsyncoff = 0;
+  tbl->wallocoff = 0;
+  tbl->cwnum = 0;
+  tbl->cpool = NULL;
   tbl->curblkrnum = 0;
   tbl->curblksiz = 0;
+  tbl->rsts = NULL;
+  tbl->rstnum = 0;
+  tbl->rstcap = 0;
   tbl->lastappended.kbuf = NULL;
   tbl->lastappended.ksiz = 0;
   tbl->lastappended.doff = 0;
@@ -267,16 +900,88 @@ static void ssftblclear(SSFTBL *tbl) {
   tbl->idx = NULL;
   tbl->idxnum = 0;
   tbl->idxoff = 0;
+  tbl->idxsiz = 0;
+  tbl->idxsec = NULL;
+  tbl->idxpfx = NULL;
+  tbl->idxrecs = NULL;
+  tbl->idxkbuf = NULL;
+  tbl->khashs = NULL;
+  tbl->khnum = 0;
+  tbl->khcap = 0;
+  tbl->bfoff = 0;
+  tbl->bfsiz = 0;
+  tbl->bfnhash = 0;
+  tbl->bfbuf = NULL;
+  tbl->bf = NULL;
   tbl->blkc = NULL;
-  tbl->blkcnum = DEFBLKCNUM;
+  tbl->blkcsiz = DEFBLKCSIZ;
+  tbl->blkcsnum = 0;
+  tbl->cblkc = NULL;
+  tbl->cblkcsiz = 0;
+  tbl->cblkcsnum = 0;
+  tbl->sblkc = NULL;
+  tbl->scblkc = NULL;
+  tbl->cid = 0;
+  tbl->map = NULL;
+  tbl->mapsiz = 0;
+}
+
+static SSCACHE *ssftblnewcache(uint64_t capsiz, uint32_t snum) {
+  /* scans and compactions read each block once, which must not flush the hot blocks */
+  SSCACHE *cache = sscachenew(capsiz, snum);
+  if (cache && sscachetune(cache, SSCACHETTINYLFU) != 0) {
+    sscachedel(cache);
+    return NULL;
+  }
+  return cache;
+}
+
+static int ssftblsetcid(SSFTBL *tbl) {
+  /* ids are reused only after the blocks of their last table left the shared caches */
+  off_t fsiz = lseek(tbl->dfd, 0, SEEK_END);
+  if (fsiz < 0 || (uint64_t)fsiz >= (1ULL << FTBLCIDSHIFT)) {
+    ssftblsetecode(tbl, SSEINVALID);
+    return -1;
+  }
+  pthread_mutex_lock(&ftblcidmtx);
+  if (ftblcidfnum > 0) {
+    tbl->cid = ftblcidfree[--ftblcidfnum];
+  } else if (ftblcidnext <= FTBLCIDMAX) {
+    tbl->cid = ftblcidnext++;
+  }
+  pthread_mutex_unlock(&ftblcidmtx);
+  if (tbl->cid == 0) {
+    ssftblsetecode(tbl, SSEMISC);
+    return -1;
+  }
+  return 0;
+}
+
+static void ssftblcidrelease(uint32_t cid) {
+  pthread_mutex_lock(&ftblcidmtx);
+  if (ftblcidfnum >= ftblcidfcap) {
+    uint32_t fcap = ftblcidfcap > 0 ? ftblcidfcap * 2 : 64;
+    uint32_t *fids = NULL;
+    SSREALLOC(fids, ftblcidfree, sizeof(uint32_t) * fcap);
+    if (fids == NULL) {
+      /* the id is leaked rather than reused too early */
+      pthread_mutex_unlock(&ftblcidmtx);
+      return;
+    }
+    ftblcidfree = fids;
+    ftblcidfcap = fcap;
+  }
+  ftblcidfree[ftblcidfnum++] = cid;
+  pthread_mutex_unlock(&ftblcidmtx);
 }
 
-static int ssftblopenimpl(SSFTBL *tbl, const char *basepath, int oflag) {
+static int ssftblopenimpl(SSFTBL *tbl, const char *basepath, int oflag, int *fdp) {
   int r, fd;
   char *path;
-  SSMALLOC(path, strlen(basepath) + strlen(FTBLFILESUFFIX));
+  SSMALLOC(path, strlen(basepath) + strlen(FTBLFILESUFFIX) + 1);
   sprintf(path, "%s%s", basepath, FTBLFILESUFFIX);
   SSSYS_NOINTR(fd, open(path, oflag, FTBLFILEMODE));
+  SSFREE(path);
   if (fd < 0) {
     int ecode = SSEOPEN;
     switch (errno) {
@@ -287,7 +992,7 @@ static int ssftblopenimpl(SSFTBL *tbl, const char *basepath, int oflag) {
     ssftblsetecode(tbl, ecode);
     goto err;
   }
-  tbl->dfd = fd;
+  *fdp = fd;
   return 0;
 err:
   SSSYS_NOINTR(r, close(fd));
@@ -299,47 +1004,62 @@ static int ssftblappendimpl(SSFTBL *tbl, const void *kbuf, int ksiz, const void
   int isfirstappend = (tbl->lastappended.kbuf == NULL);
   int ismovetonext = (tbl->curblksiz >= tbl->blksiz);
   if (isfirstappend || ismovetonext) {
-    /* write current blkbuf */
-    uint64_t doff = 0;
-    int blksiz = 0;
-    if (isfirstappend) {
-      doff = lseek(tbl->dfd, 0, SEEK_END);
-    } else if (ismovetonext) {
-      if (ssftbldumpblk(tbl, tbl->dfd, tbl->blkbuf, tbl->curblksiz, &blksiz) != 0)
-        return -1;
-      tbl->idx[tbl->idxnum-1].blksiz = blksiz;
-      doff = lseek(tbl->dfd, 0, SEEK_END);
-    }
+    /* write current blkbuf; its offset and size are recorded when it reaches the file */
+    if (!isfirstappend && ssftblputblk(tbl, ssftblsealblk(tbl)) != 0) return -1;
     tbl->idxnum++;
     /* record the index entry */
     SSREALLOC(tbl->idx, tbl->idx, sizeof(SSFTBLIDXENT) * tbl->idxnum);
     SSMALLOC(tbl->idx[tbl->idxnum-1].kbuf, ksiz);
     memcpy(tbl->idx[tbl->idxnum-1].kbuf, kbuf, ksiz);
     tbl->idx[tbl->idxnum-1].ksiz = ksiz;
-    tbl->idx[tbl->idxnum-1].doff = doff;
+    tbl->idx[tbl->idxnum-1].doff = 0;
+    tbl->idx[tbl->idxnum-1].blksiz = 0;
     /* move to the next block */
     SSREALLOC(tbl->blkbuf, tbl->blkbuf, tbl->blksiz);
     tbl->blkbufsiz = tbl->blksiz;
     tbl->curblkrnum = 0;
     tbl->curblksiz = 0;
+    tbl->rstnum = 0;
+  }
+  /* every FTBLRSTINTV-th record starts a restart interval */
+  if (tbl->curblkrnum % FTBLRSTINTV == 0) {
+    if (tbl->rstnum >= tbl->rstcap) {
+      tbl->rstcap = (tbl->rstcap > 0) ? tbl->rstcap * 2 : 64;
+      SSREALLOC(tbl->rsts, tbl->rsts, sizeof(uint32_t) * tbl->rstcap);
+    }
+    tbl->rsts[tbl->rstnum++] = tbl->curblksiz;
+  }
+  /* share the prefix with the previous key unless this record is a restart point */
+  int shared = 0;
+  if (tbl->curblkrnum % FTBLRSTINTV != 0) {
+    const char *lkbuf = tbl->lastappended.kbuf;
+    int min = (tbl->lastappended.ksiz < ksiz) ? tbl->lastappended.ksiz : ksiz;
+    while (shared < min && lkbuf[shared] == ((const char *)kbuf)[shared])
+      shared++;
   }
   /* append to blkbuf */
-  uint32_t datasiz = sizeof(ksiz) + ksiz + sizeof(vsiz) + vsiz;
+  uint32_t datasiz = SSVNUMMAXSIZ * 3 + (ksiz - shared) + vsiz;
   if (tbl->blkbufsiz < tbl->curblksiz + datasiz) {
     SSREALLOC(tbl->blkbuf, tbl->blkbuf, tbl->curblksiz + datasiz);
     tbl->blkbufsiz = tbl->curblksiz + datasiz;
   }
   char *p = tbl->blkbuf + tbl->curblksiz;
-  memcpy(p, &ksiz, sizeof(ksiz));
-  p += sizeof(ksiz);
-  memcpy(p, kbuf, ksiz);
-  p += ksiz;
-  memcpy(p, &vsiz, sizeof(vsiz));
-  p += sizeof(vsiz);
+  p += ssvnumput(p, shared);
+  p += ssvnumput(p, ksiz - shared);
+  p += ssvnumput(p, vsiz);
+  memcpy(p, (const char *)kbuf + shared, ksiz - shared);
+  p += ksiz - shared;
   memcpy(p, vbuf, vsiz);
+  p += vsiz;
+  /* keep the key hash for the bloom filter built in close */
+  if (tbl->khnum >= tbl->khcap) {
+    tbl->khcap = (tbl->khcap > 0) ? tbl->khcap * 2 : 1024;
+    SSREALLOC(tbl->khashs, tbl->khashs, sizeof(uint64_t) * tbl->khcap);
+  }
+  tbl->khashs[tbl->khnum++] = ssbfhash(kbuf, ksiz);
   /* update lastappended */
   tbl->curblkrnum++;
-  tbl->curblksiz += datasiz;
+  tbl->curblksiz = p - tbl->blkbuf;
   SSREALLOC(tbl->lastappended.kbuf, tbl->lastappended.kbuf, ksiz);
   memcpy(tbl->lastappended.kbuf, kbuf, ksiz);
   tbl->lastappended.ksiz = ksiz;
@@ -356,6 +1076,11 @@ static int ssftbldumpheader(SSFTBL *tbl) {
   memcpy(buf + FTBLIDXNUM, &tbl->idxnum, sizeof(tbl->idxnum));
   memcpy(buf + FTBLIDXOFF, &tbl->idxoff, sizeof(tbl->idxoff));
   memcpy(buf + FTBLCMETHODOFF, &tbl->cmethod, sizeof(tbl->cmethod));
+  memcpy(buf + FTBLFMTVEROFF, &tbl->fmtver, sizeof(tbl->fmtver));
+  memcpy(buf + FTBLOPTSOFF, &tbl->opts, sizeof(tbl->opts));
+  memcpy(buf + FTBLBFOFFOFF, &tbl->bfoff, sizeof(tbl->bfoff));
+  memcpy(buf + FTBLBFSIZOFF, &tbl->bfsiz, sizeof(tbl->bfsiz));
+  memcpy(buf + FTBLBFNHASHOFF, &tbl->bfnhash, sizeof(tbl->bfnhash));
   if (lseek(tbl->dfd, 0, SEEK_SET) != 0) {
     ssftblsetecode(tbl, SSESEEK);
     return -1;
@@ -386,142 +1111,1305 @@ static int ssftblloadheader(SSFTBL *tbl) {
   memcpy(&tbl->idxnum,  buf + FTBLIDXNUM, sizeof(tbl->idxnum));
   memcpy(&tbl->idxoff,  buf + FTBLIDXOFF, sizeof(tbl->idxoff));
   memcpy(&tbl->cmethod, buf + FTBLCMETHODOFF, sizeof(tbl->cmethod));
-  assert(tbl);
+  memcpy(&tbl->fmtver,  buf + FTBLFMTVEROFF, sizeof(tbl->fmtver));
+  if (tbl->fmtver > FTBLFORMATVER) {
+    ssftblsetecode(tbl, SSEMETA);
+    return -1;
+  }
+  tbl->opts = 0;
+  if (tbl->fmtver >= FTBLFMTOPTS)
+    memcpy(&tbl->opts, buf + FTBLOPTSOFF, sizeof(tbl->opts));
+  if (tbl->opts & ~FTBLTOPTSALL) {
+    /* the blocks of unknown options cannot be parsed */
+    ssftblsetecode(tbl, SSEMETA);
+    return -1;
+  }
+  /* older writers left the bloom filter fields zero */
+  memcpy(&tbl->bfoff,   buf + FTBLBFOFFOFF, sizeof(tbl->bfoff));
+  memcpy(&tbl->bfsiz,   buf + FTBLBFSIZOFF, sizeof(tbl->bfsiz));
+  memcpy(&tbl->bfnhash, buf + FTBLBFNHASHOFF, sizeof(tbl->bfnhash));
   return 0;
 }
 
 static int ssftbldumpindex(SSFTBL *tbl) {
+  /* the section is laid out exactly as readers use it: the prefix array, the record array
+     and the key area, followed by the footer, all written at once */
   assert(tbl);
-  assert(tbl->idxoff >= FTBLHEADERSIZ);
   if (tbl->dfd < 0) {
     ssftblsetecode(tbl, SSEINVALID);
     return -1;
   }
-  off_t idxoff = lseek(tbl->dfd, 0, SEEK_END);
-  if (idxoff == -1) {
-    ssftblsetecode(tbl, SSESEEK);
+  if ((tbl->opts & SSFTBLTPARTIDX) && ssftbldumppartidx(tbl) != 0) return -1;
+  uint64_t endoff = FTBLWEND(tbl);
+  uint32_t padsiz = (FTBLIDXALIGN - endoff % FTBLIDXALIGN) % FTBLIDXALIGN;
+  uint64_t idxsiz = ssftblidxsecsiz(tbl->idx, tbl->idxnum);
+  char *buf = calloc(1, padsiz + idxsiz + FTBLFOOTERSIZ);
+  if (buf == NULL) {
+    ssftblsetecode(tbl, SSEMISC);
     return -1;
   }
-  uint32_t i;
-  for (i = 0; i < tbl->idxnum; i++) {
-    SSFTBLIDXENT *e = tbl->idx + i;
-    if (sswrite(tbl->dfd, &e->ksiz,   sizeof(e->ksiz))   != 0) return -1;
-    if (sswrite(tbl->dfd, e->kbuf,    e->ksiz)           != 0) return -1;
-    if (sswrite(tbl->dfd, &e->doff,   sizeof(e->doff))   != 0) return -1;
-    if (sswrite(tbl->dfd, &e->blksiz, sizeof(e->blksiz)) != 0) return -1;
+  char *sec = buf + padsiz;
+  ssftblfillidxsec(sec, tbl->idx, tbl->idxnum);
+  tbl->idxoff = endoff + padsiz;
+  tbl->idxsiz = idxsiz;
+  char *foot = sec + idxsiz;
+  memcpy(foot + FTBLFIDXOFFOFF, &tbl->idxoff, sizeof(tbl->idxoff));
+  memcpy(foot + FTBLFIDXSIZOFF, &tbl->idxsiz, sizeof(tbl->idxsiz));
+  memcpy(foot + FTBLFIDXNUMOFF, &tbl->idxnum, sizeof(tbl->idxnum));
+  memcpy(foot + FTBLFFMTVEROFF, &tbl->fmtver, sizeof(tbl->fmtver));
+  memcpy(foot + FTBLFMAGICOFF, FTBLFOOTMAGIC, strlen(FTBLFOOTMAGIC));
+  int r = ssftblwrite(tbl, buf, padsiz + idxsiz + FTBLFOOTERSIZ);
+  SSFREE(buf);
+  return r;
+}
+
+static int ssftbldumppartidx(SSFTBL *tbl) {
+  /* entries are grouped into partitions of about a block each, written after the data blocks
+     as the entry count followed by a section laid out like the flat index. Then `tbl->idx' is
+     replaced by the top level: the first key of each partition, and the last key again */
+  uint64_t off = FTBLWEND(tbl);
+  SSFTBLIDXENT *top = NULL;
+  uint32_t topnum = 0, first = 0, i;
+  int err = 0;
+  SSMALLOC(top, sizeof(SSFTBLIDXENT) * (tbl->idxnum + 1));
+  while (first < tbl->idxnum && !err) {
+    uint32_t num = 0;
+    uint64_t siz = FTBLPARTHDSIZ;
+    while (first + num < tbl->idxnum && (num == 0 || siz < tbl->blksiz)) {
+      siz += sizeof(uint64_t) + sizeof(SSFTBLIDXREC) + tbl->idx[first+num].ksiz;
+      num++;
+    }
+    uint32_t padsiz = (FTBLIDXALIGN - off % FTBLIDXALIGN) % FTBLIDXALIGN;
+    char *buf = calloc(1, padsiz + siz);
+    if (buf == NULL) {
+      ssftblsetecode(tbl, SSEMISC);
+      err = -1;
+      break;
+    }
+    memcpy(buf + padsiz, &num, sizeof(num));
+    ssftblfillidxsec(buf + padsiz + FTBLPARTHDSIZ, tbl->idx + first, num);
+    if (ssftblwrite(tbl, buf, padsiz + siz) != 0) err = -1;
+    SSFREE(buf);
+    SSFTBLIDXENT *e = top + topnum++;
+    SSMALLOC(e->kbuf, tbl->idx[first].ksiz);
+    memcpy(e->kbuf, tbl->idx[first].kbuf, tbl->idx[first].ksiz);
+    e->ksiz = tbl->idx[first].ksiz;
+    e->doff = off + padsiz;
+    e->blksiz = siz;
+    off += padsiz + siz;
+    first += num;
+  }
+  if (!err) {
+    SSFTBLIDXENT *last = tbl->idx + tbl->idxnum - 1;
+    SSFTBLIDXENT *e = top + topnum++;
+    SSMALLOC(e->kbuf, last->ksiz);
+    memcpy(e->kbuf, last->kbuf, last->ksiz);
+    e->ksiz = last->ksiz;
+    e->doff = top[topnum-2].doff;
+    e->blksiz = top[topnum-2].blksiz;
+  }
+  for (i = 0; i < tbl->idxnum; i++)
+    SSFREE(tbl->idx[i].kbuf);
+  SSFREE(tbl->idx);
+  tbl->idx = top;
+  tbl->idxnum = topnum;
+  return err;
+}
+
+static int ssftbldumpbf(SSFTBL *tbl) {
+  /* the filter is sized once all keys are known, so only their hashes are kept in append */
+  if (tbl->khnum < 1) return 0;
+  uint64_t bfsiz = (tbl->khnum * FTBLBFBITS + CHAR_BIT - 1) / CHAR_BIT;
+  if (bfsiz < sizeof(uint64_t)) bfsiz = sizeof(uint64_t);
+  char *bits = calloc(1, bfsiz);
+  if (bits == NULL) {
+    ssftblsetecode(tbl, SSEMISC);
+    return -1;
   }
+  uint64_t i;
+  for (i = 0; i < tbl->khnum; i++)
+    ssbfsetbits(bits, bfsiz * CHAR_BIT, SSBFDEFNHASH, tbl->khashs[i]);
+  uint64_t off = FTBLWEND(tbl);
+  int r = ssftblwrite(tbl, bits, bfsiz);
+  SSFREE(bits);
+  if (r != 0) return -1;
+  tbl->bfoff = off;
+  tbl->bfsiz = bfsiz;
+  tbl->bfnhash = SSBFDEFNHASH;
   return 0;
 }
 
-static int ssftbldumpblk(SSFTBL *tbl, int fd, char *buf, int bufsiz, int *sp) {
-  compressfunc func = getcompressfunc(tbl->cmethod);
+static int ssftblloadbf(SSFTBL *tbl) {
+  if (tbl->bfoff == 0) return 0;
+  if (tbl->bfoff < FTBLHEADERSIZ || tbl->bfsiz < 1 || tbl->bfnhash < 1 ||
+      tbl->bfoff + tbl->bfsiz > tbl->idxoff) {
+    ssftblsetecode(tbl, SSEMETA);
+    return -1;
+  }
+  if (tbl->map) {
+    tbl->bf = tbl->map + tbl->bfoff;
+    return 0;
+  }
+  SSMALLOC(tbl->bfbuf, tbl->bfsiz);
+  if (pread(tbl->dfd, tbl->bfbuf, tbl->bfsiz, tbl->bfoff) != (ssize_t)tbl->bfsiz) {
+    ssftblsetecode(tbl, SSEREAD);
+    return -1;
+  }
+  tbl->bf = tbl->bfbuf;
+  return 0;
+}
+
+static uint64_t ssftblidxsecsiz(const SSFTBLIDXENT *ents, uint32_t num) {
+  uint64_t siz = (sizeof(uint64_t) + sizeof(SSFTBLIDXREC)) * (uint64_t)num;
+  uint32_t i;
+  for (i = 0; i < num; i++)
+    siz += ents[i].ksiz;
+  return siz;
+}
+
+static void ssftblfillidxsec(char *sec, const SSFTBLIDXENT *ents, uint32_t num) {
+  /* the prefix array, the record array and the key area */
+  uint64_t recsoff = sizeof(uint64_t) * num;
+  uint64_t kbufoff = recsoff + sizeof(SSFTBLIDXREC) * num;
+  uint64_t koff = 0;
+  uint32_t i;
+  for (i = 0; i < num; i++) {
+    const SSFTBLIDXENT *e = ents + i;
+    uint64_t pfx = ssftblkeypfx(e->kbuf, e->ksiz);
+    SSFTBLIDXREC rec;
+    rec.doff = e->doff;
+    rec.koff = koff;
+    rec.blksiz = e->blksiz;
+    rec.ksiz = e->ksiz;
+    memcpy(sec + sizeof(pfx) * i, &pfx, sizeof(pfx));
+    memcpy(sec + recsoff + sizeof(rec) * i, &rec, sizeof(rec));
+    memcpy(sec + kbufoff + koff, e->kbuf, e->ksiz);
+    koff += e->ksiz;
+  }
+}
+
+static int ssftblsealblk(SSFTBL *tbl) {
+  /* append the block hash and its bucket count if tuned so, then the restart array and its
+     length after the records */
+  uint32_t hbnum = 0;
+  if ((tbl->opts & SSFTBLTBLKHASH) && tbl->rstnum < FTBLHASHCOLL)
+    hbnum = tbl->curblkrnum * 100 / FTBLHASHUTIL + 1;
+  uint32_t siz = tbl->curblksiz + sizeof(uint32_t) * (tbl->rstnum + 1);
+  if (tbl->opts & SSFTBLTBLKHASH) siz += sizeof(uint16_t) * hbnum + sizeof(uint32_t);
+  if (tbl->blkbufsiz < siz) {
+    SSREALLOC(tbl->blkbuf, tbl->blkbuf, siz);
+    tbl->blkbufsiz = siz;
+  }
+  char *p = tbl->blkbuf + tbl->curblksiz;
+  if (tbl->opts & SSFTBLTBLKHASH) {
+    /* the hashes of the records of this block are the last ones kept for the bloom filter */
+    const uint64_t *khashs = tbl->khashs + tbl->khnum - tbl->curblkrnum;
+    uint16_t empty = FTBLHASHEMPTY, coll = FTBLHASHCOLL;
+    uint32_t i;
+    for (i = 0; i < hbnum; i++)
+      memcpy(p + sizeof(uint16_t) * i, &empty, sizeof(empty));
+    for (i = 0; hbnum > 0 && i < tbl->curblkrnum; i++) {
+      char *bp = p + sizeof(uint16_t) * (khashs[i] % hbnum);
+      uint16_t bkt, rst = i / FTBLRSTINTV;
+      memcpy(&bkt, bp, sizeof(bkt));
+      if (bkt == FTBLHASHEMPTY) {
+        memcpy(bp, &rst, sizeof(rst));
+      } else if (bkt != rst) {
+        memcpy(bp, &coll, sizeof(coll));
+      }
+    }
+    p += sizeof(uint16_t) * hbnum;
+    memcpy(p, &hbnum, sizeof(hbnum));
+    p += sizeof(hbnum);
+  }
+  memcpy(p, tbl->rsts, sizeof(uint32_t) * tbl->rstnum);
+  p += sizeof(uint32_t) * tbl->rstnum;
+  memcpy(p, &tbl->rstnum, sizeof(tbl->rstnum));
+  return siz;
+}
+
+static int ssftblputblk(SSFTBL *tbl, int bufsiz) {
+  /* the sealed block in blkbuf belongs to the last index entry */
+  uint32_t seq = tbl->idxnum - 1;
+  SSFTBLCOMPPOOL *pool = tbl->cpool;
+  if (pool == NULL) {
+    int cbufsiz;
+    char *cbuf = ssftblcompblk(tbl->cmethod, tbl->blkbuf, bufsiz, &cbufsiz);
+    int r = ssftblwriteblk(tbl, seq, cbuf, cbufsiz);
+    SSFREE(cbuf);
+    return r;
+  }
+  /* write what is done and wait for a free slot, then hand blkbuf over to the workers */
+  int err = ssftblcpooldrain(tbl, pool->depth - 1);
+  pthread_mutex_lock(&pool->mtx);
+  SSFTBLCOMPJOB *job = pool->ring + pool->tail % pool->depth;
+  job->buf = tbl->blkbuf;
+  job->siz = bufsiz;
+  job->seq = seq;
+  job->done = 0;
+  pool->tail++;
+  pthread_cond_signal(&pool->wcond);
+  pthread_mutex_unlock(&pool->mtx);
+  tbl->blkbuf = NULL;
+  tbl->blkbufsiz = 0;
+  return err;
+}
+
+static char *ssftblcompblk(int cmethod, const char *buf, int bufsiz, int *sp) {
+  compressfunc func = getcompressfunc(cmethod);
   int cbufsiz = 0;
   char *cbuf = func(buf, bufsiz, &cbufsiz);
   assert(cbuf && cbufsiz > 0);
-  if (sswrite(fd, cbuf, cbufsiz) != 0) {
+  /* the checksum covers the stored bytes, so it is verified before they are decompressed */
+  uint32_t crc = sscrc32c(0, cbuf, cbufsiz);
+  SSREALLOC(cbuf, cbuf, cbufsiz + FTBLCRCSIZ);
+  memcpy(cbuf + cbufsiz, &crc, FTBLCRCSIZ);
+  *sp = cbufsiz + FTBLCRCSIZ;
+  return cbuf;
+}
+
+static int ssftblwriteblk(SSFTBL *tbl, uint32_t seq, char *cbuf, int cbufsiz) {
+  tbl->idx[seq].doff = FTBLWEND(tbl);
+  tbl->idx[seq].blksiz = cbufsiz;
+  return ssftblwrite(tbl, cbuf, cbufsiz);
+}
+
+static SSFTBLCOMPPOOL *ssftblcpoolnew(int cmethod, uint32_t thnum) {
+  SSFTBLCOMPPOOL *pool;
+  SSMALLOC(pool, sizeof(SSFTBLCOMPPOOL));
+  if (pool == NULL) return NULL;
+  pool->cmethod = cmethod;
+  pool->depth = thnum * FTBLCJOBSPERW;
+  pool->head = 0;
+  pool->next = 0;
+  pool->tail = 0;
+  pool->stop = 0;
+  pool->thnum = 0;
+  SSMALLOC(pool->ring, sizeof(SSFTBLCOMPJOB) * pool->depth);
+  SSMALLOC(pool->ths, sizeof(pthread_t) * thnum);
+  pthread_mutex_init(&pool->mtx, NULL);
+  pthread_cond_init(&pool->wcond, NULL);
+  pthread_cond_init(&pool->dcond, NULL);
+  if (pool->ring == NULL || pool->ths == NULL) {
+    ssftblcpooldel(pool);
+    return NULL;
+  }
+  while (pool->thnum < thnum) {
+    if (pthread_create(pool->ths + pool->thnum, NULL, ssftblcompworker, pool) != 0) {
+      ssftblcpooldel(pool);
+      return NULL;
+    }
+    pool->thnum++;
+  }
+  return pool;
+}
+
+static void ssftblcpooldel(SSFTBLCOMPPOOL *pool) {
+  /* blocks still queued after a failed write are compressed and then dropped */
+  uint32_t i;
+  pthread_mutex_lock(&pool->mtx);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->wcond);
+  pthread_mutex_unlock(&pool->mtx);
+  for (i = 0; i < pool->thnum; i++)
+    pthread_join(pool->ths[i], NULL);
+  for (; pool->head < pool->tail; pool->head++)
+    SSFREE(pool->ring[pool->head % pool->depth].buf);
+  pthread_cond_destroy(&pool->dcond);
+  pthread_cond_destroy(&pool->wcond);
+  pthread_mutex_destroy(&pool->mtx);
+  if (pool->ths) SSFREE(pool->ths);
+  if (pool->ring) SSFREE(pool->ring);
+  SSFREE(pool);
+}
+
+static int ssftblcpooldrain(SSFTBL *tbl, uint64_t keep) {
+  /* write the compressed blocks at the head of the ring in order, waiting for the workers
+     until no more than `keep' blocks are left */
+  SSFTBLCOMPPOOL *pool = tbl->cpool;
+  int err = 0;
+  pthread_mutex_lock(&pool->mtx);
+  while (pool->head < pool->tail) {
+    SSFTBLCOMPJOB *job = pool->ring + pool->head % pool->depth;
+    if (!job->done) {
+      if (pool->tail - pool->head <= keep) break;
+      pthread_cond_wait(&pool->dcond, &pool->mtx);
+      continue;
+    }
+    pthread_mutex_unlock(&pool->mtx);
+    if (ssftblwriteblk(tbl, job->seq, job->buf, job->siz) != 0) err = -1;
+    SSFREE(job->buf);
+    job->buf = NULL;
+    pthread_mutex_lock(&pool->mtx);
+    pool->head++;
+  }
+  pthread_mutex_unlock(&pool->mtx);
+  return err;
+}
+
+static void *ssftblcompworker(void *arg) {
+  SSFTBLCOMPPOOL *pool = arg;
+  pthread_mutex_lock(&pool->mtx);
+  while (1) {
+    while (pool->next >= pool->tail && !pool->stop)
+      pthread_cond_wait(&pool->wcond, &pool->mtx);
+    if (pool->next >= pool->tail) break;
+    SSFTBLCOMPJOB *job = pool->ring + pool->next % pool->depth;
+    pool->next++;
+    pthread_mutex_unlock(&pool->mtx);
+    int cbufsiz;
+    char *cbuf = ssftblcompblk(pool->cmethod, job->buf, job->siz, &cbufsiz);
+    SSFREE(job->buf);
+    pthread_mutex_lock(&pool->mtx);
+    job->buf = cbuf;
+    job->siz = cbufsiz;
+    job->done = 1;
+    pthread_cond_signal(&pool->dcond);
+  }
+  pthread_mutex_unlock(&pool->mtx);
+  return NULL;
+}
+
+static int ssftblwrite(SSFTBL *tbl, char *buf, uint64_t siz) {
+  /* small pieces are gathered in the write buffer, and a piece which does not fit goes out
+     with the buffered bytes in one vectored write instead of being copied */
+  if (tbl->wbufsiz + siz <= FTBLWBUFSIZ) {
+    memcpy(tbl->wbuf + tbl->wbufsiz, buf, siz);
+    tbl->wbufsiz += siz;
+    return 0;
+  }
+  struct iovec iov;
+  iov.iov_base = buf;
+  iov.iov_len = siz;
+  return ssftblflush(tbl, &iov, 1);
+}
+
+static int ssftblflush(SSFTBL *tbl, struct iovec *iov, int num) {
+  /* write the buffered bytes followed by `num' more regions at the end of the file */
+  struct iovec vec[2];
+  uint64_t siz = tbl->wbufsiz;
+  int vnum = 0, i;
+  if (tbl->wbufsiz > 0) {
+    vec[vnum].iov_base = tbl->wbuf;
+    vec[vnum++].iov_len = tbl->wbufsiz;
+  }
+  for (i = 0; i < num && vnum < 2; i++) {
+    vec[vnum++] = iov[i];
+    siz += iov[i].iov_len;
+  }
+  assert(i == num);
+  if (siz < 1) return 0;
+  if (tbl->woff + siz > tbl->wallocoff) {
+    /* preallocation keeps the file contiguous and the allocator out of the writes, but it is
+       only a hint, so filesystems without it allocate as they are written */
+    uint64_t end = tbl->woff + siz + FTBLPREALLOC;
+    fallocate(tbl->dfd, 0, tbl->wallocoff, end - tbl->wallocoff);
+    tbl->wallocoff = end;
+  }
+  if (sspwritev(tbl->dfd, vec, vnum, tbl->woff) != 0) {
     ssftblsetecode(tbl, SSEWRITE);
-    SSFREE(cbuf);
     return -1;
   }
-  SSFREE(cbuf);
-  *sp = cbufsiz;
+  tbl->woff += siz;
+  tbl->wbufsiz = 0;
+  if (tbl->woff - tbl->wsyncoff >= FTBLSYNCSIZ) {
+    /* writeback starts in the background, so the `fsync' in close has little left to do */
+    sync_file_range(tbl->dfd, tbl->wsyncoff, tbl->woff - tbl->wsyncoff, SYNC_FILE_RANGE_WRITE);
+    tbl->wsyncoff = tbl->woff;
+  }
   return 0;
 }
 
-static char *ssftblloadblk(SSFTBL *tbl, int fd, uint64_t doff, int blksiz, int *sp) {
-  char *buf;
-  SSMALLOC(buf, blksiz);
-  ssize_t nbytes = pread(fd, buf, blksiz, doff);
-  if (nbytes != blksiz) {
-    ssftblsetecode(tbl, SSEREAD);
+static char *ssftblloadblk(SSFTBL *tbl, uint64_t doff, int blksiz, int fill, int *sp) {
+  /* `fill' tells whether a block read from the file is kept in the compressed tier */
+  const char *buf;
+  char *rbuf = NULL, *pbuf;
+  SSCACHEENT *cce = NULL;
+  if (tbl->map) {
+    /* decompress straight from the mapped region */
+    if (doff + blksiz > tbl->mapsiz) {
+      ssftblsetecode(tbl, SSEREAD);
+      return NULL;
+    }
+    buf = tbl->map + doff;
+  } else if (tbl->cblkc && (cce = sscacheget(tbl->cblkc, FTBLCKEY(tbl, doff))) != NULL) {
+    /* a miss in the decompressed tier is inflated from memory */
+    buf = cce->buf;
+  } else {
+    if ((rbuf = ssftblreadblk(tbl, tbl->bfd, doff, blksiz, &pbuf)) == NULL) return NULL;
+    if (tbl->cblkc && fill) ssftblputcblk(tbl, doff, pbuf, blksiz);
+    buf = pbuf;
+  }
+  char *dbuf = ssftblinflate(tbl, buf, blksiz, sp);
+  if (cce) sscacherelease(tbl->cblkc, cce);
+  if (rbuf) SSFREE(rbuf);
+  return dbuf;
+}
+
+static char *ssftblinflate(SSFTBL *tbl, const char *buf, int blksiz, int *sp) {
+  /* `buf' holds the block as stored, with its checksum trailer if the format has one */
+  int tail = FTBLBLKTAIL(tbl);
+  if (blksiz <= tail) {
+    ssftblsetecode(tbl, SSERHEAD);
     return NULL;
   }
+  if (tail > 0) {
+    uint32_t crc;
+    memcpy(&crc, buf + blksiz - tail, sizeof(crc));
+    if (sscrc32c(0, buf, blksiz - tail) != crc) {
+      ssftblsetecode(tbl, SSECHKSUM);
+      return NULL;
+    }
+  }
   decompressfunc func = getdecompressfunc(tbl->cmethod);
   int dbufsiz = 0;
-  char *dbuf = func(buf, blksiz, &dbufsiz);
-  assert(dbuf && dbufsiz > 0);
+  char *dbuf = func(buf, blksiz - tail, &dbufsiz);
+  if (dbuf == NULL || dbufsiz < 1) {
+    /* blocks of older formats have no checksum to catch a broken one earlier */
+    if (dbuf) SSFREE(dbuf);
+    ssftblsetecode(tbl, SSERHEAD);
+    return NULL;
+  }
   *sp = dbufsiz;
   return dbuf;
 }
 
+static void ssftblputcblk(SSFTBL *tbl, uint64_t doff, const char *buf, int blksiz) {
+  char *cbuf;
+  SSMALLOC(cbuf, blksiz);
+  if (cbuf == NULL) return;
+  memcpy(cbuf, buf, blksiz);
+  sscacherelease(tbl->cblkc, sscacheput(tbl->cblkc, FTBLCKEY(tbl, doff), cbuf, blksiz));
+}
+
+static char *ssftblreadblk(SSFTBL *tbl, int fd, uint64_t off, uint64_t siz, char **bp) {
+  /* the returned region is freed by the caller and `*bp' points at the data in it */
+  char *rbuf = NULL;
+  uint64_t roff = off, rsiz = siz;
+  if (tbl->omode & SSFTBLODIRECT) {
+    /* O_DIRECT needs the whole aligned range, which may end beyond the file */
+    roff = off & ~(uint64_t)(FTBLDIRECTALIGN - 1);
+    rsiz = (off + siz - roff + FTBLDIRECTALIGN - 1) & ~(uint64_t)(FTBLDIRECTALIGN - 1);
+    if (posix_memalign((void **)&rbuf, FTBLDIRECTALIGN, rsiz) != 0) rbuf = NULL;
+  } else {
+    SSMALLOC(rbuf, rsiz);
+  }
+  if (rbuf == NULL) {
+    ssftblsetecode(tbl, SSEMISC);
+    return NULL;
+  }
+  ssize_t nbytes;
+  SSSYS_NOINTR(nbytes, pread(fd, rbuf, rsiz, roff));
+  if (nbytes < 0 || (uint64_t)nbytes < off - roff + siz) {
+    ssftblsetecode(tbl, SSEREAD);
+    SSFREE(rbuf);
+    return NULL;
+  }
+  *bp = rbuf + (off - roff);
+  return rbuf;
+}
+
+static int ssftblloadblks(SSFTBL *tbl, SSFTBLMGETITEM *items, SSFTBLMGETGRP *grps, int gnum) {
+  /* blocks still missing are read in runs of adjacent ones, one pread for each run */
+  int err = 0, i = 0, j, k;
+  if (tbl->cblkc) {
+    /* blocks in the compressed tier need no reads */
+    for (k = 0; k < gnum; k++) {
+      if (grps[k].buf || grps[k].ce) continue;
+      const SSFTBLIDXREC *ke = &items[grps[k].start].rec;
+      SSCACHEENT *cce = sscacheget(tbl->cblkc, FTBLCKEY(tbl, ke->doff));
+      if (cce == NULL) continue;
+      int dbufsiz;
+      char *dbuf = ssftblinflate(tbl, cce->buf, ke->blksiz, &dbufsiz);
+      sscacherelease(tbl->cblkc, cce);
+      if (dbuf == NULL) {
+        err = -1;
+        continue;
+      }
+      grps[k].ce = sscacheput(tbl->blkc, FTBLCKEY(tbl, ke->doff), dbuf, dbufsiz);
+      grps[k].buf = grps[k].ce->buf;
+      grps[k].bufsiz = grps[k].ce->siz;
+    }
+  }
+  if ((tbl->omode & SSFTBLOAIO) && !tbl->map) {
+    SSAIO *aio = ssaiothread();
+    if (aio) return ssftblloadblksaio(tbl, aio, items, grps, gnum);
+  }
+  while (i < gnum) {
+    if (grps[i].buf || grps[i].ce) {
+      i++;
+      continue;
+    }
+    const SSFTBLIDXREC *e = &items[grps[i].start].rec;
+    if (tbl->map) {
+      int bufsiz;
+      char *lbuf = ssftblloadblk(tbl, e->doff, e->blksiz, 1, &bufsiz);
+      if (lbuf) {
+        grps[i].ce = sscacheput(tbl->blkc, FTBLCKEY(tbl, e->doff), lbuf, bufsiz);
+        grps[i].buf = grps[i].ce->buf;
+        grps[i].bufsiz = grps[i].ce->siz;
+      } else {
+        err = -1;
+      }
+      i++;
+      continue;
+    }
+    uint64_t end = e->doff;
+    for (j = i; j < gnum && j - i < FTBLRUNNUM; j++) {
+      const SSFTBLIDXREC *je = &items[grps[j].start].rec;
+      if (grps[j].buf || grps[j].ce || je->doff != end) break;
+      end += je->blksiz;
+    }
+    char *buf;
+    char *rbuf = ssftblreadblk(tbl, tbl->bfd, e->doff, end - e->doff, &buf);
+    if (rbuf == NULL) {
+      err = -1;
+      i = j;
+      continue;
+    }
+    for (k = i; k < j; k++) {
+      const SSFTBLIDXREC *ke = &items[grps[k].start].rec;
+      const char *kbuf = buf + (ke->doff - e->doff);
+      int dbufsiz;
+      char *dbuf = ssftblinflate(tbl, kbuf, ke->blksiz, &dbufsiz);
+      if (dbuf == NULL) {
+        err = -1;
+        continue;
+      }
+      if (tbl->cblkc) ssftblputcblk(tbl, ke->doff, kbuf, ke->blksiz);
+      grps[k].ce = sscacheput(tbl->blkc, FTBLCKEY(tbl, ke->doff), dbuf, dbufsiz);
+      grps[k].buf = grps[k].ce->buf;
+      grps[k].bufsiz = grps[k].ce->siz;
+    }
+    SSFREE(rbuf);
+    i = j;
+  }
+  return err;
+}
+
+static int ssftblloadblksaio(SSFTBL *tbl, SSAIO *aio, SSFTBLMGETITEM *items,
+                             SSFTBLMGETGRP *grps, int gnum) {
+  /* every missing block is in flight at once, adjacent or not */
+  SSAIOREQ *reqs = NULL;
+  int *gidxs = NULL;
+  int err = 0, num = 0, i;
+  uint64_t align = (tbl->omode & SSFTBLODIRECT) ? FTBLDIRECTALIGN : 1;
+  SSMALLOC(reqs, sizeof(SSAIOREQ) * gnum);
+  SSMALLOC(gidxs, sizeof(int) * gnum);
+  if (reqs == NULL || gidxs == NULL) {
+    if (gidxs) SSFREE(gidxs);
+    if (reqs) SSFREE(reqs);
+    ssftblsetecode(tbl, SSEMISC);
+    return -1;
+  }
+  for (i = 0; i < gnum; i++) {
+    if (grps[i].buf || grps[i].ce) continue;
+    const SSFTBLIDXREC *e = &items[grps[i].start].rec;
+    reqs[num].fd = tbl->bfd;
+    reqs[num].off = e->doff & ~(align - 1);
+    reqs[num].siz = (e->doff + e->blksiz - reqs[num].off + align - 1) & ~(align - 1);
+    if (posix_memalign(&reqs[num].buf, align < sizeof(void *) ? sizeof(void *) : align,
+                       reqs[num].siz) != 0) {
+      ssftblsetecode(tbl, SSEMISC);
+      err = -1;
+      continue;
+    }
+    gidxs[num++] = i;
+  }
+  ssaioread(aio, reqs, num);
+  for (i = 0; i < num; i++) {
+    SSFTBLMGETGRP *grp = grps + gidxs[i];
+    const SSFTBLIDXREC *e = &items[grp->start].rec;
+    /* an aligned read may stop short at the end of the file, past the block */
+    if (reqs[i].res >= 0 && (uint64_t)reqs[i].res >= e->doff - reqs[i].off + e->blksiz) {
+      const char *ebuf = (const char *)reqs[i].buf + (e->doff - reqs[i].off);
+      int dbufsiz;
+      char *dbuf = ssftblinflate(tbl, ebuf, e->blksiz, &dbufsiz);
+      if (dbuf) {
+        if (tbl->cblkc) ssftblputcblk(tbl, e->doff, ebuf, e->blksiz);
+        grp->ce = sscacheput(tbl->blkc, FTBLCKEY(tbl, e->doff), dbuf, dbufsiz);
+        grp->buf = grp->ce->buf;
+        grp->bufsiz = grp->ce->siz;
+      } else {
+        err = -1;
+      }
+    } else {
+      ssftblsetecode(tbl, SSEREAD);
+      err = -1;
+    }
+    SSFREE(reqs[i].buf);
+  }
+  SSFREE(gidxs);
+  SSFREE(reqs);
+  return err;
+}
+
 static int ssftblloadindex(SSFTBL *tbl) {
   assert(tbl);
-  if (lseek(tbl->dfd, tbl->idxoff, SEEK_SET) != (off_t)tbl->idxoff) {
+  if (tbl->fmtver < FTBLFMTFLATIDX) return ssftblloadlegacyindex(tbl);
+  off_t fsiz = lseek(tbl->dfd, 0, SEEK_END);
+  if (fsiz == -1) {
     ssftblsetecode(tbl, SSESEEK);
     return -1;
   }
-  SSMALLOC(tbl->idx, sizeof(SSFTBLIDXENT) * tbl->idxnum);
+  /* a writer closed without records leaves only the header */
+  if (tbl->idxnum == 0 && fsiz == FTBLHEADERSIZ) {
+    tbl->idxsiz = 0;
+    return 0;
+  }
+  char foot[FTBLFOOTERSIZ];
+  if (fsiz < FTBLHEADERSIZ + FTBLFOOTERSIZ ||
+      pread(tbl->dfd, foot, FTBLFOOTERSIZ, fsiz - FTBLFOOTERSIZ) != FTBLFOOTERSIZ) {
+    ssftblsetecode(tbl, SSEREAD);
+    return -1;
+  }
+  uint64_t idxoff;
+  uint32_t idxnum;
+  memcpy(&idxoff, foot + FTBLFIDXOFFOFF, sizeof(idxoff));
+  memcpy(&tbl->idxsiz, foot + FTBLFIDXSIZOFF, sizeof(tbl->idxsiz));
+  memcpy(&idxnum, foot + FTBLFIDXNUMOFF, sizeof(idxnum));
+  if (memcmp(foot + FTBLFMAGICOFF, FTBLFOOTMAGIC, strlen(FTBLFOOTMAGIC)) != 0 ||
+      idxoff != tbl->idxoff || idxnum != tbl->idxnum || idxoff % FTBLIDXALIGN != 0 ||
+      idxoff + tbl->idxsiz + FTBLFOOTERSIZ != (uint64_t)fsiz ||
+      tbl->idxsiz < (sizeof(uint64_t) + sizeof(SSFTBLIDXREC)) * (uint64_t)idxnum) {
+    ssftblsetecode(tbl, SSEMETA);
+    return -1;
+  }
+  if (tbl->map) {
+    /* used in place, so opening does not depend on the index size */
+    ssftblsetindex(tbl, tbl->map + tbl->idxoff);
+    return 0;
+  }
+  SSMALLOC(tbl->idxsec, tbl->idxsiz + 1);
+  if (tbl->idxsec == NULL) {
+    ssftblsetecode(tbl, SSEMISC);
+    return -1;
+  }
+  if (pread(tbl->dfd, tbl->idxsec, tbl->idxsiz, tbl->idxoff) != (ssize_t)tbl->idxsiz) {
+    ssftblsetecode(tbl, SSEREAD);
+    return -1;
+  }
+  ssftblsetindex(tbl, tbl->idxsec);
+  return 0;
+}
+
+static int ssftblloadlegacyindex(SSFTBL *tbl) {
+  /* entries are stored one by one as ksiz, kbuf, doff and blksiz up to the end of file;
+     read them at once and convert them into the flat layout */
+  off_t fsiz = lseek(tbl->dfd, 0, SEEK_END);
+  if (fsiz == -1 || (uint64_t)fsiz < tbl->idxoff) {
+    ssftblsetecode(tbl, SSESEEK);
+    return -1;
+  }
+  uint64_t rsiz = fsiz - tbl->idxoff;
+  char *rbuf = NULL;
+  SSMALLOC(rbuf, rsiz + 1);
+  if (rbuf == NULL) {
+    ssftblsetecode(tbl, SSEMISC);
+    return -1;
+  }
+  if (pread(tbl->dfd, rbuf, rsiz, tbl->idxoff) != (ssize_t)rsiz) goto err;
+  uint64_t off = 0, ksizsum = 0;
   uint32_t i;
   for (i = 0; i < tbl->idxnum; i++) {
-    SSFTBLIDXENT *e = tbl->idx + i;
-    if (ssread(tbl->dfd, &e->ksiz,   sizeof(e->ksiz))   != 0) goto err;
-    SSMALLOC(e->kbuf, e->ksiz);
-    if (ssread(tbl->dfd, e->kbuf,    e->ksiz)           != 0) goto err;
-    if (ssread(tbl->dfd, &e->doff,   sizeof(e->doff))   != 0) goto err;
-    if (ssread(tbl->dfd, &e->blksiz, sizeof(e->blksiz)) != 0) goto err;
+    int ksiz;
+    if (off + sizeof(ksiz) > rsiz) goto err;
+    memcpy(&ksiz, rbuf + off, sizeof(ksiz));
+    if (ksiz < 0) goto err;
+    off += sizeof(ksiz) + ksiz + sizeof(uint64_t) + sizeof(uint32_t);
+    if (off > rsiz) goto err;
+    ksizsum += ksiz;
+  }
+  uint64_t recsoff = sizeof(uint64_t) * tbl->idxnum;
+  uint64_t kbufoff = recsoff + sizeof(SSFTBLIDXREC) * tbl->idxnum;
+  tbl->idxsiz = kbufoff + ksizsum;
+  SSMALLOC(tbl->idxsec, tbl->idxsiz + 1);
+  if (tbl->idxsec == NULL) goto err;
+  uint64_t *pfxs = (uint64_t *)tbl->idxsec;
+  SSFTBLIDXREC *recs = (SSFTBLIDXREC *)(tbl->idxsec + recsoff);
+  uint64_t koff = 0;
+  off = 0;
+  for (i = 0; i < tbl->idxnum; i++) {
+    int ksiz;
+    memcpy(&ksiz, rbuf + off, sizeof(ksiz));
+    off += sizeof(ksiz);
+    memcpy(tbl->idxsec + kbufoff + koff, rbuf + off, ksiz);
+    pfxs[i] = ssftblkeypfx(rbuf + off, ksiz);
+    off += ksiz;
+    memcpy(&recs[i].doff, rbuf + off, sizeof(recs[i].doff));
+    off += sizeof(recs[i].doff);
+    memcpy(&recs[i].blksiz, rbuf + off, sizeof(recs[i].blksiz));
+    off += sizeof(recs[i].blksiz);
+    recs[i].koff = koff;
+    recs[i].ksiz = ksiz;
+    koff += ksiz;
   }
+  SSFREE(rbuf);
+  ssftblsetindex(tbl, tbl->idxsec);
   return 0;
 err:
+  SSFREE(rbuf);
   ssftblsetecode(tbl, SSEREAD);
   return -1;
 }
 
-static SSFTBLIDXENT *ssftblindexupperbound(SSFTBL *tbl, const void *kbuf, int ksiz) {
-  assert(tbl && kbuf && ksiz);
-  uint32_t len = tbl->idxnum;
-  uint32_t half;
-  SSFTBLIDXENT *first, *last, *middle;
-  first = tbl->idx;
-  last = tbl->idx + len;
+static void ssftblsetindex(SSFTBL *tbl, const char *sec) {
+  tbl->idxpfx = (const uint64_t *)sec;
+  tbl->idxrecs = (const SSFTBLIDXREC *)(sec + sizeof(uint64_t) * tbl->idxnum);
+  tbl->idxkbuf = sec + (sizeof(uint64_t) + sizeof(SSFTBLIDXREC)) * tbl->idxnum;
+}
+
+static int ssftblmap(SSFTBL *tbl) {
+  assert(tbl && tbl->dfd >= 0);
+  off_t siz = lseek(tbl->dfd, 0, SEEK_END);
+  if (siz == -1) {
+    ssftblsetecode(tbl, SSESEEK);
+    return -1;
+  }
+  void *ptr = mmap(NULL, siz, PROT_READ, MAP_SHARED, tbl->dfd, 0);
+  if (ptr == MAP_FAILED) {
+    ssftblsetecode(tbl, SSEMMAP);
+    return -1;
+  }
+  /* point lookups touch a block at a time, so kernel readahead only pollutes */
+  madvise(ptr, siz, MADV_RANDOM);
+  tbl->map = ptr;
+  tbl->mapsiz = siz;
+  return 0;
+}
+
+static uint32_t ssftblindexupperbound(const uint64_t *pfxs, const SSFTBLIDXREC *recs,
+                                      const char *kbufs, uint32_t num,
+                                      const void *kbuf, int ksiz) {
+  assert(kbuf && ksiz);
+  uint32_t len = num;
+  uint32_t half, first = 0, middle;
+  uint64_t pfx = ssftblkeypfx(kbuf, ksiz);
   while (len > 0) {
     half = len >> 1;
     middle = first + half;
-    if (FTKEYCMPLESS(kbuf, ksiz, middle->kbuf, middle->ksiz)) {
+    /* the dense prefix array decides most probes without touching the keys */
+    uint64_t mpfx = pfxs[middle];
+    const SSFTBLIDXREC *e = recs + middle;
+    if (pfx < mpfx || (pfx == mpfx && FTKEYCMPLESS(kbuf, ksiz, kbufs + e->koff, e->ksiz))) {
       len = half;
     } else {
-      first = middle;
-      first++;
+      first = middle + 1;
       len = len - half - 1;
     }
   }
   return first;
 }
 
-static void *ssftblgetbyscan(SSFTBL *tbl, SSFTBLIDXENT *e, const void *kb, int ks, int *sp) {
-  assert(e && kb && ks);
+static const SSFTBLIDXREC *ssftblindexsearch(SSFTBL *tbl, const void *kbuf, int ksiz) {
+  if (tbl->idxnum == 0) return NULL;
+  const SSFTBLIDXREC *ubound = tbl->idxrecs +
+    ssftblindexupperbound(tbl->idxpfx, tbl->idxrecs, tbl->idxkbuf, tbl->idxnum, kbuf, ksiz);
+  const SSFTBLIDXREC *first = tbl->idxrecs;
+  const SSFTBLIDXREC *last = tbl->idxrecs + tbl->idxnum;
+  assert(first <= ubound && ubound <= last);
+  if (ubound == first)
+    return NULL;
+  if (ubound == last &&
+      FTKEYCMPGREATER(kbuf, ksiz, tbl->idxkbuf + (last-1)->koff, (last-1)->ksiz))
+    return NULL;
+  const SSFTBLIDXREC *e = ubound - 1;
+  assert(first <= e && e < last);
+  return e;
+}
+
+static int ssftblpartsearch(SSFTBL *tbl, const SSFTBLIDXREC *e, const void *kbuf, int ksiz,
+                            SSFTBLIDXREC *rp) {
+  const char *buf;
+  uint32_t num;
+  SSCACHEENT *ce;
+  if (ssftblpinpart(tbl, e, &buf, &num, &ce) != 0) return -1;
+  const uint64_t *pfxs = (const uint64_t *)(buf + FTBLPARTHDSIZ);
+  const SSFTBLIDXREC *recs = (const SSFTBLIDXREC *)(pfxs + num);
+  const char *kbufs = (const char *)(recs + num);
+  /* the top level routes only keys from the first key of the partition on */
+  uint32_t ubound = ssftblindexupperbound(pfxs, recs, kbufs, num, kbuf, ksiz);
+  *rp = recs[(ubound > 0) ? ubound - 1 : 0];
+  if (ce) sscacherelease(tbl->blkc, ce);
+  return 0;
+}
+
+static int ssftblpinpart(SSFTBL *tbl, const SSFTBLIDXREC *e, const char **bp, uint32_t *np,
+                         SSCACHEENT **cp) {
+  const char *buf = NULL;
+  SSCACHEENT *ce = NULL;
+  if (e->blksiz < FTBLPARTHDSIZ) {
+    ssftblsetecode(tbl, SSERHEAD);
+    return -1;
+  }
+  if (tbl->map) {
+    /* partitions are never compressed, so they are always searched in place */
+    if (e->doff + e->blksiz > tbl->mapsiz) {
+      ssftblsetecode(tbl, SSEREAD);
+      return -1;
+    }
+    buf = tbl->map + e->doff;
+  } else {
+    ce = sscacheget(tbl->blkc, FTBLCKEY(tbl, e->doff));
+    if (ce == NULL) {
+      char *lbuf, *rbuf, *pbuf;
+      if ((rbuf = ssftblreadblk(tbl, tbl->bfd, e->doff, e->blksiz, &pbuf)) == NULL) return -1;
+      if (pbuf == rbuf) {
+        lbuf = rbuf;
+      } else {
+        /* the cache frees what it is given, so the partition is moved out of the aligned read */
+        SSMALLOC(lbuf, e->blksiz);
+        memcpy(lbuf, pbuf, e->blksiz);
+        SSFREE(rbuf);
+      }
+      ce = sscacheput(tbl->blkc, FTBLCKEY(tbl, e->doff), lbuf, e->blksiz);
+    }
+    buf = ce->buf;
+  }
+  uint32_t num;
+  memcpy(&num, buf, sizeof(num));
+  if (num < 1 ||
+      num > (e->blksiz - FTBLPARTHDSIZ) / (sizeof(uint64_t) + sizeof(SSFTBLIDXREC))) {
+    ssftblsetecode(tbl, SSERHEAD);
+    if (ce) sscacherelease(tbl->blkc, ce);
+    return -1;
+  }
+  *bp = buf;
+  *np = num;
+  *cp = ce;
+  return 0;
+}
+
+static void ssftblcurrelease(SSFTBLCUR *cur) {
+  SSFTBLBLKCUR *bc = cur->blkcur;
+  if (bc->buf) {
+    ssftblblkcurfree(bc);
+    bc->buf = NULL;
+  }
+  if (cur->bce) {
+    sscacherelease(cur->tbl->blkc, cur->bce);
+    cur->bce = NULL;
+  }
+  if (cur->pce) {
+    sscacherelease(cur->tbl->blkc, cur->pce);
+    cur->pce = NULL;
+  }
+  cur->recs = NULL;
+  cur->bnum = 0;
+  cur->valid = 0;
+}
+
+static int ssftblcursetpart(SSFTBLCUR *cur, uint32_t pidx) {
+  /* blocks are listed by the flat index or by each partition, except the last key entry */
+  SSFTBL *tbl = cur->tbl;
+  if (cur->pce) {
+    sscacherelease(tbl->blkc, cur->pce);
+    cur->pce = NULL;
+  }
+  cur->pidx = pidx;
+  if (!(tbl->opts & SSFTBLTPARTIDX)) {
+    cur->recs = tbl->idxrecs;
+    cur->pnum = tbl->idxnum;
+    cur->bnum = tbl->idxnum - 1;
+    return 0;
+  }
+  const char *buf;
+  uint32_t num;
+  SSCACHEENT *ce;
+  if (ssftblpinpart(tbl, tbl->idxrecs + pidx, &buf, &num, &ce) != 0) return -1;
+  cur->pce = ce;
+  cur->recs = (const SSFTBLIDXREC *)(buf + FTBLPARTHDSIZ + sizeof(uint64_t) * num);
+  cur->pnum = num;
+  cur->bnum = (pidx + 2 >= tbl->idxnum) ? num - 1 : num;
+  return 0;
+}
+
+static int ssftblcursetblk(SSFTBLCUR *cur, uint32_t bidx) {
+  SSFTBL *tbl = cur->tbl;
+  SSFTBLBLKCUR *bc = cur->blkcur;
+  if (bc->buf) {
+    ssftblblkcurfree(bc);
+    bc->buf = NULL;
+  }
+  if (cur->bce) {
+    sscacherelease(tbl->blkc, cur->bce);
+    cur->bce = NULL;
+  }
+  cur->valid = 0;
+  cur->bidx = bidx;
+  const char *buf;
+  int bufsiz;
+  SSCACHEENT *ce;
+  if (ssftblpinblk(tbl, cur->recs + bidx, &buf, &bufsiz, &ce) != 0) return -1;
+  cur->bce = ce;
+  if (ssftblblkcurinit(tbl, bc, buf, bufsiz) != 0) return -1;
+  return 0;
+}
+
+static int ssftblcurlocate(SSFTBLCUR *cur, const void *kbuf, int ksiz) {
+  /* the last entry not greater than the key, at the top level and then in the partition */
+  SSFTBL *tbl = cur->tbl;
+  uint32_t ubound =
+    ssftblindexupperbound(tbl->idxpfx, tbl->idxrecs, tbl->idxkbuf, tbl->idxnum, kbuf, ksiz);
+  uint32_t pidx = 0, bidx;
+  if (tbl->opts & SSFTBLTPARTIDX) {
+    pidx = (ubound > 0) ? ubound - 1 : 0;
+    if (pidx > tbl->idxnum - 2) pidx = tbl->idxnum - 2;
+    if (ssftblcursetpart(cur, pidx) != 0) return -1;
+    const uint64_t *pfxs = (const uint64_t *)cur->recs - cur->pnum;
+    const char *kbufs = (const char *)(cur->recs + cur->pnum);
+    ubound = ssftblindexupperbound(pfxs, cur->recs, kbufs, cur->pnum, kbuf, ksiz);
+    if (cur->bnum < 1 && pidx > 0) {
+      /* the last partition may hold nothing but the last key */
+      if (ssftblcursetpart(cur, pidx - 1) != 0) return -1;
+      ubound = cur->bnum;
+    }
+  } else {
+    if (ssftblcursetpart(cur, 0) != 0) return -1;
+  }
+  bidx = (ubound > 0) ? ubound - 1 : 0;
+  if (bidx >= cur->bnum) bidx = cur->bnum - 1;
+  cur->bidx = bidx;
+  return 0;
+}
+
+static int ssftblcurnextblk(SSFTBLCUR *cur) {
+  /* move to the next block without loading it; 1 is returned at the end */
+  SSFTBL *tbl = cur->tbl;
+  if (cur->bidx + 1 < cur->bnum) {
+    cur->bidx++;
+    return 0;
+  }
+  while ((tbl->opts & SSFTBLTPARTIDX) && cur->pidx + 2 < tbl->idxnum) {
+    if (ssftblcursetpart(cur, cur->pidx + 1) != 0) return -1;
+    if (cur->bnum > 0) {
+      cur->bidx = 0;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void *ssftblscanworker(void *arg) {
+  /* read and decompress blocks in order, keeping up to `depth' of them ahead of the scan */
+  SSFTBLSCAN *scan = arg;
+  SSFTBLCUR *cur = scan->cur;
+  int ecode = SSESUCCESS;
+  ftbltlecode = SSESUCCESS;
+  while (1) {
+    pthread_mutex_lock(&scan->mtx);
+    while (scan->num >= scan->depth && !scan->stop)
+      pthread_cond_wait(&scan->cond, &scan->mtx);
+    int stop = scan->stop;
+    pthread_mutex_unlock(&scan->mtx);
+    if (stop) break;
+    const SSFTBLIDXREC *e = cur->recs + cur->bidx;
+    /* no record of a block starting at or after the end key is wanted */
+    const char *kbufs = (const char *)(cur->recs + cur->pnum);
+    if (scan->ekbuf && !FTKEYCMPLESS(kbufs + e->koff, e->ksiz, scan->ekbuf, scan->eksiz))
+      break;
+    SSFTBLSCANBLK b;
+    if (ssftblscanload(scan->tbl, e, scan->opts, &b) != 0) {
+      ecode = ftbltlecode;
+      break;
+    }
+    pthread_mutex_lock(&scan->mtx);
+    scan->ring[(scan->head + scan->num) % scan->depth] = b;
+    scan->num++;
+    pthread_cond_signal(&scan->cond);
+    pthread_mutex_unlock(&scan->mtx);
+    int r = ssftblcurnextblk(cur);
+    if (r != 0) {
+      if (r < 0) ecode = ftbltlecode;
+      break;
+    }
+    /* the next block is read by the kernel while this thread may wait for room; the advice
+       covers only that block, as the file is shared with other users of the table, and is
+       left out for direct reads, which bypass the page cache */
+    if (scan->tbl->bfd == scan->tbl->dfd) {
+      e = cur->recs + cur->bidx;
+      posix_fadvise(scan->tbl->dfd, e->doff, e->blksiz, POSIX_FADV_WILLNEED);
+    }
+  }
+  pthread_mutex_lock(&scan->mtx);
+  scan->ecode = ecode;
+  scan->done = 1;
+  pthread_cond_signal(&scan->cond);
+  pthread_mutex_unlock(&scan->mtx);
+  return NULL;
+}
+
+static int ssftblscanload(SSFTBL *tbl, const SSFTBLIDXREC *e, int opts, SSFTBLSCANBLK *bp) {
+  bp->ce = NULL;
+  bp->own = NULL;
+  if (!(opts & SSFTBLSNOCACHE)) return ssftblpinblk(tbl, e, &bp->buf, &bp->bufsiz, &bp->ce);
+  /* cached blocks are still used, but blocks read here are not left in the cache */
+  if (!(tbl->map && tbl->cmethod == SSCMNONE) &&
+      (bp->ce = sscacheget(tbl->blkc, FTBLCKEY(tbl, e->doff))) == NULL) {
+    bp->own = ssftblloadblk(tbl, e->doff, e->blksiz, 0, &bp->bufsiz);
+    if (bp->own == NULL) return -1;
+    bp->buf = bp->own;
+    return 0;
+  }
+  if (bp->ce) {
+    bp->buf = bp->ce->buf;
+    bp->bufsiz = bp->ce->siz;
+    return 0;
+  }
+  return ssftblpinblk(tbl, e, &bp->buf, &bp->bufsiz, &bp->ce);
+}
+
+static void ssftblscanrelease(SSFTBL *tbl, SSFTBLSCANBLK *b) {
+  if (b->ce) sscacherelease(tbl->blkc, b->ce);
+  if (b->own) SSFREE(b->own);
+}
+
+static int ssftblcurstep(SSFTBLCUR *cur) {
+  /* move to the next record, crossing into following blocks and partitions */
+  SSFTBL *tbl = cur->tbl;
+  SSFTBLBLKCUR *bc = cur->blkcur;
+  while (1) {
+    if (bc->buf && ssftblblkcurnext(bc) == 0) {
+      cur->valid = 1;
+      return 0;
+    }
+    cur->valid = 0;
+    if (bc->buf && bc->off < bc->datasiz) {
+      ssftblsetecode(tbl, SSERHEAD);
+      return -1;
+    }
+    int r = ssftblcurnextblk(cur);
+    if (r != 0) {
+      if (r > 0) ssftblsetecode(tbl, SSENOREC);
+      return -1;
+    }
+    if (ssftblcursetblk(cur, cur->bidx) != 0) return -1;
+  }
+}
+
+/* find the block which may hold a key; 0 is returned with the block, 1 if no block holds it,
+   or -1 on failure */
+static int ssftblfindblk(SSFTBL *tbl, const void *kbuf, int ksiz, SSFTBLIDXREC *rp) {
+  /* most misses end here without touching the index or any block */
+  if (tbl->bf && !ssbftestbits(tbl->bf, tbl->bfsiz * CHAR_BIT, tbl->bfnhash,
+                               ssbfhash(kbuf, ksiz)))
+    return 1;
+  const SSFTBLIDXREC *e = ssftblindexsearch(tbl, kbuf, ksiz);
+  if (e == NULL) return 1;
+  if (tbl->opts & SSFTBLTPARTIDX) return ssftblpartsearch(tbl, e, kbuf, ksiz, rp);
+  *rp = *e;
+  return 0;
+}
+
+static int ssftblpinblk(SSFTBL *tbl, const SSFTBLIDXREC *e, const char **bp, int *sp,
+                        SSCACHEENT **cp) {
+  *cp = NULL;
+  if (tbl->map && tbl->cmethod == SSCMNONE) {
+    /* uncompressed blocks are scanned directly in the mapped region, where the checksum is
+       not verified on every access but records are still bounds-checked */
+    if (e->doff + e->blksiz > tbl->mapsiz || e->blksiz <= FTBLBLKTAIL(tbl)) {
+      ssftblsetecode(tbl, SSEREAD);
+      return -1;
+    }
+    *bp = tbl->map + e->doff;
+    *sp = e->blksiz - FTBLBLKTAIL(tbl);
+    return 0;
+  }
+  SSCACHEENT *ce = sscacheget(tbl->blkc, FTBLCKEY(tbl, e->doff));
+  if (ce == NULL) {
+    int bufsiz;
+    char *lbuf = ssftblloadblk(tbl, e->doff, e->blksiz, 1, &bufsiz); /* block cache miss */
+    if (lbuf == NULL) return -1;
+    ce = sscacheput(tbl->blkc, FTBLCKEY(tbl, e->doff), lbuf, bufsiz);
+  }
+  *bp = ce->buf;
+  *sp = ce->siz;
+  *cp = ce;
+  return 0;
+}
+
+static const char *ssftblgetbyscan(SSFTBL *tbl, const SSFTBLIDXREC *e,
+                                   const void *kb, int ks, int *sp, void **hp) {
+  assert(e && kb && ks && sp && hp);
   int bufsiz = 0;
-  char *buf = tcmdbget(tbl->blkc, &e->doff, sizeof(e->doff), &bufsiz);
-  if (buf == NULL) {
-    buf = ssftblloadblk(tbl, tbl->dfd, e->doff, e->blksiz, &bufsiz); /* block cache miss */
-    if (buf == NULL) return NULL;
-    tcmdbput3(tbl->blkc, &e->doff, sizeof(e->doff), buf, bufsiz);
-    if (tcmdbrnum(tbl->blkc) >= tbl->blkcnum)
-      tcmdbcutfront(tbl->blkc, FTBLBLKCOUT);
+  const char *buf = NULL;
+  SSCACHEENT *ce = NULL;
+  if (ssftblpinblk(tbl, e, &buf, &bufsiz, &ce) != 0) return NULL;
+  const char *vbuf = ssftblblkfind(tbl, buf, bufsiz, kb, ks, sp);
+  if (vbuf) {
+    *hp = ce;
+    return vbuf;
   }
-  if (buf == NULL || bufsiz <= 0)
-    return NULL;
-  int curpos = 0;
-  while (curpos < bufsiz) {
-    int ksiz = *((int*)(buf + curpos));
-    curpos += sizeof(ksiz);
-    char *kbuf = buf + curpos;
-    curpos += ksiz;
-    int vsiz = *((int*)(buf + curpos));
-    curpos += sizeof(vsiz);
-    char *vbuf = buf + curpos;
-    curpos += vsiz;
-    if (FTKEYCMPEQUAL(kbuf, ksiz, kb, ks)) {
-      if (sp) *sp = vsiz;
-      char *ret = NULL;
-      SSMALLOC(ret, vsiz);
-      memcpy(ret, vbuf, vsiz);
-      return ret;
+  if (ce) sscacherelease(tbl->blkc, ce);
+  return NULL;
+}
+
+static const char *ssftblblkfind(SSFTBL *tbl, const char *buf, int bufsiz,
+                                 const void *kb, int ks, int *sp) {
+  SSFTBLBLKCUR cur;
+  if (ssftblblkcurinit(tbl, &cur, buf, bufsiz) != 0) return NULL;
+  uint32_t end = ssftblblkcurhashseek(&cur, kb, ks);
+  while (cur.off < end && ssftblblkcurnext(&cur) == 0) {
+    int cmp = ssftblkeycmp(cur.kbuf, cur.ksiz, kb, ks);
+    if (cmp == 0) {
+      ssftblblkcurfree(&cur);
+      *sp = cur.vsiz;
+      return cur.vbuf;
     }
+    if (cmp > 0) break; /* records are sorted, so the key is not here */
   }
-  SSFREE(buf);
+  ssftblblkcurfree(&cur);
   return NULL;
 }
 
+static int ssftblmgetitemcmp(const void *a, const void *b) {
+  const SSFTBLMGETITEM *ia = a, *ib = b;
+  if (ia->rec.doff != ib->rec.doff) return (ia->rec.doff < ib->rec.doff) ? -1 : 1;
+  return ssftblkeycmp(ia->kbuf, ia->ksiz, ib->kbuf, ib->ksiz);
+}
+
+static int ssftblblkcurinit(SSFTBL *tbl, SSFTBLBLKCUR *cur, const char *buf, int bufsiz) {
+  cur->fmtver = tbl->fmtver;
+  cur->kown = cur->kfix;
+  cur->kownsiz = sizeof(cur->kfix);
+  cur->buf = buf;
+  cur->datasiz = bufsiz;
+  cur->rsts = NULL;
+  cur->rstnum = 0;
+  cur->hbkts = NULL;
+  cur->hbnum = 0;
+  cur->off = 0;
+  if (tbl->fmtver >= FTBLFMTRESTART) {
+    uint32_t rstnum;
+    if (bufsiz < (int)sizeof(rstnum)) goto err;
+    memcpy(&rstnum, buf + bufsiz - sizeof(rstnum), sizeof(rstnum));
+    if (rstnum > (bufsiz - sizeof(rstnum)) / sizeof(uint32_t)) goto err;
+    cur->datasiz = bufsiz - sizeof(uint32_t) * (rstnum + 1);
+    cur->rsts = buf + cur->datasiz;
+    cur->rstnum = rstnum;
+  }
+  if (tbl->opts & SSFTBLTBLKHASH) {
+    uint32_t hbnum;
+    if (cur->datasiz < sizeof(hbnum)) goto err;
+    memcpy(&hbnum, buf + cur->datasiz - sizeof(hbnum), sizeof(hbnum));
+    if (hbnum > (cur->datasiz - sizeof(hbnum)) / sizeof(uint16_t)) goto err;
+    cur->datasiz -= sizeof(hbnum) + sizeof(uint16_t) * hbnum;
+    cur->hbkts = buf + cur->datasiz;
+    cur->hbnum = hbnum;
+  }
+  return 0;
+err:
+  ssftblsetecode(tbl, SSERHEAD);
+  return -1;
+}
+
+static int ssftblblkcurnext(SSFTBLBLKCUR *cur) {
+  uint32_t off = cur->off;
+  int ksiz, vsiz;
+  if (cur->fmtver >= FTBLFMTPREFIX) {
+    uint64_t shared, unshared, vnum;
+    int step;
+    const char *endp = cur->buf + cur->datasiz;
+    if (!(step = ssvnumget(cur->buf + off, endp - (cur->buf + off), &shared))) return -1;
+    off += step;
+    if (!(step = ssvnumget(cur->buf + off, endp - (cur->buf + off), &unshared))) return -1;
+    off += step;
+    if (!(step = ssvnumget(cur->buf + off, endp - (cur->buf + off), &vnum))) return -1;
+    off += step;
+    if (unshared > cur->datasiz - off || vnum > cur->datasiz - off - unshared) return -1;
+    if (shared > 0 && (cur->off == 0 || shared > (uint64_t)cur->ksiz)) return -1;
+    if (shared == 0) {
+      /* restart points and unrelated keys are used in place */
+      cur->kbuf = cur->buf + off;
+    } else {
+      if (shared + unshared > (uint64_t)cur->kownsiz) {
+        int kownsiz = shared + unshared;
+        char *kown = NULL;
+        SSMALLOC(kown, kownsiz);
+        if (kown == NULL) return -1;
+        memcpy(kown, cur->kbuf, shared);
+        if (cur->kown != cur->kfix) SSFREE(cur->kown);
+        cur->kown = kown;
+        cur->kownsiz = kownsiz;
+      } else if (cur->kbuf != cur->kown) {
+        memcpy(cur->kown, cur->kbuf, shared);
+      }
+      memcpy(cur->kown + shared, cur->buf + off, unshared);
+      cur->kbuf = cur->kown;
+    }
+    cur->ksiz = shared + unshared;
+    off += unshared;
+    cur->vbuf = cur->buf + off;
+    cur->vsiz = vnum;
+    cur->off = off + vnum;
+    return 0;
+  }
+  if (off + sizeof(ksiz) > cur->datasiz) return -1;
+  memcpy(&ksiz, cur->buf + off, sizeof(ksiz));
+  off += sizeof(ksiz);
+  if (ksiz < 0 || off + ksiz + sizeof(vsiz) > cur->datasiz) return -1;
+  cur->kbuf = cur->buf + off;
+  cur->ksiz = ksiz;
+  off += ksiz;
+  memcpy(&vsiz, cur->buf + off, sizeof(vsiz));
+  off += sizeof(vsiz);
+  if (vsiz < 0 || off + vsiz > cur->datasiz) return -1;
+  cur->vbuf = cur->buf + off;
+  cur->vsiz = vsiz;
+  cur->off = off + vsiz;
+  return 0;
+}
+
+static void ssftblblkcurfree(SSFTBLBLKCUR *cur) {
+  if (cur->kown != cur->kfix) SSFREE(cur->kown);
+  cur->kown = cur->kfix;
+  cur->kownsiz = sizeof(cur->kfix);
+}
+
+static uint32_t ssftblblkcurseek(SSFTBLBLKCUR *cur, const void *kbuf, int ksiz) {
+  /* position at the last restart point not greater than the key and return the offset at
+     which the scan can stop */
+  uint32_t lo = 0, hi = cur->rstnum, rst;
+  if (cur->rstnum == 0) {
+    cur->off = 0;
+    return cur->datasiz;
+  }
+  while (hi - lo > 1) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    memcpy(&rst, cur->rsts + sizeof(rst) * mid, sizeof(rst));
+    cur->off = rst;
+    if (ssftblblkcurnext(cur) == 0 && !FTKEYCMPGREATER(cur->kbuf, cur->ksiz, kbuf, ksiz)) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  memcpy(&rst, cur->rsts + sizeof(rst) * lo, sizeof(rst));
+  cur->off = rst;
+  if (hi == cur->rstnum) return cur->datasiz;
+  memcpy(&rst, cur->rsts + sizeof(rst) * hi, sizeof(rst));
+  return rst;
+}
+
+static uint32_t ssftblblkcurhashseek(SSFTBLBLKCUR *cur, const void *kbuf, int ksiz) {
+  /* position at the restart interval of the key in the block hash and return the offset at
+     which the scan can stop, which is the position itself if the key is not in the block */
+  if (cur->hbnum < 1) return ssftblblkcurseek(cur, kbuf, ksiz);
+  uint16_t bkt;
+  memcpy(&bkt, cur->hbkts + sizeof(bkt) * (ssbfhash(kbuf, ksiz) % cur->hbnum), sizeof(bkt));
+  if (bkt == FTBLHASHEMPTY) {
+    cur->off = 0;
+    return 0;
+  }
+  if (bkt >= cur->rstnum) return ssftblblkcurseek(cur, kbuf, ksiz); /* collisions */
+  uint32_t rst;
+  memcpy(&rst, cur->rsts + sizeof(rst) * bkt, sizeof(rst));
+  cur->off = rst;
+  if (bkt + 1U == cur->rstnum) return cur->datasiz;
+  memcpy(&rst, cur->rsts + sizeof(rst) * (bkt + 1), sizeof(rst));
+  return rst;
+}
+
 static int ssftblkeycmp(const char *s1, size_t n1, const char *s2, size_t n2) {
   /* same with std::string ordering */
   assert(s1 && s2);
@@ -534,7 +2422,19 @@ static int ssftblkeycmp(const char *s1, size_t n1, const char *s2, size_t n2) {
   return r;
 }
 
+static uint64_t ssftblkeypfx(const char *kbuf, int ksiz) {
+  /* the first 8 bytes in big-endian order, zero-padded, so that integer order agrees with
+     the key order whenever two prefixes differ */
+  const unsigned char *p = (const unsigned char *)kbuf;
+  uint64_t pfx = 0;
+  int i;
+  for (i = 0; i < 8; i++)
+    pfx = (pfx << 8) | ((i < ksiz) ? p[i] : 0);
+  return pfx;
+}
+
 static void ssftblsetecode(SSFTBL *tbl, int ecode) {
   assert(tbl);
   tbl->ecode = ecode;
+  ftbltlecode = ecode;
 }
@@ -12,10 +12,20 @@ SSFTBL_CLINKAGEBEGIN
 
 #include <compress.h>
 #include <ssutil.h>
+#include <ssbf.h>
+#include <sscache.h>
 
 enum SSFTBLOMODE { /* enumeration for open modes */
   SSFTBLOREADER = 1 << 0, /* open as a reader */
-  SSFTBLOWRITER = 1 << 1  /* open as a writer */
+  SSFTBLOWRITER = 1 << 1, /* open as a writer */
+  SSFTBLOMMAP   = 1 << 2, /* map the whole table file (reader only) */
+  SSFTBLOAIO    = 1 << 3, /* read blocks missed by a batch with io_uring where available */
+  SSFTBLODIRECT = 1 << 4  /* read blocks with O_DIRECT, bypassing the page cache (reader only) */
+};
+
+enum SSFTBLTOPTS { /* enumeration for tuning options */
+  SSFTBLTPARTIDX = 1 << 0, /* two-level index whose partitions are loaded on demand */
+  SSFTBLTBLKHASH = 1 << 1  /* hash table in each block from keys to restart intervals */
 };
 
 typedef struct {
@@ -25,13 +35,29 @@ typedef struct {
   uint32_t blksiz; /* size of block in data file */
 } SSFTBLIDXENT;
 
+typedef struct {       /* index entry as stored in the index section */
+  uint64_t doff;       /* offset of the block in data file */
+  uint64_t koff;       /* offset of the key in the key area */
+  uint32_t blksiz;     /* size of the block in data file */
+  uint32_t ksiz;       /* size of the key */
+} SSFTBLIDXREC;
+
+typedef struct {   /* key and result of a multiple retrieval */
+  const void *kbuf; /* key data */
+  int ksiz;         /* key size */
+  void *vbuf;       /* value allocated with `malloc', or NULL if the key is not found */
+  int vsiz;         /* value size */
+} SSFTBLMGETREC;
+
 typedef struct {
   char *path;                  /* path of table file */
   int dfd;                     /* file descriptor for data file */
+  int bfd;                     /* file descriptor for blocks, opened with O_DIRECT if asked */
   uint32_t blksiz;             /* block size */
   uint32_t rnum;               /* total number of records */
-  pthread_rwlock_t mtx;        /* mutex for record */
+  uint32_t fmtver;             /* format version of the table file */
   int cmethod;                 /* compression method */
+  int opts;                    /* tuning options */
   int omode;                   /* open mode */
   int ecode;                   /* error code */
   /* writer-only */
@@ -39,26 +65,206 @@ typedef struct {
   uint32_t blkbufsiz;          /* size of block buffer */
   uint32_t curblkrnum;         /* number of records in the current block */
   uint32_t curblksiz;          /* counter for splitting into blocks in append */
+  uint32_t *rsts;              /* restart offsets of the current block */
+  uint32_t rstnum;             /* number of restart offsets */
+  uint32_t rstcap;             /* capacity of the restart offsets */
   SSFTBLIDXENT lastappended;   /* last appended key info */
+  SSFTBLIDXENT *idx;           /* index entries collected in append */
+  uint64_t *khashs;            /* hashes of appended keys for the bloom filter */
+  uint64_t khnum;              /* number of key hashes */
+  uint64_t khcap;              /* capacity of the key hashes */
+  char *wbuf;                  /* aligned buffer gathering output for vectored writes */
+  uint32_t wbufsiz;            /* bytes waiting in the write buffer */
+  uint64_t woff;               /* offset in the file of the write buffer */
+  uint64_t wsyncoff;           /* offset up to which writeback has been started */
+  uint64_t wallocoff;          /* offset up to which space has been preallocated */
+  uint32_t cwnum;              /* number of compression workers, 0 to compress inline */
+  void *cpool;                 /* pool of compression workers, or NULL */
   /* reader-only */
-  SSFTBLIDXENT *idx;           /* index used for binary-search */
-  uint32_t idxnum;             /* number of index entry */
-  uint64_t idxoff;             /* offset to the index file */
-  void *blkc;                  /* lru cache of block */
-  uint32_t blkcnum;            /* number of blocks to be cached */
+  uint32_t idxnum;             /* number of index entry, of the top level if partitioned */
+  uint64_t idxoff;             /* offset to the index section */
+  uint64_t idxsiz;             /* size of the index section */
+  char *idxsec;                /* index section read into memory, NULL if used in the map */
+  const uint64_t *idxpfx;      /* big-endian 8-byte key prefixes for binary-search */
+  const SSFTBLIDXREC *idxrecs; /* index records parallel to idxpfx */
+  const char *idxkbuf;         /* key area of the index section */
+  uint64_t bfoff;              /* offset to the bloom filter, or 0 if there is none */
+  uint64_t bfsiz;              /* size of the bloom filter in bytes */
+  uint32_t bfnhash;            /* number of probes of the bloom filter */
+  char *bfbuf;                 /* bloom filter read into memory, NULL if used in the map */
+  const char *bf;              /* bloom filter checked before the index */
+  void *blkc;                  /* lru cache of block (SSCACHE) */
+  uint64_t blkcsiz;            /* capacity of the block cache in bytes */
+  uint32_t blkcsnum;           /* number of shards of the block cache */
+  void *cblkc;                 /* lru cache of compressed blocks (SSCACHE), or NULL */
+  uint64_t cblkcsiz;           /* capacity of the compressed block cache in bytes */
+  uint32_t cblkcsnum;          /* number of shards of the compressed block cache */
+  SSCACHE *sblkc;              /* shared block cache given by the caller, or NULL */
+  SSCACHE *scblkc;             /* shared compressed block cache given by the caller, or NULL */
+  uint32_t cid;                /* id of the table in the keys of shared caches, 0 if none */
+  char *map;                   /* mapped region of the table file */
+  uint64_t mapsiz;             /* size of the mapped region */
 } SSFTBL;
 
+enum SSFTBLSOPTS { /* enumeration for scan options */
+  SSFTBLSNOCACHE = 1 << 0 /* do not fill the block cache with scanned blocks */
+};
+
+/* type of the pointer to a function called for each record of a scan.
+   `kbuf' and `ksiz' specify the key, `vbuf' and `vsiz' specify the value, and `op' specifies
+   the opaque argument of the scan. The regions are valid only during the call.
+   The return value is nonzero to continue the scan, or 0 to stop it. */
+typedef int (*SSFTBLITER)(const void *kbuf, int ksiz, const void *vbuf, int vsiz, void *op);
+
+typedef struct {               /* cursor over the records of a reader */
+  SSFTBL *tbl;                 /* table of the cursor */
+  uint32_t pidx;               /* top-level entry of the current partition */
+  const SSFTBLIDXREC *recs;    /* records of the flat index or of the current partition */
+  uint32_t pnum;               /* number of records in `recs' */
+  uint32_t bnum;               /* number of blocks in `recs' */
+  uint32_t bidx;               /* index of the current block in `recs' */
+  void *pce;                   /* pinned cache entry of the current partition */
+  void *bce;                   /* pinned cache entry of the current block */
+  void *blkcur;                /* record cursor over the current block */
+  int valid;                   /* whether the cursor points at a record */
+} SSFTBLCUR;
+
 SSFTBL *ssftblnew(void);
 void ssftbldel(SSFTBL *tbl);
-int ssftbltune(SSFTBL *tbl, uint64_t blksiz, int cmethod);
-int ssftblsetcache(SSFTBL *tbl, uint32_t blkcnum);
+/* Set the tuning parameters of a writer.
+   `blksiz' specifies the size of a block before compression, or 0 for the default.
+   `cmethod' specifies the compression method, or 0 for the default.
+   `opts' specifies options by bitwise-or: `SSFTBLTPARTIDX' splits the index into partitions
+   of about a block each, which readers load through the block cache only when searched,
+   keeping only one entry per partition resident. `SSFTBLTBLKHASH' appends to each block a
+   table of about three bytes per key mapping key hashes to restart intervals, so that a get
+   reads one interval instead of searching the restart points, and a key missing from the
+   block is mostly rejected without reading a record.
+   Readers take the options from the table file. */
+int ssftbltune(SSFTBL *tbl, uint64_t blksiz, int cmethod, int opts);
+/* Set the block cache of a reader.
+   `capsiz' specifies the capacity in bytes of decompressed blocks to be cached.
+   `snum' specifies the number of lock-striped shards, or 0 for the default.
+   Blocks read by a reader opened with `SSFTBLODIRECT' are not kept in the page cache, so
+   this cache is the only one of the table and may be given the memory the page cache would
+   otherwise have spent on the file.
+   It takes effect on the next `ssftblopen'. A reader may be shared by any threads calling
+   `ssftblget', `ssftblgetref' and `ssftblrelease' concurrently. */
+int ssftblsetcache(SSFTBL *tbl, uint64_t capsiz, uint32_t snum);
+/* Set the compressed block cache of a reader.
+   `capsiz' specifies the capacity in bytes of compressed blocks to be cached, or 0 to disable
+   the cache, which is the default.
+   `snum' specifies the number of lock-striped shards, or 0 for the default.
+   Blocks are kept here as they are stored in the file, apart from the cache of decompressed
+   blocks, and a block missing from the latter is inflated from here without a read. A
+   compressed block takes a fraction of the memory of a decompressed one, so a table several
+   times larger than memory stays off the disk with a small decompressed cache in front of a
+   large compressed one. The cache is not used for mapped or uncompressed tables.
+   It takes effect on the next `ssftblopen'. */
+int ssftblsetccache(SSFTBL *tbl, uint64_t capsiz, uint32_t snum);
+/* Set block caches shared with other readers.
+   `cache' specifies the block cache object used instead of a private cache of decompressed
+   blocks, or `NULL' for a private one.
+   `ccache' specifies the block cache object used instead of a private cache of compressed
+   blocks, or `NULL' for a private one as set by `ssftblsetccache'.
+   The caches are created with `sscachenew' by the caller, which deletes them after every
+   table using them is closed. Their capacities bound the memory of all the tables together,
+   and blocks of all tables are evicted in one least-recently-used order. Keys combine an id
+   given to the table on open with the offset of the block, so the data file of a table using
+   a shared cache must be smaller than 1 TiB. Blocks of a table are removed from the caches
+   when it is closed.
+   It takes effect on the next `ssftblopen'. */
+int ssftblsetsharedcache(SSFTBL *tbl, SSCACHE *cache, SSCACHE *ccache);
+/* Set the compression workers of a writer.
+   `num' specifies the number of threads compressing sealed blocks, or 0 to compress each
+   block on the appending thread, which is the default.
+   Blocks are compressed in parallel while later ones are appended, and written in order as
+   they complete, so the file is the same as one written without workers. About twice as many
+   blocks as workers are held in memory.
+   It takes effect on the next `ssftblopen'. */
+int ssftblsetcworkers(SSFTBL *tbl, uint32_t num);
 
-int ssftblopen(SSFTBL *tbl, const char *path, enum SSFTBLOMODE omode);
+int ssftblopen(SSFTBL *tbl, const char *path, int omode);
 int ssftblclose(SSFTBL *tbl);
 
 int ssftblappend(SSFTBL *tbl, const void *kbuf, int ksiz, const void *vbuf, int vsiz);
 void *ssftblget(SSFTBL *tbl, const void *kbuf, int ksiz, int *sp);
 
+/* Retrieve a record without copying its value.
+   The returned region points into the cached (or mapped) block and stays valid until the
+   handle assigned to `*hp' is passed to `ssftblrelease'. */
+const void *ssftblgetref(SSFTBL *tbl, const void *kbuf, int ksiz, int *sp, void **hp);
+void ssftblrelease(SSFTBL *tbl, void *h);
+
+/* Create a cursor object of a reader.
+   `tbl' specifies the table object opened as a reader.
+   The return value is the new cursor object, which points at nothing until `ssftblcurfirst'
+   or `ssftblcurjump' is called. A cursor must not be shared by threads, and must be deleted
+   before the table is closed. */
+SSFTBLCUR *ssftblcurnew(SSFTBL *tbl);
+
+/* Delete a cursor object.
+   `cur' specifies the cursor object. */
+void ssftblcurdel(SSFTBLCUR *cur);
+
+/* Move a cursor object to the first record.
+   `cur' specifies the cursor object.
+   The return value is 0 for success, or -1 on failure or if there is no record. */
+int ssftblcurfirst(SSFTBLCUR *cur);
+
+/* Move a cursor object to the first record not less than a key.
+   `cur' specifies the cursor object.
+   `kbuf' specifies the pointer to the region of the key.
+   `ksiz' specifies the size of the region of the key.
+   The return value is 0 for success, or -1 on failure or if there is no such record. */
+int ssftblcurjump(SSFTBLCUR *cur, const void *kbuf, int ksiz);
+
+/* Move a cursor object to the next record.
+   `cur' specifies the cursor object.
+   The return value is 0 for success, or -1 on failure or at the end of the table, in which
+   case the error code is `SSENOREC'. */
+int ssftblcurnext(SSFTBLCUR *cur);
+
+/* Get the key of the record at a cursor object.
+   `cur' specifies the cursor object.
+   `sp' specifies the pointer to the variable into which the size of the key is assigned.
+   The return value is the key, or `NULL' if the cursor points at nothing. The region is
+   valid until the cursor moves, and must not be freed. */
+const void *ssftblcurkey(SSFTBLCUR *cur, int *sp);
+
+/* Get the value of the record at a cursor object.
+   `cur' specifies the cursor object.
+   `sp' specifies the pointer to the variable into which the size of the value is assigned.
+   The return value is the value, or `NULL' if the cursor points at nothing. The region is
+   valid until the cursor moves, and must not be freed. */
+const void *ssftblcurval(SSFTBLCUR *cur, int *sp);
+
+/* Scan the records of a reader in order.
+   `bkbuf' and `bksiz' specify the first key of the range, or `NULL' for the first record.
+   `ekbuf' and `eksiz' specify the key at which the range ends exclusively, or `NULL' for the
+   end of the table.
+   `iter' specifies the function called for each record on the calling thread.
+   `op' specifies the opaque argument passed to `iter'.
+   `depth' specifies the number of blocks a helper thread reads and decompresses ahead of
+   `iter', or 0 for the default.
+   `opts' specifies options by bitwise-or: `SSFTBLSNOCACHE' keeps blocks read by the scan out
+   of the block cache, so that a full scan does not evict the working set of gets.
+   The return value is 0 for success, including a scan stopped by `iter', or -1 on failure. */
+int ssftblscan(SSFTBL *tbl, const void *bkbuf, int bksiz, const void *ekbuf, int eksiz,
+               SSFTBLITER iter, void *op, int depth, int opts);
+
+/* Retrieve multiple records at once.
+   `recs' specifies the array of records whose `kbuf' and `ksiz' are set. `vbuf' and `vsiz'
+   of each are assigned the value, or `NULL' if the key is not found, and the value must be
+   released with `free'.
+   `num' specifies the number of records.
+   Keys are sorted and grouped by block so that each block is searched once, and blocks
+   missing from the cache and adjacent in the file are read with one `pread'. If the table
+   is opened with `SSFTBLOAIO', all missing blocks are read at once through the
+   asynchronous read object of the calling thread instead.
+   The return value is the number of records found, or -1 on failure. */
+int ssftblmultiget(SSFTBL *tbl, SSFTBLMGETREC *recs, int num);
+
 void *ssftblgetfirstkey(SSFTBL *tbl, int *sp);
 void *ssftblgetlastkey(SSFTBL *tbl, int *sp);
                      
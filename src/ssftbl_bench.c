@@ -0,0 +1,204 @@
+/* Multithreaded read benchmark of SSFTBL.
+   usage: ssftbl_bench [rnum] [maxthreads] [ops-per-thread] [cmethod] [opts]
+   A table of `rnum' records is built inline and then again with `maxthreads' compression
+   workers, and readers sharing one SSFTBL issue random
+   gets with 1, 2, 4, ... `maxthreads' threads. The speedup column is the throughput
+   relative to a single thread, which should stay close to the thread count as long as
+   there are idle cores. A full cursor scan and a full `ssftblscan' with read-ahead are
+   timed at the end, followed by the cost of verifying the checksum of a block against
+   that of decompressing it. */
+#include <ssftbl.h>
+#include <sscrc.h>
+#include <compress.h>
+
+#include <unistd.h>
+#include <time.h>
+
+#define BENCHPATH "./ssftblbench"
+#define BENCHVSIZ 100
+#define BENCHBLKSIZ (64 * 1024)
+#define BENCHBLKNUM 2000
+
+typedef struct {
+  SSFTBL *tbl;
+  uint32_t rnum;
+  uint32_t ops;
+  unsigned int seed;
+  uint32_t hits;
+} BENCHARG;
+
+static double benchnow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int benchkey(char *buf, uint32_t i) {
+  return sprintf(buf, "%012u", i);
+}
+
+static void *benchreader(void *p) {
+  BENCHARG *arg = p;
+  char kbuf[32];
+  uint32_t i;
+  for (i = 0; i < arg->ops; i++) {
+    int ksiz = benchkey(kbuf, rand_r(&arg->seed) % arg->rnum);
+    int vsiz;
+    void *h;
+    const void *vbuf = ssftblgetref(arg->tbl, kbuf, ksiz, &vsiz, &h);
+    if (vbuf) {
+      arg->hits++;
+      ssftblrelease(arg->tbl, h);
+    }
+  }
+  return NULL;
+}
+
+static int benchscaniter(const void *kbuf, int ksiz, const void *vbuf, int vsiz, void *op) {
+  uint64_t *sums = op;
+  (void)kbuf;
+  (void)vbuf;
+  sums[0]++;
+  sums[1] += ksiz + vsiz;
+  return 1;
+}
+
+static void benchchecksum(int cmethod) {
+  /* a block of records like those of the table, as it is stored */
+  char *blk = malloc(BENCHBLKSIZ);
+  int off = 0, ksiz, csiz = 0, dsiz = 0;
+  uint32_t i = 0, crc = 0;
+  char kbuf[32];
+  while (off + (int)sizeof(kbuf) + BENCHVSIZ < BENCHBLKSIZ) {
+    ksiz = benchkey(kbuf, i++);
+    memcpy(blk + off, kbuf, ksiz);
+    memset(blk + off + ksiz, 'v', BENCHVSIZ);
+    off += ksiz + BENCHVSIZ;
+  }
+  char *cblk = getcompressfunc(cmethod)(blk, off, &csiz);
+  decompressfunc dfunc = getdecompressfunc(cmethod);
+  double start = benchnow();
+  for (i = 0; i < BENCHBLKNUM; i++)
+    crc ^= sscrc32c(0, cblk, csiz);
+  double celapsed = benchnow() - start;
+  start = benchnow();
+  for (i = 0; i < BENCHBLKNUM; i++)
+    free(dfunc(cblk, csiz, &dsiz));
+  double delapsed = benchnow() - start;
+  printf("checksum (%s): %.2f us per %d-byte block, %.0f MB/sec, %.1f%% of decompression\n",
+         sscrc32chw() ? "sse4.2" : "slice-by-8", celapsed / BENCHBLKNUM * 1e6, csiz,
+         (double)csiz * BENCHBLKNUM / celapsed / (1024 * 1024), celapsed / delapsed * 100);
+  if (crc == 1) fprintf(stderr, "\n"); /* keeps the loop from being optimized out */
+  free(cblk);
+  free(blk);
+}
+
+static int benchbuild(uint32_t rnum, int cmethod, int opts, int cwnum) {
+  SSFTBL *tbl = ssftblnew();
+  char kbuf[32], vbuf[BENCHVSIZ];
+  uint32_t i;
+  uint64_t siz = 0;
+  ssftbltune(tbl, 0, cmethod, opts);
+  ssftblsetcworkers(tbl, cwnum);
+  double start = benchnow();
+  if (ssftblopen(tbl, BENCHPATH, SSFTBLOWRITER) != 0) {
+    fprintf(stderr, "open error: %d\n", tbl->ecode);
+    ssftbldel(tbl);
+    return -1;
+  }
+  for (i = 0; i < rnum; i++) {
+    int ksiz = benchkey(kbuf, i);
+    /* values compress about as well as text rather than being a single repeated byte */
+    uint32_t j;
+    for (j = 0; j < sizeof(vbuf); j++)
+      vbuf[j] = 'a' + (i * 7 + j * j) % 13;
+    siz += ksiz + sizeof(vbuf);
+    if (ssftblappend(tbl, kbuf, ksiz, vbuf, sizeof(vbuf)) != 0) {
+      fprintf(stderr, "append error: %d\n", tbl->ecode);
+      ssftbldel(tbl);
+      return -1;
+    }
+  }
+  int r = ssftblclose(tbl);
+  double elapsed = benchnow() - start;
+  if (r == 0) printf("build: %d workers, %.1f MB/sec\n", cwnum, siz / elapsed / (1024 * 1024));
+  ssftbldel(tbl);
+  return r;
+}
+
+int main(int argc, char **argv) {
+  uint32_t rnum = (argc > 1) ? atoi(argv[1]) : 1000000;
+  int maxthreads = (argc > 2) ? atoi(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t ops = (argc > 3) ? atoi(argv[3]) : 1000000;
+  int cmethod = (argc > 4) ? atoi(argv[4]) : SSCMZLIB;
+  int opts = (argc > 5) ? atoi(argv[5]) : 0;
+  if (rnum < 1 || maxthreads < 1 || ops < 1) {
+    fprintf(stderr, "usage: %s [rnum] [maxthreads] [ops-per-thread] [cmethod] [opts]\n", argv[0]);
+    return 1;
+  }
+  if (benchbuild(rnum, cmethod, opts, 0) != 0) return 1;
+  if (benchbuild(rnum, cmethod, opts, maxthreads) != 0) return 1;
+  SSFTBL *tbl = ssftblnew();
+  if (ssftblopen(tbl, BENCHPATH, SSFTBLOREADER) != 0) {
+    fprintf(stderr, "open error: %d\n", tbl->ecode);
+    return 1;
+  }
+  printf("records: %u, ops/thread: %u, cores: %ld\n", rnum, ops, sysconf(_SC_NPROCESSORS_ONLN));
+  printf("%8s %14s %8s\n", "threads", "ops/sec", "speedup");
+  double base = 0;
+  int tnum, i;
+  for (tnum = 1; tnum <= maxthreads; tnum *= 2) {
+    pthread_t *ths = malloc(sizeof(pthread_t) * tnum);
+    BENCHARG *args = malloc(sizeof(BENCHARG) * tnum);
+    double start = benchnow();
+    for (i = 0; i < tnum; i++) {
+      args[i].tbl = tbl;
+      args[i].rnum = rnum;
+      args[i].ops = ops;
+      args[i].seed = i + 1;
+      args[i].hits = 0;
+      pthread_create(ths + i, NULL, benchreader, args + i);
+    }
+    for (i = 0; i < tnum; i++)
+      pthread_join(ths[i], NULL);
+    double rate = (double)ops * tnum / (benchnow() - start);
+    if (tnum == 1) base = rate;
+    printf("%8d %14.0f %8.2f\n", tnum, rate, rate / base);
+    for (i = 0; i < tnum; i++) {
+      if (args[i].hits != ops) fprintf(stderr, "missing records: %u\n", ops - args[i].hits);
+    }
+    free(args);
+    free(ths);
+    if (tnum < maxthreads && tnum * 2 > maxthreads) tnum = maxthreads / 2;
+  }
+  SSFTBLCUR *cur = ssftblcurnew(tbl);
+  double start = benchnow();
+  uint64_t snum = 0, ssiz = 0;
+  if (ssftblcurfirst(cur) == 0) {
+    do {
+      int ksiz, vsiz;
+      ssftblcurkey(cur, &ksiz);
+      ssftblcurval(cur, &vsiz);
+      snum++;
+      ssiz += ksiz + vsiz;
+    } while (ssftblcurnext(cur) == 0);
+  }
+  double elapsed = benchnow() - start;
+  printf("scan: %llu records, %.0f records/sec, %.1f MB/sec\n", (unsigned long long)snum,
+         snum / elapsed, ssiz / elapsed / (1024 * 1024));
+  if (snum != rnum) fprintf(stderr, "missing records in scan: %llu\n",
+                            (unsigned long long)(rnum - snum));
+  ssftblcurdel(cur);
+  uint64_t sums[2] = {0, 0};
+  start = benchnow();
+  if (ssftblscan(tbl, NULL, 0, NULL, 0, benchscaniter, sums, 0, SSFTBLSNOCACHE) != 0)
+    fprintf(stderr, "scan error: %d\n", tbl->ecode);
+  elapsed = benchnow() - start;
+  printf("scan with read-ahead: %llu records, %.0f records/sec, %.1f MB/sec\n",
+         (unsigned long long)sums[0], sums[0] / elapsed, sums[1] / elapsed / (1024 * 1024));
+  ssftblclose(tbl);
+  ssftbldel(tbl);
+  unlink(BENCHPATH ".sstbl");
+  benchchecksum(cmethod);
+  return 0;
+}
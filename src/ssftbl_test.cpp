@@ -1,9 +1,12 @@
 #include <ssftbl.h>
+#include <sscache.h>
 
+#include <algorithm>
 #include <map>
 #include <vector>
 #include <string>
 #include <gtest/gtest.h>
+#include <sys/stat.h>
 
 using namespace std;
 
@@ -15,6 +18,31 @@ string get_random_str(int minlen, int maxlen) {
     s += 'a' + rand() % 26;
   return s;
 }
+
+string cur_key(SSFTBLCUR *cur) {
+  int ksiz;
+  const char *kbuf = (const char *)ssftblcurkey(cur, &ksiz);
+  return kbuf ? string(kbuf, ksiz) : string();
+}
+
+string cur_val(SSFTBLCUR *cur) {
+  int vsiz;
+  const char *vbuf = (const char *)ssftblcurval(cur, &vsiz);
+  return vbuf ? string(vbuf, vsiz) : string();
+}
+
+struct scan_result {
+  vector<pair<const string, string> > recs;
+  size_t limit;
+  scan_result() : limit(0) {}
+};
+
+int scan_collect(const void *kbuf, int ksiz, const void *vbuf, int vsiz, void *op) {
+  scan_result *res = (scan_result *)op;
+  res->recs.push_back(make_pair(string((const char *)kbuf, ksiz),
+                                string((const char *)vbuf, vsiz)));
+  return res->limit == 0 || res->recs.size() < res->limit;
+}
 }
 
 /*-----------------------------------------------------------------------------
@@ -110,6 +138,104 @@ TEST_F(SSFTBLWriterTestFixture, append_2_desc_order) {
   ASSERT_EQ(-1, r);
 }
 
+TEST_F(SSFTBLTestFixture, write_buffered) {
+  /* records both smaller and larger than the write buffer, over several flushes */
+  string dbname = "./ssftblbufferedtest";
+  string path = dbname + ".sstbl";
+  ASSERT_EQ(0, ssftblopen(ftbl, dbname.c_str(), SSFTBLOWRITER));
+  map<string, string> recs;
+  char kbuf[16];
+  for (int i = 0; i < 3000; i++) {
+    snprintf(kbuf, sizeof(kbuf), "key%06d", i);
+    string val = (i % 1000 == 500) ? get_random_str(2 << 20, (2 << 20) + 100)
+      : get_random_str(100, 2000);
+    recs[kbuf] = val;
+    ASSERT_EQ(0, ssftblappend(ftbl, kbuf, strlen(kbuf), val.data(), val.size()));
+  }
+  ASSERT_EQ(0, ssftblclose(ftbl));
+  ASSERT_EQ(0, ssftblopen(ftbl, dbname.c_str(), SSFTBLOREADER));
+  struct stat sbuf;
+  ASSERT_EQ(0, stat(path.c_str(), &sbuf));
+  ASSERT_EQ((uint64_t)sbuf.st_size, ftbl->idxoff + ftbl->idxsiz + 32);
+  for (map<string, string>::iterator it = recs.begin(); it != recs.end(); it++) {
+    int vsiz;
+    char *vbuf = (char *)ssftblget(ftbl, it->first.data(), it->first.size(), &vsiz);
+    ASSERT_TRUE(vbuf != NULL);
+    ASSERT_EQ(it->second, string(vbuf, vsiz));
+    free(vbuf);
+  }
+  ASSERT_EQ(0, ssftblclose(ftbl));
+  ASSERT_EQ(0, unlink(path.c_str()));
+}
+
+TEST_F(SSFTBLTestFixture, write_cworkers) {
+  /* blocks compressed by workers are written in order, giving the same file as inline */
+  string files[2];
+  map<string, string> recs;
+  char kbuf[16];
+  for (int i = 0; i < 20000; i++) {
+    snprintf(kbuf, sizeof(kbuf), "key%08d", i);
+    recs[kbuf] = get_random_str(10, 200);
+  }
+  for (int n = 0; n < 2; n++) {
+    string dbname = n ? "./ssftblcworkertest" : "./ssftblinlinetest";
+    ASSERT_EQ(0, ssftbltune(ftbl, 4096, SSFTBLCMETHOD, SSFTBLTBLKHASH));
+    ASSERT_EQ(0, ssftblsetcworkers(ftbl, n ? 4 : 0));
+    ASSERT_EQ(0, ssftblopen(ftbl, dbname.c_str(), SSFTBLOWRITER));
+    for (map<string, string>::iterator it = recs.begin(); it != recs.end(); it++)
+      ASSERT_EQ(0, ssftblappend(ftbl, it->first.data(), it->first.size(),
+                                it->second.data(), it->second.size()));
+    ASSERT_EQ(0, ssftblclose(ftbl));
+    FILE *fp = fopen((dbname + ".sstbl").c_str(), "rb");
+    ASSERT_TRUE(fp != NULL);
+    char buf[8192];
+    size_t siz;
+    while ((siz = fread(buf, 1, sizeof(buf), fp)) > 0)
+      files[n].append(buf, siz);
+    fclose(fp);
+  }
+  ASSERT_TRUE(files[0] == files[1]);
+  ASSERT_EQ(0, ssftblopen(ftbl, "./ssftblcworkertest", SSFTBLOREADER));
+  ASSERT_GT(ftbl->idxnum, 100U);
+  for (map<string, string>::iterator it = recs.begin(); it != recs.end(); it++) {
+    int vsiz;
+    char *vbuf = (char *)ssftblget(ftbl, it->first.data(), it->first.size(), &vsiz);
+    ASSERT_TRUE(vbuf != NULL);
+    ASSERT_EQ(it->second, string(vbuf, vsiz));
+    free(vbuf);
+  }
+  ASSERT_EQ(0, ssftblclose(ftbl));
+  ASSERT_EQ(0, unlink("./ssftblinlinetest.sstbl"));
+  ASSERT_EQ(0, unlink("./ssftblcworkertest.sstbl"));
+}
+
+TEST_F(SSFTBLTestFixture, write_empty) {
+  /* a table closed without records opens as an empty one, plainly and mapped */
+  string dbname = "./ssftblemptytest";
+  ASSERT_EQ(0, ssftblopen(ftbl, dbname.c_str(), SSFTBLOWRITER));
+  ASSERT_EQ(0, ssftblclose(ftbl));
+  for (int n = 0; n < 2; n++) {
+    ASSERT_EQ(0, ssftblopen(ftbl, dbname.c_str(), SSFTBLOREADER | (n ? SSFTBLOMMAP : 0)));
+    ASSERT_EQ(0U, ftbl->idxnum);
+    int vsiz;
+    ASSERT_TRUE(ssftblget(ftbl, "key", 3, &vsiz) == NULL);
+    SSFTBLMGETREC rec;
+    rec.kbuf = "key";
+    rec.ksiz = 3;
+    ASSERT_EQ(0, ssftblmultiget(ftbl, &rec, 1));
+    ASSERT_TRUE(rec.vbuf == NULL);
+    SSFTBLCUR *cur = ssftblcurnew(ftbl);
+    ASSERT_EQ(-1, ssftblcurfirst(cur));
+    ASSERT_EQ(-1, ssftblcurjump(cur, "key", 3));
+    ssftblcurdel(cur);
+    scan_result res;
+    ASSERT_EQ(0, ssftblscan(ftbl, NULL, 0, NULL, 0, scan_collect, &res, 0, 0));
+    ASSERT_EQ(0u, res.recs.size());
+    ASSERT_EQ(0, ssftblclose(ftbl));
+  }
+  ASSERT_EQ(0, unlink((dbname + ".sstbl").c_str()));
+}
+
 /*-----------------------------------------------------------------------------
  * SimpleReader
  */
@@ -122,7 +248,7 @@ protected:
     SSFTBLTestFixture::SetUp();
     int r;
     int cmode = SSFTBLCMETHOD;
-    r = ssftbltune(ftbl, 64 * 1024, cmode);
+    r = ssftbltune(ftbl, BlockSize(), cmode, TuneOpts());
     ASSERT_EQ(0, r);
 
     r = ssftblopen(ftbl, dbname.c_str(), SSFTBLOWRITER);
@@ -133,7 +259,8 @@ protected:
     r = ssftblclose(ftbl);
     ASSERT_EQ(0, r);
 
-    r = ssftblopen(ftbl, dbname.c_str(), SSFTBLOREADER);
+    SetCache(ftbl);
+    r = ssftblopen(ftbl, dbname.c_str(), OpenMode());
     ASSERT_EQ(0, r);
   }
   void TearDown() {
@@ -146,6 +273,10 @@ protected:
     SSFTBLTestFixture::TearDown();
   }
   virtual void Appends(SSFTBL *ftbl) = 0;
+  virtual int OpenMode() { return SSFTBLOREADER; }
+  virtual uint64_t BlockSize() { return 64 * 1024; }
+  virtual int TuneOpts() { return 0; }
+  virtual void SetCache(SSFTBL *ftbl) { (void)ftbl; }
   string dbname;
 };
 
@@ -246,6 +377,89 @@ TEST_F(SSFTBLRandomReaderTestFixture, get_many) {
   }
 }
 
+TEST_F(SSFTBLRandomReaderTestFixture, getref_many) {
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    int sp;
+    void *h;
+    const string &key = it->first;
+    const string &val = it->second;
+    const void *p = ssftblgetref(ftbl, key.c_str(), key.size(), &sp, &h);
+    ASSERT_TRUE(p != NULL);
+    ASSERT_EQ(val, string((const char*)p, sp));
+    ssftblrelease(ftbl, h);
+  }
+  int sp;
+  void *h;
+  string key = "not found key";
+  ASSERT_TRUE(ssftblgetref(ftbl, key.c_str(), key.size(), &sp, &h) == NULL);
+}
+
+TEST_F(SSFTBLRandomReaderTestFixture, getref_outlives_cache) {
+  ssftblsetcache(ftbl, 1, 1);
+  int r = ssftblclose(ftbl);
+  ASSERT_EQ(0, r);
+  r = ssftblopen(ftbl, dbname.c_str(), SSFTBLOREADER);
+  ASSERT_EQ(0, r);
+  vector<pair<const void *, void *> > refs;
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    int sp;
+    void *h;
+    const void *p = ssftblgetref(ftbl, it->first.c_str(), it->first.size(), &sp, &h);
+    ASSERT_TRUE(p != NULL);
+    refs.push_back(make_pair(p, h));
+  }
+  map<string, string>::const_iterator it = m.begin();
+  for (size_t i = 0; i < refs.size(); i++, ++it) {
+    ASSERT_EQ(0, memcmp(it->second.c_str(), refs[i].first, it->second.size()));
+    ssftblrelease(ftbl, refs[i].second);
+  }
+}
+
+TEST_F(SSFTBLRandomReaderTestFixture, footer) {
+  string path = dbname + ".sstbl";
+  struct stat sbuf;
+  ASSERT_EQ(0, stat(path.c_str(), &sbuf));
+  FILE *fp = fopen(path.c_str(), "rb");
+  ASSERT_TRUE(fp != NULL);
+  char foot[32];
+  ASSERT_EQ(0, fseek(fp, -32, SEEK_END));
+  ASSERT_EQ(1, fread(foot, sizeof(foot), 1, fp));
+  fclose(fp);
+  uint64_t idxoff, idxsiz;
+  uint32_t idxnum;
+  memcpy(&idxoff, foot, sizeof(idxoff));
+  memcpy(&idxsiz, foot + 8, sizeof(idxsiz));
+  memcpy(&idxnum, foot + 16, sizeof(idxnum));
+  ASSERT_EQ(0, memcmp(foot + 24, "SsFtBlIx", 8));
+  ASSERT_EQ(ftbl->idxoff, idxoff);
+  ASSERT_EQ(ftbl->idxnum, idxnum);
+  ASSERT_EQ(0, idxoff % 8);
+  ASSERT_EQ((uint64_t)sbuf.st_size, idxoff + idxsiz + 32);
+  ASSERT_TRUE(ftbl->idxsec != NULL);
+}
+
+TEST_F(SSFTBLRandomReaderTestFixture, broken_footer) {
+  string path = dbname + ".sstbl";
+  ASSERT_EQ(0, ssftblclose(ftbl));
+  FILE *fp = fopen(path.c_str(), "r+b");
+  ASSERT_TRUE(fp != NULL);
+  ASSERT_EQ(0, fseek(fp, -8, SEEK_END));
+  ASSERT_EQ(1, fwrite("XXXXXXXX", 8, 1, fp));
+  fclose(fp);
+  ASSERT_EQ(-1, ssftblopen(ftbl, dbname.c_str(), SSFTBLOREADER));
+  ASSERT_EQ(SSEMETA, ftbl->ecode);
+  ASSERT_EQ(0, ssftblclose(ftbl));
+  ASSERT_EQ(-1, ssftblopen(ftbl, dbname.c_str(), SSFTBLOREADER | SSFTBLOMMAP));
+  ASSERT_EQ(SSEMETA, ftbl->ecode);
+  ASSERT_EQ(0, ssftblclose(ftbl));
+  fp = fopen(path.c_str(), "r+b");
+  ASSERT_TRUE(fp != NULL);
+  ASSERT_EQ(0, fseek(fp, -8, SEEK_END));
+  ASSERT_EQ(1, fwrite("SsFtBlIx", 8, 1, fp));
+  fclose(fp);
+  ASSERT_EQ(0, ssftblopen(ftbl, dbname.c_str(), SSFTBLOREADER));
+}
+
 TEST_F(SSFTBLRandomReaderTestFixture, get_many_include_not_found) {
   for (unsigned int i = 0; i < 10240; i++) {
     int sp;
@@ -386,3 +600,956 @@ TEST_F(SSFTBLLargeBlockReaderTestFixture, get_many_include_not_found) {
     }
   }
 }
+
+/*-----------------------------------------------------------------------------
+ * SmallRecordReader
+ */
+class SSFTBLSmallRecordReaderTestFixture : public SSFTBLBaseReaderTestFixture {
+public:
+  virtual void Appends(SSFTBL *ftbl) {
+    int r;
+    char kbuf[32];
+    for (int i = 0; i < 20000; i += 2) {
+      int ksiz = sprintf(kbuf, "key%08d", i);
+      string val = get_random_str(1, 16);
+      m[string(kbuf, ksiz)] = val;
+      r = ssftblappend(ftbl, kbuf, ksiz, val.c_str(), val.size());
+      ASSERT_EQ(0, r);
+    }
+  }
+  map<string, string> m;
+};
+
+TEST_F(SSFTBLSmallRecordReaderTestFixture, get_many) {
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    int sp;
+    const string &key = it->first;
+    const string &val = it->second;
+    void *p = ssftblget(ftbl, key.c_str(), key.size(), &sp);
+    ASSERT_TRUE(p != NULL) << key;
+    ASSERT_EQ(val, string((const char*)p, sp));
+    free(p);
+  }
+}
+
+TEST_F(SSFTBLSmallRecordReaderTestFixture, get_not_found_between_keys) {
+  char kbuf[32];
+  for (int i = 1; i < 20000; i += 2) {
+    int sp;
+    int ksiz = sprintf(kbuf, "key%08d", i);
+    ASSERT_TRUE(ssftblget(ftbl, kbuf, ksiz, &sp) == NULL) << kbuf;
+    ksiz = sprintf(kbuf, "key%08da", i - 1);
+    ASSERT_TRUE(ssftblget(ftbl, kbuf, ksiz, &sp) == NULL) << kbuf;
+  }
+}
+
+TEST_F(SSFTBLSmallRecordReaderTestFixture, multiget) {
+  vector<string> keys;
+  char kbuf[32];
+  for (int i = 0; i < 3000; i++) {
+    int ksiz = sprintf(kbuf, "key%08d", rand() % 20100);
+    keys.push_back(string(kbuf, ksiz));
+  }
+  keys.push_back(keys[0]);
+  vector<SSFTBLMGETREC> recs(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    recs[i].kbuf = keys[i].c_str();
+    recs[i].ksiz = keys[i].size();
+  }
+  int fnum = ssftblmultiget(ftbl, &recs[0], recs.size());
+  int expnum = 0;
+  for (size_t i = 0; i < keys.size(); i++) {
+    map<string, string>::const_iterator it = m.find(keys[i]);
+    if (it == m.end()) {
+      ASSERT_TRUE(recs[i].vbuf == NULL) << keys[i];
+      continue;
+    }
+    expnum++;
+    ASSERT_TRUE(recs[i].vbuf != NULL) << keys[i];
+    ASSERT_EQ(it->second, string((const char *)recs[i].vbuf, recs[i].vsiz));
+    free(recs[i].vbuf);
+  }
+  ASSERT_EQ(expnum, fnum);
+  ASSERT_EQ(0, ssftblmultiget(ftbl, &recs[0], 0));
+}
+
+TEST_F(SSFTBLSmallRecordReaderTestFixture, cursor) {
+  SSFTBLCUR *cur = ssftblcurnew(ftbl);
+  ASSERT_TRUE(cur != NULL);
+  int ksiz, vsiz;
+  ASSERT_TRUE(ssftblcurkey(cur, &ksiz) == NULL);
+  ASSERT_EQ(0, ssftblcurfirst(cur));
+  map<string, string>::const_iterator it = m.begin();
+  do {
+    ASSERT_TRUE(it != m.end());
+    const char *kbuf = (const char *)ssftblcurkey(cur, &ksiz);
+    const char *vbuf = (const char *)ssftblcurval(cur, &vsiz);
+    ASSERT_EQ(it->first, string(kbuf, ksiz));
+    ASSERT_EQ(it->second, string(vbuf, vsiz));
+    ++it;
+  } while (ssftblcurnext(cur) == 0);
+  ASSERT_EQ(SSENOREC, ftbl->ecode);
+  ASSERT_TRUE(it == m.end());
+  ASSERT_EQ(-1, ssftblcurnext(cur));
+  /* jump to existing keys, keys between records and out of range */
+  ASSERT_EQ(0, ssftblcurjump(cur, "key00001000", 11));
+  ASSERT_EQ("key00001000", cur_key(cur));
+  ASSERT_EQ(0, ssftblcurjump(cur, "key00001001", 11));
+  ASSERT_EQ("key00001002", cur_key(cur));
+  ASSERT_EQ(0, ssftblcurnext(cur));
+  ASSERT_EQ("key00001004", cur_key(cur));
+  ASSERT_EQ(0, ssftblcurjump(cur, "a", 1));
+  ASSERT_EQ(m.begin()->first, cur_key(cur));
+  ASSERT_EQ(0, ssftblcurjump(cur, m.rbegin()->first.c_str(), m.rbegin()->first.size()));
+  ASSERT_EQ(m.rbegin()->first, cur_key(cur));
+  ASSERT_EQ(-1, ssftblcurjump(cur, "z", 1));
+  ssftblcurdel(cur);
+}
+
+TEST_F(SSFTBLSmallRecordReaderTestFixture, cursor_jump_every_key) {
+  SSFTBLCUR *cur = ssftblcurnew(ftbl);
+  char kbuf[32];
+  for (int i = 0; i < 19999; i++) {
+    int n = sprintf(kbuf, "key%08d", i);
+    ASSERT_EQ(0, ssftblcurjump(cur, kbuf, n)) << kbuf;
+    n = sprintf(kbuf, "key%08d", i + i % 2);
+    ASSERT_EQ(string(kbuf, n), cur_key(cur));
+  }
+  ssftblcurdel(cur);
+}
+
+TEST_F(SSFTBLSmallRecordReaderTestFixture, bloom_filter) {
+  ASSERT_TRUE(ftbl->bf != NULL);
+  ASSERT_TRUE(ftbl->bfsiz >= m.size());
+  uint64_t nbits = ftbl->bfsiz * 8;
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it)
+    ASSERT_EQ(1, ssbftestbits(ftbl->bf, nbits, ftbl->bfnhash,
+                              ssbfhash(it->first.c_str(), it->first.size())));
+  char kbuf[32];
+  int fpnum = 0;
+  for (int i = 1; i < 20000; i += 2) {
+    int ksiz = sprintf(kbuf, "key%08d", i);
+    fpnum += ssbftestbits(ftbl->bf, nbits, ftbl->bfnhash, ssbfhash(kbuf, ksiz));
+  }
+  ASSERT_LT(fpnum, 10000 * 3 / 100);
+}
+
+TEST_F(SSFTBLSmallRecordReaderTestFixture, scan) {
+  scan_result res;
+  ASSERT_EQ(0, ssftblscan(ftbl, NULL, 0, NULL, 0, scan_collect, &res, 0, 0));
+  ASSERT_EQ(m.size(), res.recs.size());
+  ASSERT_TRUE(equal(m.begin(), m.end(), res.recs.begin()));
+  /* ranges are half open and need not start or end at existing keys */
+  res.recs.clear();
+  ASSERT_EQ(0, ssftblscan(ftbl, "key00001000", 11, "key00002000", 11, scan_collect, &res, 1, 0));
+  ASSERT_EQ(500u, res.recs.size());
+  ASSERT_EQ("key00001000", res.recs.front().first);
+  ASSERT_EQ("key00001998", res.recs.back().first);
+  res.recs.clear();
+  ASSERT_EQ(0, ssftblscan(ftbl, "key00001001", 11, "key00001009", 11, scan_collect, &res, 0, 0));
+  ASSERT_EQ(4u, res.recs.size());
+  ASSERT_EQ("key00001002", res.recs.front().first);
+  res.recs.clear();
+  ASSERT_EQ(0, ssftblscan(ftbl, "z", 1, NULL, 0, scan_collect, &res, 0, 0));
+  ASSERT_EQ(0u, res.recs.size());
+  ASSERT_EQ(0, ssftblscan(ftbl, NULL, 0, "a", 1, scan_collect, &res, 0, 0));
+  ASSERT_EQ(0u, res.recs.size());
+}
+
+TEST_F(SSFTBLSmallRecordReaderTestFixture, scan_stop) {
+  scan_result res;
+  res.limit = 10;
+  ASSERT_EQ(0, ssftblscan(ftbl, NULL, 0, NULL, 0, scan_collect, &res, 2, 0));
+  ASSERT_EQ(10u, res.recs.size());
+  ASSERT_EQ(m.begin()->first, res.recs.front().first);
+}
+
+TEST_F(SSFTBLSmallRecordReaderTestFixture, scan_nocache) {
+  scan_result res;
+  ASSERT_EQ(0, ssftblscan(ftbl, NULL, 0, NULL, 0, scan_collect, &res, 0, SSFTBLSNOCACHE));
+  ASSERT_EQ(m.size(), res.recs.size());
+  ASSERT_EQ(0u, sscachernum((SSCACHE *)ftbl->blkc));
+  res.recs.clear();
+  ASSERT_EQ(0, ssftblscan(ftbl, NULL, 0, NULL, 0, scan_collect, &res, 0, 0));
+  ASSERT_EQ(m.size(), res.recs.size());
+  ASSERT_TRUE(sscachernum((SSCACHE *)ftbl->blkc) > 0);
+}
+
+/*-----------------------------------------------------------------------------
+ * AioReader
+ */
+class SSFTBLAioReaderTestFixture : public SSFTBLSmallRecordReaderTestFixture {
+public:
+  virtual int OpenMode() { return SSFTBLOREADER | SSFTBLOAIO; }
+  virtual uint64_t BlockSize() { return 1024; }
+};
+
+TEST_F(SSFTBLAioReaderTestFixture, multiget) {
+  vector<string> keys;
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    if (rand() % 3 == 0) keys.push_back(it->first);
+  }
+  keys.push_back("key00000001");
+  random_shuffle(keys.begin(), keys.end());
+  vector<SSFTBLMGETREC> recs(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    recs[i].kbuf = keys[i].c_str();
+    recs[i].ksiz = keys[i].size();
+  }
+  ASSERT_EQ((int)keys.size() - 1, ssftblmultiget(ftbl, &recs[0], recs.size()));
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (keys[i] == "key00000001") {
+      ASSERT_TRUE(recs[i].vbuf == NULL);
+      continue;
+    }
+    ASSERT_EQ(m[keys[i]], string((const char *)recs[i].vbuf, recs[i].vsiz));
+    free(recs[i].vbuf);
+  }
+  /* the second round is served from the cache */
+  uint64_t rnum = sscachernum((SSCACHE *)ftbl->blkc);
+  ASSERT_TRUE(rnum > 0);
+  ASSERT_EQ((int)keys.size() - 1, ssftblmultiget(ftbl, &recs[0], recs.size()));
+  for (size_t i = 0; i < keys.size(); i++)
+    free(recs[i].vbuf);
+  ASSERT_EQ(rnum, sscachernum((SSCACHE *)ftbl->blkc));
+}
+
+/*-----------------------------------------------------------------------------
+ * DirectReader
+ */
+class SSFTBLDirectReaderTestFixture : public SSFTBLSmallRecordReaderTestFixture {
+public:
+  virtual int OpenMode() { return SSFTBLOREADER | SSFTBLODIRECT; }
+  virtual uint64_t BlockSize() { return 1024; }
+};
+
+TEST_F(SSFTBLDirectReaderTestFixture, open_close) {
+  ASSERT_TRUE(ftbl->bfd >= 0);
+  ASSERT_NE(ftbl->dfd, ftbl->bfd);
+}
+
+TEST_F(SSFTBLDirectReaderTestFixture, get_many) {
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    int sp;
+    const string &key = it->first;
+    void *p = ssftblget(ftbl, key.c_str(), key.size(), &sp);
+    ASSERT_TRUE(p != NULL) << key;
+    ASSERT_EQ(it->second, string((const char*)p, sp));
+    free(p);
+  }
+}
+
+TEST_F(SSFTBLDirectReaderTestFixture, multiget) {
+  vector<string> keys;
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it)
+    keys.push_back(it->first);
+  vector<SSFTBLMGETREC> recs(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    recs[i].kbuf = keys[i].c_str();
+    recs[i].ksiz = keys[i].size();
+  }
+  ASSERT_EQ((int)m.size(), ssftblmultiget(ftbl, &recs[0], recs.size()));
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_EQ(m[keys[i]], string((const char *)recs[i].vbuf, recs[i].vsiz));
+    free(recs[i].vbuf);
+  }
+}
+
+TEST_F(SSFTBLDirectReaderTestFixture, scan) {
+  scan_result res;
+  ASSERT_EQ(0, ssftblscan(ftbl, NULL, 0, NULL, 0, scan_collect, &res, 0, SSFTBLSNOCACHE));
+  ASSERT_EQ(m.size(), res.recs.size());
+  ASSERT_TRUE(equal(m.begin(), m.end(), res.recs.begin()));
+}
+
+/*-----------------------------------------------------------------------------
+ * TwoTierCacheReader
+ */
+class SSFTBLTwoTierCacheReaderTestFixture : public SSFTBLSmallRecordReaderTestFixture {
+public:
+  virtual uint64_t BlockSize() { return 1024; }
+  virtual void SetCache(SSFTBL *ftbl) {
+    /* the decompressed tier keeps a single block, the compressed one keeps all */
+    ssftblsetcache(ftbl, 1, 1);
+    ssftblsetccache(ftbl, 16 * 1024 * 1024, 0);
+  }
+  /* the compressed tier must serve everything once the file cannot be read */
+  void ReadAll(bool nofile) {
+    int bfd = ftbl->bfd;
+    if (nofile) ftbl->bfd = -1;
+    for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+      int sp;
+      void *p = ssftblget(ftbl, it->first.c_str(), it->first.size(), &sp);
+      ASSERT_TRUE(p != NULL) << it->first;
+      ASSERT_EQ(it->second, string((const char*)p, sp));
+      free(p);
+    }
+    ftbl->bfd = bfd;
+  }
+};
+
+TEST_F(SSFTBLTwoTierCacheReaderTestFixture, get_many) {
+  if (ftbl->cmethod == SSCMNONE) {
+    ASSERT_TRUE(ftbl->cblkc == NULL);
+    return;
+  }
+  ASSERT_TRUE(ftbl->cblkc != NULL);
+  ReadAll(false);
+  ASSERT_EQ(ftbl->idxnum - 1, sscachernum((SSCACHE *)ftbl->cblkc));
+  ASSERT_EQ(1u, sscachernum((SSCACHE *)ftbl->blkc));
+  ReadAll(true);
+}
+
+TEST_F(SSFTBLTwoTierCacheReaderTestFixture, multiget) {
+  if (ftbl->cmethod == SSCMNONE) return;
+  vector<string> keys;
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it)
+    keys.push_back(it->first);
+  vector<SSFTBLMGETREC> recs(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    recs[i].kbuf = keys[i].c_str();
+    recs[i].ksiz = keys[i].size();
+  }
+  ASSERT_EQ((int)m.size(), ssftblmultiget(ftbl, &recs[0], recs.size()));
+  for (size_t i = 0; i < keys.size(); i++)
+    free(recs[i].vbuf);
+  ASSERT_EQ(ftbl->idxnum - 1, sscachernum((SSCACHE *)ftbl->cblkc));
+  int bfd = ftbl->bfd;
+  ftbl->bfd = -1;
+  ASSERT_EQ((int)m.size(), ssftblmultiget(ftbl, &recs[0], recs.size()));
+  ftbl->bfd = bfd;
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_EQ(m[keys[i]], string((const char *)recs[i].vbuf, recs[i].vsiz));
+    free(recs[i].vbuf);
+  }
+}
+
+TEST_F(SSFTBLTwoTierCacheReaderTestFixture, scan_nocache) {
+  scan_result res;
+  ASSERT_EQ(0, ssftblscan(ftbl, NULL, 0, NULL, 0, scan_collect, &res, 0, SSFTBLSNOCACHE));
+  ASSERT_EQ(m.size(), res.recs.size());
+  if (ftbl->cblkc) {
+    ASSERT_EQ(0u, sscachernum((SSCACHE *)ftbl->cblkc));
+  }
+}
+
+/*-----------------------------------------------------------------------------
+ * SharedCacheReader
+ */
+class SSFTBLSharedCacheReaderTestFixture : public SSFTBLSmallRecordReaderTestFixture {
+public:
+  virtual uint64_t BlockSize() { return 1024; }
+  virtual void SetCache(SSFTBL *ftbl) {
+    cache = sscachenew(64 * 1024 * 1024, 0);
+    ccache = sscachenew(64 * 1024 * 1024, 0);
+    ASSERT_EQ(0, ssftblsetsharedcache(ftbl, cache, ccache));
+  }
+  void TearDown() {
+    SSFTBLSmallRecordReaderTestFixture::TearDown();
+    ASSERT_EQ(0u, sscachernum(cache));
+    sscachedel(cache);
+    sscachedel(ccache);
+  }
+  SSCACHE *cache;
+  SSCACHE *ccache;
+};
+
+TEST_F(SSFTBLSharedCacheReaderTestFixture, two_tables) {
+  ASSERT_TRUE(ftbl->blkc == cache);
+  ASSERT_TRUE(ftbl->cid > 0);
+  /* another table whose blocks sit at the same offsets with other records */
+  SSFTBL *other = ssftblnew();
+  ASSERT_EQ(0, ssftbltune(other, BlockSize(), SSFTBLCMETHOD, 0));
+  ASSERT_EQ(0, ssftblopen(other, "./ssftblsharedtest", SSFTBLOWRITER));
+  map<string, string> om;
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    string val = it->second + "o";
+    om[it->first] = val;
+    ASSERT_EQ(0, ssftblappend(other, it->first.c_str(), it->first.size(),
+                              val.c_str(), val.size()));
+  }
+  ASSERT_EQ(0, ssftblclose(other));
+  ASSERT_EQ(0, ssftblsetsharedcache(other, cache, ccache));
+  ASSERT_EQ(0, ssftblopen(other, "./ssftblsharedtest", SSFTBLOREADER));
+  ASSERT_NE(ftbl->cid, other->cid);
+  for (int round = 0; round < 2; round++) {
+    for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+      int sp;
+      char *p = (char *)ssftblget(ftbl, it->first.c_str(), it->first.size(), &sp);
+      ASSERT_TRUE(p != NULL);
+      ASSERT_EQ(it->second, string(p, sp));
+      free(p);
+      p = (char *)ssftblget(other, it->first.c_str(), it->first.size(), &sp);
+      ASSERT_TRUE(p != NULL);
+      ASSERT_EQ(om[it->first], string(p, sp));
+      free(p);
+    }
+  }
+  ASSERT_EQ((uint64_t)(ftbl->idxnum - 1) + (other->idxnum - 1), sscachernum(cache));
+  ASSERT_EQ(0, ssftblclose(other));
+  ASSERT_EQ((uint64_t)(ftbl->idxnum - 1), sscachernum(cache));
+  ssftbldel(other);
+  unlink("./ssftblsharedtest.sstbl");
+}
+
+/*-----------------------------------------------------------------------------
+ * PartitionedIndexReader
+ */
+class SSFTBLPartIdxReaderTestFixture : public SSFTBLSmallRecordReaderTestFixture {
+public:
+  virtual uint64_t BlockSize() { return 512; }
+  virtual int TuneOpts() { return SSFTBLTPARTIDX; }
+};
+
+TEST_F(SSFTBLPartIdxReaderTestFixture, open_close) {
+  ASSERT_TRUE(ftbl->opts & SSFTBLTPARTIDX);
+  /* only the top level is resident */
+  ASSERT_TRUE(ftbl->idxnum > 2);
+  ASSERT_TRUE(ftbl->idxnum < m.size() / 100);
+  ASSERT_EQ(0, sscachernum((SSCACHE *)ftbl->blkc));
+}
+
+TEST_F(SSFTBLPartIdxReaderTestFixture, get_many) {
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    int sp;
+    const string &key = it->first;
+    const string &val = it->second;
+    void *p = ssftblget(ftbl, key.c_str(), key.size(), &sp);
+    ASSERT_TRUE(p != NULL) << key;
+    ASSERT_EQ(val, string((const char*)p, sp));
+    free(p);
+  }
+}
+
+TEST_F(SSFTBLPartIdxReaderTestFixture, get_not_found) {
+  char kbuf[32];
+  int sp;
+  for (int i = -1; i < 20002; i += 2) {
+    int ksiz = sprintf(kbuf, "key%08d", i);
+    ASSERT_TRUE(ssftblget(ftbl, kbuf, ksiz, &sp) == NULL) << kbuf;
+  }
+  ASSERT_TRUE(ssftblget(ftbl, "a", 1, &sp) == NULL);
+  ASSERT_TRUE(ssftblget(ftbl, "z", 1, &sp) == NULL);
+}
+
+TEST_F(SSFTBLPartIdxReaderTestFixture, first_last_key) {
+  int sp;
+  char *p = (char *)ssftblgetfirstkey(ftbl, &sp);
+  ASSERT_EQ(m.begin()->first, string(p, sp));
+  free(p);
+  p = (char *)ssftblgetlastkey(ftbl, &sp);
+  ASSERT_EQ(m.rbegin()->first, string(p, sp));
+  free(p);
+}
+
+TEST_F(SSFTBLPartIdxReaderTestFixture, multiget) {
+  vector<string> keys;
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    keys.push_back(it->first);
+    keys.push_back(it->first + "x");
+  }
+  vector<SSFTBLMGETREC> recs(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    recs[i].kbuf = keys[i].c_str();
+    recs[i].ksiz = keys[i].size();
+  }
+  ASSERT_EQ((int)m.size(), ssftblmultiget(ftbl, &recs[0], recs.size()));
+  for (size_t i = 0; i < keys.size(); i += 2) {
+    ASSERT_EQ(m[keys[i]], string((const char *)recs[i].vbuf, recs[i].vsiz));
+    ASSERT_TRUE(recs[i+1].vbuf == NULL);
+    free(recs[i].vbuf);
+  }
+}
+
+TEST_F(SSFTBLPartIdxReaderTestFixture, multiget_broken_partition) {
+  /* a partition which cannot be read fails the call instead of passing for a miss */
+  uint64_t doff = ftbl->idxrecs[0].doff;
+  ASSERT_EQ(0, ssftblclose(ftbl));
+  FILE *fp = fopen((dbname + ".sstbl").c_str(), "r+b");
+  ASSERT_TRUE(fp != NULL);
+  uint32_t num = 0;
+  ASSERT_EQ(0, fseek(fp, doff, SEEK_SET));
+  ASSERT_EQ(1u, fwrite(&num, sizeof(num), 1, fp));
+  fclose(fp);
+  ASSERT_EQ(0, ssftblopen(ftbl, dbname.c_str(), OpenMode()));
+  vector<SSFTBLMGETREC> recs(2);
+  recs[0].kbuf = m.begin()->first.c_str();
+  recs[0].ksiz = m.begin()->first.size();
+  recs[1].kbuf = m.rbegin()->first.c_str();
+  recs[1].ksiz = m.rbegin()->first.size();
+  ASSERT_EQ(-1, ssftblmultiget(ftbl, &recs[0], recs.size()));
+  ASSERT_EQ(SSERHEAD, ftbl->ecode);
+  ASSERT_TRUE(recs[0].vbuf == NULL);
+  free(recs[1].vbuf);
+  ASSERT_EQ(1, ssftblmultiget(ftbl, &recs[1], 1));
+  ASSERT_EQ(m.rbegin()->second, string((const char *)recs[1].vbuf, recs[1].vsiz));
+  free(recs[1].vbuf);
+}
+
+TEST_F(SSFTBLPartIdxReaderTestFixture, cursor) {
+  SSFTBLCUR *cur = ssftblcurnew(ftbl);
+  int ksiz, vsiz;
+  ASSERT_EQ(0, ssftblcurfirst(cur));
+  map<string, string>::const_iterator it = m.begin();
+  do {
+    ASSERT_TRUE(it != m.end());
+    const char *kbuf = (const char *)ssftblcurkey(cur, &ksiz);
+    const char *vbuf = (const char *)ssftblcurval(cur, &vsiz);
+    ASSERT_EQ(it->first, string(kbuf, ksiz));
+    ASSERT_EQ(it->second, string(vbuf, vsiz));
+    ++it;
+  } while (ssftblcurnext(cur) == 0);
+  ASSERT_TRUE(it == m.end());
+  char kbuf[32];
+  for (int i = 0; i < 19999; i += 7) {
+    int n = sprintf(kbuf, "key%08d", i);
+    ASSERT_EQ(0, ssftblcurjump(cur, kbuf, n)) << kbuf;
+    n = sprintf(kbuf, "key%08d", i + i % 2);
+    ASSERT_EQ(string(kbuf, n), cur_key(cur));
+  }
+  ASSERT_EQ(0, ssftblcurjump(cur, m.rbegin()->first.c_str(), m.rbegin()->first.size()));
+  ASSERT_EQ(-1, ssftblcurnext(cur));
+  ssftblcurdel(cur);
+}
+
+TEST_F(SSFTBLPartIdxReaderTestFixture, scan) {
+  scan_result res;
+  ASSERT_EQ(0, ssftblscan(ftbl, NULL, 0, NULL, 0, scan_collect, &res, 3, SSFTBLSNOCACHE));
+  ASSERT_EQ(m.size(), res.recs.size());
+  ASSERT_TRUE(equal(m.begin(), m.end(), res.recs.begin()));
+  char bkbuf[32], ekbuf[32];
+  for (int i = 0; i < 20000; i += 997) {
+    int bksiz = sprintf(bkbuf, "key%08d", i);
+    int eksiz = sprintf(ekbuf, "key%08d", i + 301);
+    res.recs.clear();
+    ASSERT_EQ(0, ssftblscan(ftbl, bkbuf, bksiz, ekbuf, eksiz, scan_collect, &res, 0, 0));
+    map<string, string>::const_iterator it = m.lower_bound(string(bkbuf, bksiz));
+    map<string, string>::const_iterator end = m.lower_bound(string(ekbuf, eksiz));
+    ASSERT_EQ((size_t)distance(it, end), res.recs.size()) << bkbuf;
+    ASSERT_TRUE(equal(it, end, res.recs.begin()));
+  }
+}
+
+class SSFTBLPartIdxMmapReaderTestFixture : public SSFTBLPartIdxReaderTestFixture {
+public:
+  virtual int OpenMode() { return SSFTBLOREADER | SSFTBLOMMAP; }
+};
+
+class SSFTBLPartIdxDirectAioReaderTestFixture : public SSFTBLPartIdxReaderTestFixture {
+public:
+  virtual int OpenMode() { return SSFTBLOREADER | SSFTBLODIRECT | SSFTBLOAIO; }
+};
+
+TEST_F(SSFTBLPartIdxDirectAioReaderTestFixture, multiget) {
+  vector<string> keys;
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it)
+    keys.push_back(it->first);
+  random_shuffle(keys.begin(), keys.end());
+  vector<SSFTBLMGETREC> recs(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    recs[i].kbuf = keys[i].c_str();
+    recs[i].ksiz = keys[i].size();
+  }
+  ASSERT_EQ((int)m.size(), ssftblmultiget(ftbl, &recs[0], recs.size()));
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_EQ(m[keys[i]], string((const char *)recs[i].vbuf, recs[i].vsiz));
+    free(recs[i].vbuf);
+  }
+}
+
+TEST_F(SSFTBLPartIdxMmapReaderTestFixture, get_many) {
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    int sp;
+    const string &key = it->first;
+    void *p = ssftblget(ftbl, key.c_str(), key.size(), &sp);
+    ASSERT_TRUE(p != NULL) << key;
+    ASSERT_EQ(it->second, string((const char*)p, sp));
+    free(p);
+  }
+}
+
+/*-----------------------------------------------------------------------------
+ * BlockHashReader
+ */
+class SSFTBLBlkHashReaderTestFixture : public SSFTBLSmallRecordReaderTestFixture {
+public:
+  virtual uint64_t BlockSize() { return 4096; }
+  virtual int TuneOpts() { return SSFTBLTBLKHASH; }
+};
+
+TEST_F(SSFTBLBlkHashReaderTestFixture, get_many) {
+  ASSERT_TRUE(ftbl->opts & SSFTBLTBLKHASH);
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    int sp;
+    const string &key = it->first;
+    void *p = ssftblget(ftbl, key.c_str(), key.size(), &sp);
+    ASSERT_TRUE(p != NULL) << key;
+    ASSERT_EQ(it->second, string((const char*)p, sp));
+    free(p);
+  }
+}
+
+TEST_F(SSFTBLBlkHashReaderTestFixture, get_not_found_between_keys) {
+  char kbuf[32];
+  for (int i = 1; i < 20000; i += 2) {
+    int sp;
+    int ksiz = sprintf(kbuf, "key%08d", i);
+    ASSERT_TRUE(ssftblget(ftbl, kbuf, ksiz, &sp) == NULL) << kbuf;
+    ksiz = sprintf(kbuf, "key%08da", i - 1);
+    ASSERT_TRUE(ssftblget(ftbl, kbuf, ksiz, &sp) == NULL) << kbuf;
+  }
+}
+
+TEST_F(SSFTBLBlkHashReaderTestFixture, multiget) {
+  vector<string> keys;
+  char kbuf[32];
+  for (int i = 0; i < 3000; i++) {
+    int ksiz = sprintf(kbuf, "key%08d", rand() % 20100);
+    keys.push_back(string(kbuf, ksiz));
+  }
+  vector<SSFTBLMGETREC> recs(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    recs[i].kbuf = keys[i].c_str();
+    recs[i].ksiz = keys[i].size();
+  }
+  int fnum = ssftblmultiget(ftbl, &recs[0], recs.size());
+  int expnum = 0;
+  for (size_t i = 0; i < keys.size(); i++) {
+    map<string, string>::const_iterator it = m.find(keys[i]);
+    if (it == m.end()) {
+      ASSERT_TRUE(recs[i].vbuf == NULL) << keys[i];
+      continue;
+    }
+    expnum++;
+    ASSERT_EQ(it->second, string((const char *)recs[i].vbuf, recs[i].vsiz));
+    free(recs[i].vbuf);
+  }
+  ASSERT_EQ(expnum, fnum);
+}
+
+TEST_F(SSFTBLBlkHashReaderTestFixture, scan) {
+  /* range reads skip the block hash */
+  scan_result res;
+  ASSERT_EQ(0, ssftblscan(ftbl, NULL, 0, NULL, 0, scan_collect, &res, 0, 0));
+  ASSERT_EQ(m.size(), res.recs.size());
+  ASSERT_TRUE(equal(m.begin(), m.end(), res.recs.begin()));
+  SSFTBLCUR *cur = ssftblcurnew(ftbl);
+  char kbuf[32];
+  for (int i = 0; i < 19999; i += 7) {
+    int n = sprintf(kbuf, "key%08d", i);
+    ASSERT_EQ(0, ssftblcurjump(cur, kbuf, n)) << kbuf;
+    n = sprintf(kbuf, "key%08d", i + i % 2);
+    ASSERT_EQ(string(kbuf, n), cur_key(cur));
+  }
+  ssftblcurdel(cur);
+}
+
+TEST_F(SSFTBLBlkHashReaderTestFixture, unknown_option) {
+  string path = dbname + ".sstbl";
+  ASSERT_EQ(0, ssftblclose(ftbl));
+  FILE *fp = fopen(path.c_str(), "r+b");
+  ASSERT_TRUE(fp != NULL);
+  int opts = SSFTBLTBLKHASH | (1 << 30);
+  ASSERT_EQ(0, fseek(fp, 60, SEEK_SET));
+  ASSERT_EQ(1, fwrite(&opts, sizeof(opts), 1, fp));
+  fclose(fp);
+  ASSERT_EQ(-1, ssftblopen(ftbl, dbname.c_str(), SSFTBLOREADER));
+  ASSERT_EQ(SSEMETA, ftbl->ecode);
+}
+
+class SSFTBLPartIdxBlkHashReaderTestFixture : public SSFTBLPartIdxReaderTestFixture {
+public:
+  virtual int TuneOpts() { return SSFTBLTPARTIDX | SSFTBLTBLKHASH; }
+};
+
+TEST_F(SSFTBLPartIdxBlkHashReaderTestFixture, get_many) {
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    int sp;
+    const string &key = it->first;
+    void *p = ssftblget(ftbl, key.c_str(), key.size(), &sp);
+    ASSERT_TRUE(p != NULL) << key;
+    ASSERT_EQ(it->second, string((const char*)p, sp));
+    free(p);
+  }
+  char kbuf[32];
+  for (int i = 1; i < 20000; i += 2) {
+    int sp;
+    int ksiz = sprintf(kbuf, "key%08d", i);
+    ASSERT_TRUE(ssftblget(ftbl, kbuf, ksiz, &sp) == NULL) << kbuf;
+  }
+}
+
+/*-----------------------------------------------------------------------------
+ * ChecksumReader
+ */
+class SSFTBLChecksumReaderTestFixture : public SSFTBLSmallRecordReaderTestFixture {
+public:
+  virtual uint64_t BlockSize() { return 4096; }
+};
+
+TEST_F(SSFTBLChecksumReaderTestFixture, broken_block) {
+  /* a flipped byte in the second block fails its reads cleanly and leaves the others */
+  ASSERT_TRUE(ftbl->idxnum > 3);
+  uint64_t doff = ftbl->idxrecs[1].doff;
+  uint32_t blksiz = ftbl->idxrecs[1].blksiz;
+  ASSERT_EQ(0, ssftblclose(ftbl));
+  FILE *fp = fopen((dbname + ".sstbl").c_str(), "r+b");
+  ASSERT_TRUE(fp != NULL);
+  ASSERT_EQ(0, fseek(fp, doff + blksiz / 2, SEEK_SET));
+  int c = fgetc(fp);
+  ASSERT_EQ(0, fseek(fp, doff + blksiz / 2, SEEK_SET));
+  fputc(c ^ 0x10, fp);
+  fclose(fp);
+  ASSERT_EQ(0, ssftblopen(ftbl, dbname.c_str(), SSFTBLOREADER));
+  int broken = 0;
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    int sp;
+    void *p = ssftblget(ftbl, it->first.c_str(), it->first.size(), &sp);
+    if (p == NULL) {
+      ASSERT_EQ(SSECHKSUM, ftbl->ecode) << it->first;
+      broken++;
+      continue;
+    }
+    ASSERT_EQ(it->second, string((const char *)p, sp));
+    free(p);
+  }
+  ASSERT_TRUE(broken > 0);
+  ASSERT_TRUE(broken < (int)m.size() / 2);
+  scan_result res;
+  ASSERT_EQ(-1, ssftblscan(ftbl, NULL, 0, NULL, 0, scan_collect, &res, 0, SSFTBLSNOCACHE));
+  ASSERT_EQ(SSECHKSUM, ftbl->ecode);
+  vector<SSFTBLMGETREC> recs(1);
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    recs[0].kbuf = it->first.c_str();
+    recs[0].ksiz = it->first.size();
+    if (ssftblmultiget(ftbl, &recs[0], 1) == 1) {
+      free(recs[0].vbuf);
+    } else {
+      ASSERT_EQ(SSECHKSUM, ftbl->ecode);
+    }
+  }
+}
+
+/*-----------------------------------------------------------------------------
+ * SharedPrefixReader
+ */
+class SSFTBLSharedPrefixReaderTestFixture : public SSFTBLBaseReaderTestFixture {
+public:
+  virtual void Appends(SSFTBL *ftbl) {
+    int r;
+    char kbuf[32];
+    /* long keys sharing most of their bytes, some beyond the inline key buffer */
+    string base = "http://www.example.com/" + string(300, 'p') + "/";
+    for (int i = 0; i < 5000; i++) {
+      sprintf(kbuf, "%04d/%d", i / 10, i % 10);
+      string key = (i % 7 == 0) ? base.substr(0, 40) + kbuf : base + kbuf;
+      m[key] = get_random_str(1, 64);
+    }
+    for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+      r = ssftblappend(ftbl, it->first.c_str(), it->first.size(),
+                       it->second.c_str(), it->second.size());
+      ASSERT_EQ(0, r);
+    }
+  }
+  map<string, string> m;
+};
+
+TEST_F(SSFTBLSharedPrefixReaderTestFixture, get_many) {
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    int sp;
+    void *p = ssftblget(ftbl, it->first.c_str(), it->first.size(), &sp);
+    ASSERT_TRUE(p != NULL) << it->first;
+    ASSERT_EQ(it->second, string((const char*)p, sp));
+    free(p);
+    string miss = it->first + "x";
+    ASSERT_TRUE(ssftblget(ftbl, miss.c_str(), miss.size(), &sp) == NULL);
+  }
+}
+
+TEST_F(SSFTBLSharedPrefixReaderTestFixture, file_is_smaller_than_keys) {
+  uint64_t rawsiz = 0;
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it)
+    rawsiz += it->first.size() + it->second.size();
+  struct stat sbuf;
+  ASSERT_EQ(0, stat((dbname + ".sstbl").c_str(), &sbuf));
+  ASSERT_TRUE((uint64_t)sbuf.st_size < rawsiz / 2);
+}
+
+/*-----------------------------------------------------------------------------
+ * LegacyFormatReader
+ */
+class SSFTBLLegacyReaderTestFixture : public SSFTBLTestFixture {
+protected:
+  void SetUp() {
+    dbname = "./ssftbllegacytest";
+    SSFTBLTestFixture::SetUp();
+    /* a format version 0 file: header, one block of records and the index */
+    const char *keys[] = { "key1", "key2", "key3" };
+    const char *vals[] = { "val1", "val2", "val3" };
+    string blk;
+    for (int i = 0; i < 3; i++) {
+      int ksiz = strlen(keys[i]), vsiz = strlen(vals[i]);
+      blk.append((const char *)&ksiz, sizeof(ksiz)).append(keys[i], ksiz);
+      blk.append((const char *)&vsiz, sizeof(vsiz)).append(vals[i], vsiz);
+    }
+    uint32_t blksiz = 64 * 1024, rnum = 0, idxnum = 2, cmethod = SSCMNONE;
+    uint64_t doff = 256, idxoff = doff + blk.size();
+    string header(256, '\0');
+    memcpy(&header[0], "HuGeTaBlEKaMoNe\n", 16);
+    memcpy(&header[32], &blksiz, sizeof(blksiz));
+    memcpy(&header[36], &rnum, sizeof(rnum));
+    memcpy(&header[40], &idxnum, sizeof(idxnum));
+    memcpy(&header[44], &idxoff, sizeof(idxoff));
+    memcpy(&header[52], &cmethod, sizeof(cmethod));
+    string idx;
+    const char *idxkeys[] = { "key1", "key3" };
+    for (int i = 0; i < 2; i++) {
+      int ksiz = strlen(idxkeys[i]);
+      uint32_t bsiz = blk.size();
+      idx.append((const char *)&ksiz, sizeof(ksiz)).append(idxkeys[i], ksiz);
+      idx.append((const char *)&doff, sizeof(doff)).append((const char *)&bsiz, sizeof(bsiz));
+    }
+    FILE *fp = fopen((dbname + ".sstbl").c_str(), "wb");
+    ASSERT_TRUE(fp != NULL);
+    string file = header + blk + idx;
+    ASSERT_EQ(1, fwrite(file.data(), file.size(), 1, fp));
+    fclose(fp);
+    ASSERT_EQ(0, ssftblopen(ftbl, dbname.c_str(), SSFTBLOREADER));
+  }
+  void TearDown() {
+    ASSERT_EQ(0, ssftblclose(ftbl));
+    ASSERT_EQ(0, unlink((dbname + ".sstbl").c_str()));
+    SSFTBLTestFixture::TearDown();
+  }
+  string dbname;
+};
+
+TEST_F(SSFTBLLegacyReaderTestFixture, get) {
+  int sp;
+  void *p;
+  p = ssftblget(ftbl, "key2", 4, &sp);
+  ASSERT_TRUE(p != NULL);
+  ASSERT_EQ("val2", string((const char*)p, sp));
+  free(p);
+  p = ssftblget(ftbl, "key3", 4, &sp);
+  ASSERT_TRUE(p != NULL);
+  ASSERT_EQ("val3", string((const char*)p, sp));
+  free(p);
+  ASSERT_TRUE(ssftblget(ftbl, "key21", 5, &sp) == NULL);
+  ASSERT_TRUE(ssftblget(ftbl, "key4", 4, &sp) == NULL);
+  p = ssftblgetlastkey(ftbl, &sp);
+  ASSERT_TRUE(p != NULL);
+  ASSERT_EQ("key3", string((const char*)p, sp));
+  free(p);
+}
+
+TEST_F(SSFTBLLegacyReaderTestFixture, cursor) {
+  SSFTBLCUR *cur = ssftblcurnew(ftbl);
+  ASSERT_EQ(0, ssftblcurjump(cur, "key15", 5));
+  ASSERT_EQ("key2", cur_key(cur));
+  ASSERT_EQ("val2", cur_val(cur));
+  ASSERT_EQ(0, ssftblcurnext(cur));
+  ASSERT_EQ("key3", cur_key(cur));
+  ASSERT_EQ(-1, ssftblcurnext(cur));
+  ssftblcurdel(cur);
+}
+
+/*-----------------------------------------------------------------------------
+ * MmapReader
+ */
+class SSFTBLMmapReaderTestFixture : public SSFTBLRandomReaderTestFixture {
+public:
+  virtual int OpenMode() { return SSFTBLOREADER | SSFTBLOMMAP; }
+};
+
+TEST_F(SSFTBLMmapReaderTestFixture, open_close) {
+  ASSERT_TRUE(ftbl->map != NULL);
+  ASSERT_TRUE(ftbl->mapsiz > 0);
+}
+
+TEST_F(SSFTBLMmapReaderTestFixture, index_in_map) {
+  ASSERT_TRUE(ftbl->idxsec == NULL);
+  ASSERT_EQ(ftbl->map + ftbl->idxoff, (const char *)ftbl->idxpfx);
+}
+
+TEST_F(SSFTBLMmapReaderTestFixture, get_many) {
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it) {
+    int sp;
+    const string &key = it->first;
+    const string &val = it->second;
+    void *p = ssftblget(ftbl, key.c_str(), key.size(), &sp);
+    ASSERT_TRUE(p != NULL);
+    ASSERT_EQ(val, string((const char*)p, sp));
+    free(p);
+  }
+}
+
+TEST_F(SSFTBLMmapReaderTestFixture, multiget) {
+  vector<string> keys;
+  for (map<string, string>::const_iterator it = m.begin(); it != m.end(); ++it)
+    keys.push_back(it->first);
+  keys.push_back("not-found");
+  vector<SSFTBLMGETREC> recs(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    recs[i].kbuf = keys[i].c_str();
+    recs[i].ksiz = keys[i].size();
+  }
+  ASSERT_EQ((int)m.size(), ssftblmultiget(ftbl, &recs[0], recs.size()));
+  for (size_t i = 0; i < m.size(); i++) {
+    ASSERT_EQ(m[keys[i]], string((const char *)recs[i].vbuf, recs[i].vsiz));
+    free(recs[i].vbuf);
+  }
+  ASSERT_TRUE(recs[m.size()].vbuf == NULL);
+}
+
+TEST_F(SSFTBLMmapReaderTestFixture, cursor) {
+  SSFTBLCUR *cur = ssftblcurnew(ftbl);
+  int ksiz, vsiz;
+  ASSERT_EQ(0, ssftblcurfirst(cur));
+  map<string, string>::const_iterator it = m.begin();
+  do {
+    ASSERT_TRUE(it != m.end());
+    const char *kbuf = (const char *)ssftblcurkey(cur, &ksiz);
+    const char *vbuf = (const char *)ssftblcurval(cur, &vsiz);
+    ASSERT_EQ(it->first, string(kbuf, ksiz));
+    ASSERT_EQ(it->second, string(vbuf, vsiz));
+    ++it;
+  } while (ssftblcurnext(cur) == 0);
+  ASSERT_TRUE(it == m.end());
+  ssftblcurdel(cur);
+}
+
+TEST_F(SSFTBLMmapReaderTestFixture, scan) {
+  scan_result res;
+  ASSERT_EQ(0, ssftblscan(ftbl, NULL, 0, NULL, 0, scan_collect, &res, 0, SSFTBLSNOCACHE));
+  ASSERT_EQ(m.size(), res.recs.size());
+  ASSERT_TRUE(equal(m.begin(), m.end(), res.recs.begin()));
+}
+
+TEST_F(SSFTBLMmapReaderTestFixture, get_many_include_not_found) {
+  for (unsigned int i = 0; i < 10240; i++) {
+    int sp;
+    string key = get_random_str(10, 20);
+    bool has = (m.find(key) != m.end());
+    void *p = ssftblget(ftbl, key.c_str(), key.size(), &sp);
+    if (has) {
+      ASSERT_TRUE(p != NULL);
+      free(p);
+    } else {
+      ASSERT_TRUE(p == NULL);
+    }
+  }
+}
+
+TEST_F(SSFTBLTestFixture, mmap_writer_is_invalid) {
+  ASSERT_EQ(-1, ssftblopen(ftbl, "./ssftblmmapwritertest", SSFTBLOWRITER | SSFTBLOMMAP));
+  ASSERT_EQ(SSEINVALID, ftbl->ecode);
+}
+
+TEST_F(SSFTBLTestFixture, direct_writer_and_mmap_are_invalid) {
+  ASSERT_EQ(-1, ssftblopen(ftbl, "./ssftbldirecttest", SSFTBLOWRITER | SSFTBLODIRECT));
+  ASSERT_EQ(SSEINVALID, ftbl->ecode);
+  ASSERT_EQ(-1, ssftblopen(ftbl, "./ssftbldirecttest",
+                           SSFTBLOREADER | SSFTBLOMMAP | SSFTBLODIRECT));
+  ASSERT_EQ(SSEINVALID, ftbl->ecode);
+}
@@ -0,0 +1,490 @@
+#include <ssutil.h>
+#include <sslsm.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* const or default parameters */
+#define LSMDEFFLUSHSIZ (64ULL << 20)     /* default size of a memtable to be flushed */
+#define LSMDEFMAXMUL   4                 /* default memory limit in units of `flushsiz' */
+#define LSMDEFBLKCSIZ  (256ULL << 20)    /* default capacity of the block cache */
+#define LSMDIRMODE     00755             /* permission of created directories */
+#define LSMFILESUFFIX  ".sstbl"          /* suffix of table files, added by SSFTBL */
+#define LSMTMPSUFFIX   ".tmp"            /* suffix of a table file being flushed */
+#define LSMSEQLEN      16                /* length of the hexadecimal number of a table file */
+
+/* private function prototypes */
+static void sslsmclear(SSLSM *lsm);
+static int sslsmload(SSLSM *lsm);
+static SSFTBL *sslsmopentbl(SSLSM *lsm, uint64_t seq);
+static char *sslsmtblpath(SSLSM *lsm, uint64_t seq);
+static char *sslsmcatpath(const char *path, const char *suffix);
+static int sslsmsyncdir(SSLSM *lsm);
+static int sslsmseqcmp(const void *a, const void *b);
+static int sslsmrotate(SSLSM *lsm);
+static int sslsmwait(SSLSM *lsm, SSMTBL *imtbl);
+static void *sslsmflusher(void *arg);
+static SSFTBL *sslsmdump(SSLSM *lsm, SSMTBL *mtbl, uint64_t seq, int *ep);
+static void sslsmsetecode(SSLSM *lsm, int ecode);
+
+/*-----------------------------------------------------------------------------
+ * APIs
+ */
+SSLSM *sslsmnew(void) {
+  SSLSM *lsm;
+  SSMALLOC(lsm, sizeof(SSLSM));
+  if (lsm == NULL) return NULL;
+  sslsmclear(lsm);
+  pthread_rwlock_init(&lsm->lock, NULL);
+  pthread_mutex_init(&lsm->mtx, NULL);
+  pthread_cond_init(&lsm->cond, NULL);
+  return lsm;
+}
+
+void sslsmdel(SSLSM *lsm) {
+  assert(lsm);
+  if (lsm->open) sslsmclose(lsm);
+  pthread_cond_destroy(&lsm->cond);
+  pthread_mutex_destroy(&lsm->mtx);
+  pthread_rwlock_destroy(&lsm->lock);
+  SSFREE(lsm);
+}
+
+int sslsmtune(SSLSM *lsm, uint64_t flushsiz, uint64_t maxmsiz, int cmethod, int opts) {
+  assert(lsm);
+  if (lsm->open) {
+    sslsmsetecode(lsm, SSEINVALID);
+    return -1;
+  }
+  lsm->flushsiz = (flushsiz > 0) ? flushsiz : LSMDEFFLUSHSIZ;
+  lsm->maxmsiz = (maxmsiz > 0) ? maxmsiz : lsm->flushsiz * LSMDEFMAXMUL;
+  lsm->cmethod = cmethod;
+  lsm->opts = opts;
+  return 0;
+}
+
+int sslsmsetcache(SSLSM *lsm, uint64_t capsiz) {
+  assert(lsm);
+  if (lsm->open) {
+    sslsmsetecode(lsm, SSEINVALID);
+    return -1;
+  }
+  lsm->blkcsiz = capsiz;
+  return 0;
+}
+
+int sslsmopen(SSLSM *lsm, const char *path) {
+  assert(lsm && path);
+  if (lsm->open) {
+    sslsmsetecode(lsm, SSEINVALID);
+    return -1;
+  }
+  if (mkdir(path, LSMDIRMODE) != 0 && errno != EEXIST) {
+    sslsmsetecode(lsm, SSEMKDIR);
+    return -1;
+  }
+  lsm->path = strdup(path);
+  lsm->blkc = sscachenew(lsm->blkcsiz, 0);
+  lsm->mtbl = ssmtblnew();
+  if (lsm->blkc == NULL || lsm->mtbl == NULL) {
+    sslsmsetecode(lsm, SSETHREAD);
+    goto err;
+  }
+  if (sscachetune(lsm->blkc, SSCACHETTINYLFU) != 0) {
+    sslsmsetecode(lsm, SSEMISC);
+    goto err;
+  }
+  if (sslsmload(lsm) != 0) goto err;
+  lsm->stop = 0;
+  lsm->fecode = SSESUCCESS;
+  if (pthread_create(&lsm->th, NULL, sslsmflusher, lsm) != 0) {
+    sslsmsetecode(lsm, SSETHREAD);
+    goto err;
+  }
+  lsm->open = 1;
+  return 0;
+err:
+  /* closing releases what was made so far without waiting for a flush thread */
+  lsm->open = 1;
+  lsm->stop = 1;
+  sslsmclose(lsm);
+  return -1;
+}
+
+int sslsmclose(SSLSM *lsm) {
+  assert(lsm);
+  if (!lsm->open) {
+    sslsmsetecode(lsm, SSEINVALID);
+    return -1;
+  }
+  int err = 0;
+  uint32_t i;
+  if (!lsm->stop) {
+    if (sslsmsync(lsm) != 0) err = -1;
+    pthread_mutex_lock(&lsm->mtx);
+    lsm->stop = 1;
+    pthread_cond_broadcast(&lsm->cond);
+    pthread_mutex_unlock(&lsm->mtx);
+    pthread_join(lsm->th, NULL);
+  }
+  for (i = 0; i < lsm->ftnum; i++) {
+    if (ssftblclose(lsm->ftbls[i]) != 0) {
+      sslsmsetecode(lsm, lsm->ftbls[i]->ecode);
+      err = -1;
+    }
+    ssftbldel(lsm->ftbls[i]);
+  }
+  if (lsm->ftbls) SSFREE(lsm->ftbls);
+  /* records left in memory here were not flushed, which was reported above */
+  if (lsm->imtbl) ssmtbldel(lsm->imtbl);
+  if (lsm->mtbl) ssmtbldel(lsm->mtbl);
+  if (lsm->blkc) sscachedel(lsm->blkc);
+  if (lsm->path) SSFREE(lsm->path);
+  int ecode = lsm->ecode;
+  uint64_t flushsiz = lsm->flushsiz, maxmsiz = lsm->maxmsiz, blkcsiz = lsm->blkcsiz;
+  int cmethod = lsm->cmethod, opts = lsm->opts;
+  sslsmclear(lsm);
+  lsm->ecode = ecode;
+  lsm->flushsiz = flushsiz;
+  lsm->maxmsiz = maxmsiz;
+  lsm->blkcsiz = blkcsiz;
+  lsm->cmethod = cmethod;
+  lsm->opts = opts;
+  return err;
+}
+
+int sslsmput(SSLSM *lsm, const void *kbuf, int ksiz, const void *vbuf, int vsiz) {
+  assert(lsm && kbuf && ksiz >= 0 && vbuf && vsiz >= 0);
+  /* table files hold no empty key or value */
+  if (!lsm->open || ksiz < 1 || vsiz < 1) {
+    sslsmsetecode(lsm, SSEINVALID);
+    return -1;
+  }
+  SSMTBL *mtbl, *imtbl;
+  while (1) {
+    pthread_rwlock_rdlock(&lsm->lock);
+    mtbl = lsm->mtbl;
+    imtbl = lsm->imtbl;
+    /* writers wait for the running flush only when both memtables are over the limit */
+    if (imtbl == NULL || ssmtblmsiz(mtbl) + ssmtblmsiz(imtbl) < lsm->maxmsiz) break;
+    pthread_rwlock_unlock(&lsm->lock);
+    if (sslsmwait(lsm, imtbl) != 0) return -1;
+  }
+  int r = ssmtblput(mtbl, kbuf, ksiz, vbuf, vsiz);
+  /* once the lock is released, the memtable may be rotated out, flushed and deleted */
+  uint64_t msiz = ssmtblmsiz(mtbl);
+  pthread_rwlock_unlock(&lsm->lock);
+  if (r != 0) {
+    sslsmsetecode(lsm, mtbl->ecode);
+    return -1;
+  }
+  if (imtbl == NULL && msiz >= lsm->flushsiz) {
+    pthread_mutex_lock(&lsm->mtx);
+    /* another writer may have rotated it already */
+    if (lsm->mtbl == mtbl && lsm->imtbl == NULL && lsm->fecode == SSESUCCESS &&
+        sslsmrotate(lsm) != 0) r = -1;
+    pthread_mutex_unlock(&lsm->mtx);
+  }
+  return r;
+}
+
+void *sslsmget(SSLSM *lsm, const void *kbuf, int ksiz, int *sp) {
+  assert(lsm && kbuf && ksiz >= 0 && sp);
+  if (!lsm->open) {
+    sslsmsetecode(lsm, SSEINVALID);
+    return NULL;
+  }
+  pthread_rwlock_rdlock(&lsm->lock);
+  void *vbuf = ssmtblget(lsm->mtbl, kbuf, ksiz, sp);
+  if (vbuf == NULL && lsm->imtbl) vbuf = ssmtblget(lsm->imtbl, kbuf, ksiz, sp);
+  uint32_t i = lsm->ftnum;
+  while (vbuf == NULL && i > 0) {
+    i--;
+    vbuf = ssftblget(lsm->ftbls[i], kbuf, ksiz, sp);
+  }
+  pthread_rwlock_unlock(&lsm->lock);
+  if (vbuf == NULL) sslsmsetecode(lsm, SSENOREC);
+  return vbuf;
+}
+
+int sslsmsync(SSLSM *lsm) {
+  assert(lsm);
+  if (!lsm->open) {
+    sslsmsetecode(lsm, SSEINVALID);
+    return -1;
+  }
+  int err = 0;
+  pthread_mutex_lock(&lsm->mtx);
+  while (lsm->imtbl && lsm->fecode == SSESUCCESS)
+    pthread_cond_wait(&lsm->cond, &lsm->mtx);
+  if (lsm->fecode == SSESUCCESS && ssmtblrnum(lsm->mtbl) > 0) {
+    if (sslsmrotate(lsm) != 0) err = -1;
+    while (lsm->imtbl && lsm->fecode == SSESUCCESS)
+      pthread_cond_wait(&lsm->cond, &lsm->mtx);
+  }
+  if (lsm->fecode != SSESUCCESS) {
+    sslsmsetecode(lsm, lsm->fecode);
+    err = -1;
+  }
+  pthread_mutex_unlock(&lsm->mtx);
+  return err;
+}
+
+/*-----------------------------------------------------------------------------
+ * private functions
+ */
+static void sslsmclear(SSLSM *lsm) {
+  assert(lsm);
+  lsm->path = NULL;
+  lsm->mtbl = NULL;
+  lsm->imtbl = NULL;
+  lsm->ftbls = NULL;
+  lsm->ftnum = 0;
+  lsm->fseq = 1;
+  lsm->blkc = NULL;
+  lsm->blkcsiz = LSMDEFBLKCSIZ;
+  lsm->flushsiz = LSMDEFFLUSHSIZ;
+  lsm->maxmsiz = LSMDEFFLUSHSIZ * LSMDEFMAXMUL;
+  lsm->cmethod = 0;
+  lsm->opts = 0;
+  lsm->open = 0;
+  lsm->stop = 1;
+  lsm->fecode = SSESUCCESS;
+  lsm->ecode = SSESUCCESS;
+}
+
+static int sslsmload(SSLSM *lsm) {
+  /* open the table files of the directory in the order they were flushed */
+  DIR *dir = opendir(lsm->path);
+  if (dir == NULL) {
+    sslsmsetecode(lsm, SSENOFILE);
+    return -1;
+  }
+  uint64_t *seqs = NULL;
+  uint32_t num = 0, cap = 0, i;
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL) {
+    char *end;
+    uint64_t seq = strtoull(ent->d_name, &end, 16);
+    if (end != ent->d_name + LSMSEQLEN) continue;
+    if (strcmp(end, LSMTMPSUFFIX LSMFILESUFFIX) == 0) {
+      /* a flush cut short by a crash left only its temporary file */
+      char *tpath = sslsmcatpath(lsm->path, "/");
+      char *tfpath = sslsmcatpath(tpath, ent->d_name);
+      unlink(tfpath);
+      SSFREE(tfpath);
+      SSFREE(tpath);
+      continue;
+    }
+    if (strcmp(end, LSMFILESUFFIX) != 0) continue;
+    if (num >= cap) {
+      cap = (cap > 0) ? cap * 2 : 16;
+      SSREALLOC(seqs, seqs, sizeof(uint64_t) * cap);
+    }
+    seqs[num++] = seq;
+  }
+  closedir(dir);
+  if (num > 0) qsort(seqs, num, sizeof(uint64_t), sslsmseqcmp);
+  SSMALLOC(lsm->ftbls, sizeof(SSFTBL *) * (num + 1));
+  int err = 0;
+  for (i = 0; i < num && !err; i++) {
+    SSFTBL *ftbl = sslsmopentbl(lsm, seqs[i]);
+    if (ftbl == NULL) {
+      err = -1;
+      break;
+    }
+    lsm->ftbls[lsm->ftnum++] = ftbl;
+    lsm->fseq = seqs[i] + 1;
+  }
+  if (seqs) SSFREE(seqs);
+  return err;
+}
+
+static SSFTBL *sslsmopentbl(SSLSM *lsm, uint64_t seq) {
+  char *path = sslsmtblpath(lsm, seq);
+  SSFTBL *ftbl = ssftblnew();
+  ssftblsetsharedcache(ftbl, lsm->blkc, NULL);
+  if (ssftblopen(ftbl, path, SSFTBLOREADER) != 0) {
+    sslsmsetecode(lsm, ftbl->ecode);
+    ssftbldel(ftbl);
+    ftbl = NULL;
+  }
+  SSFREE(path);
+  return ftbl;
+}
+
+static char *sslsmtblpath(SSLSM *lsm, uint64_t seq) {
+  char *path;
+  SSMALLOC(path, strlen(lsm->path) + LSMSEQLEN + 2);
+  sprintf(path, "%s/%016llx", lsm->path, (unsigned long long)seq);
+  return path;
+}
+
+static char *sslsmcatpath(const char *path, const char *suffix) {
+  char *cpath;
+  SSMALLOC(cpath, strlen(path) + strlen(suffix) + 1);
+  sprintf(cpath, "%s%s", path, suffix);
+  return cpath;
+}
+
+static int sslsmsyncdir(SSLSM *lsm) {
+  /* make a renamed table file durable */
+  int fd, r;
+  SSSYS_NOINTR(fd, open(lsm->path, O_RDONLY | O_DIRECTORY));
+  if (fd < 0) return -1;
+  SSSYS_NOINTR(r, fsync(fd));
+  close(fd);
+  return r;
+}
+
+static int sslsmseqcmp(const void *a, const void *b) {
+  uint64_t sa = *(const uint64_t *)a, sb = *(const uint64_t *)b;
+  return (sa < sb) ? -1 : (sa > sb);
+}
+
+static int sslsmrotate(SSLSM *lsm) {
+  /* called with `mtx' held and no memtable being flushed; puts in flight on the active
+     memtable finish before the write lock is taken, so the rotated one is immutable */
+  assert(lsm->imtbl == NULL);
+  SSMTBL *mtbl = ssmtblnew();
+  if (mtbl == NULL) {
+    sslsmsetecode(lsm, SSEMISC);
+    return -1;
+  }
+  pthread_rwlock_wrlock(&lsm->lock);
+  lsm->imtbl = lsm->mtbl;
+  lsm->mtbl = mtbl;
+  pthread_rwlock_unlock(&lsm->lock);
+  pthread_cond_broadcast(&lsm->cond);
+  return 0;
+}
+
+static int sslsmwait(SSLSM *lsm, SSMTBL *imtbl) {
+  /* wait until a memtable is flushed, or the flush fails */
+  int err = 0;
+  pthread_mutex_lock(&lsm->mtx);
+  while (lsm->imtbl == imtbl && lsm->fecode == SSESUCCESS)
+    pthread_cond_wait(&lsm->cond, &lsm->mtx);
+  if (lsm->imtbl == imtbl) {
+    sslsmsetecode(lsm, lsm->fecode);
+    err = -1;
+  }
+  pthread_mutex_unlock(&lsm->mtx);
+  return err;
+}
+
+static void *sslsmflusher(void *arg) {
+  SSLSM *lsm = arg;
+  pthread_mutex_lock(&lsm->mtx);
+  while (1) {
+    while (!lsm->stop && (lsm->imtbl == NULL || lsm->fecode != SSESUCCESS))
+      pthread_cond_wait(&lsm->cond, &lsm->mtx);
+    if (lsm->imtbl == NULL || lsm->fecode != SSESUCCESS) break;
+    SSMTBL *imtbl = lsm->imtbl;
+    uint64_t seq = lsm->fseq++;
+    pthread_mutex_unlock(&lsm->mtx);
+    int ecode = SSESUCCESS;
+    SSFTBL *ftbl = sslsmdump(lsm, imtbl, seq, &ecode);
+    pthread_mutex_lock(&lsm->mtx);
+    if (ftbl == NULL) {
+      /* the memtable stays readable, and writers over the limit fail instead of waiting */
+      lsm->fecode = ecode;
+      pthread_cond_broadcast(&lsm->cond);
+      continue;
+    }
+    pthread_rwlock_wrlock(&lsm->lock);
+    lsm->ftbls[lsm->ftnum++] = ftbl;
+    lsm->imtbl = NULL;
+    pthread_rwlock_unlock(&lsm->lock);
+    ssmtbldel(imtbl);
+    /* writers filling the active memtable during the flush left its rotation to here */
+    if (ssmtblmsiz(lsm->mtbl) >= lsm->flushsiz) sslsmrotate(lsm);
+    pthread_cond_broadcast(&lsm->cond);
+  }
+  pthread_mutex_unlock(&lsm->mtx);
+  return NULL;
+}
+
+static SSFTBL *sslsmdump(SSLSM *lsm, SSMTBL *mtbl, uint64_t seq, int *ep) {
+  /* stream a memtable in key order into a temporary table file, which is renamed into place
+     only once it is complete and synced, so that a crash never leaves a broken table under a
+     name `sslsmload' opens; then open it as a reader */
+  char *path = sslsmtblpath(lsm, seq);
+  char *tpath = sslsmcatpath(path, LSMTMPSUFFIX);
+  char *fpath = sslsmcatpath(path, LSMFILESUFFIX);
+  char *tfpath = sslsmcatpath(tpath, LSMFILESUFFIX);
+  SSFTBL *ftbl = ssftblnew();
+  SSFTBL **ftbls;
+  int err = 0, renamed = 0;
+  ssftbltune(ftbl, 0, lsm->cmethod, lsm->opts);
+  if (ssftblopen(ftbl, tpath, SSFTBLOWRITER) != 0) {
+    *ep = ftbl->ecode;
+    ssftbldel(ftbl);
+    ftbl = NULL;
+    goto end;
+  }
+  SSMTBLCUR *cur = ssmtblcurnew(mtbl);
+  if (ssmtblcurfirst(cur) == 0) {
+    do {
+      int ksiz, vsiz;
+      const void *kbuf = ssmtblcurkey(cur, &ksiz);
+      const void *vbuf = ssmtblcurval(cur, &vsiz);
+      if (ssftblappend(ftbl, kbuf, ksiz, vbuf, vsiz) != 0) {
+        *ep = ftbl->ecode;
+        err = -1;
+        break;
+      }
+    } while (ssmtblcurnext(cur) == 0);
+  }
+  ssmtblcurdel(cur);
+  if (ssftblclose(ftbl) != 0 && !err) {
+    *ep = ftbl->ecode;
+    err = -1;
+  }
+  if (!err) {
+    if (rename(tfpath, fpath) != 0) {
+      *ep = SSERENAME;
+      err = -1;
+    } else {
+      renamed = 1;
+      if (sslsmsyncdir(lsm) != 0) {
+        *ep = SSESYNC;
+        err = -1;
+      }
+    }
+  }
+  /* room for the new table is made before it is opened, so adding it cannot fail */
+  pthread_rwlock_wrlock(&lsm->lock);
+  SSREALLOC(ftbls, lsm->ftbls, sizeof(SSFTBL *) * (lsm->ftnum + 1));
+  if (ftbls) lsm->ftbls = ftbls;
+  pthread_rwlock_unlock(&lsm->lock);
+  if (ftbls == NULL && !err) {
+    *ep = SSEMISC;
+    err = -1;
+  }
+  if (!err) {
+    ssftblsetsharedcache(ftbl, lsm->blkc, NULL);
+    if (ssftblopen(ftbl, path, SSFTBLOREADER) != 0) {
+      *ep = ftbl->ecode;
+      err = -1;
+    }
+  }
+  if (err) {
+    unlink(renamed ? fpath : tfpath);
+    ssftbldel(ftbl);
+    ftbl = NULL;
+  }
+end:
+  SSFREE(tfpath);
+  SSFREE(fpath);
+  SSFREE(tpath);
+  SSFREE(path);
+  return ftbl;
+}
+
+static void sslsmsetecode(SSLSM *lsm, int ecode) {
+  assert(lsm);
+  lsm->ecode = ecode;
+}
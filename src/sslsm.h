@@ -0,0 +1,108 @@
+#ifndef SSLSM_H_
+#define SSLSM_H_
+
+#if defined(__cplusplus)
+#define SSLSM_CLINKAGEBEGIN extern "C" {
+#define SSLSM_CLINKAGEEND }
+#else
+#define SSLSM_CLINKAGEBEGIN
+#define SSLSM_CLINKAGEEND
+#endif
+SSLSM_CLINKAGEBEGIN
+
+#include <stdint.h>
+#include <pthread.h>
+#include <ssmtbl.h>
+#include <ssftbl.h>
+#include <sscache.h>
+
+typedef struct {
+  char *path;              /* directory of the table files */
+  SSMTBL *mtbl;            /* active memtable taking writes */
+  SSMTBL *imtbl;           /* immutable memtable being flushed, or NULL */
+  SSFTBL **ftbls;          /* flushed tables opened as readers, oldest first */
+  uint32_t ftnum;          /* number of flushed tables */
+  uint64_t fseq;           /* number of the next table file */
+  SSCACHE *blkc;           /* block cache shared by the flushed tables */
+  uint64_t blkcsiz;        /* capacity of the block cache in bytes */
+  uint64_t flushsiz;       /* size of the active memtable at which it is rotated */
+  uint64_t maxmsiz;        /* size of both memtables at which writers wait for a flush */
+  int cmethod;             /* compression method of the table files */
+  int opts;                /* tuning options of the table files */
+  int open;                /* whether the object is open */
+  int stop;                /* whether the flush thread should exit */
+  int fecode;              /* error code of the last failed flush, or `SSESUCCESS' */
+  pthread_t th;            /* flush thread */
+  pthread_rwlock_t lock;   /* guards the memtables and tables; writers and readers share it */
+  pthread_mutex_t mtx;     /* mutex for rotations and flushes */
+  pthread_cond_t cond;     /* signaled when a memtable is rotated or flushed */
+  int ecode;               /* error code */
+} SSLSM;
+
+/* Create a log-structured table object.
+   The return value is the new object.
+   Records are put into an on-memory SSTable, which is rotated out once it is large enough and
+   written to a new table file in key order by a background thread while a fresh one takes
+   the writes. Retrievals look through the memtables and then the table files, newest first.
+   Table files are never merged, and records are not logged, so records still in memory are
+   lost if the process exits without `sslsmclose'. A table file is written under a temporary
+   name and renamed once it is synced, so a crash during a flush leaves no broken table. */
+SSLSM *sslsmnew(void);
+
+/* Delete a log-structured table object.
+   `lsm' specifies the object, which is closed first if it is open. */
+void sslsmdel(SSLSM *lsm);
+
+/* Set the tuning parameters of a log-structured table object.
+   `lsm' specifies the object, which must not be open.
+   `flushsiz' specifies the size of the memory of the active memtable at which it is flushed,
+   or 0 for the default of 64 MiB.
+   `maxmsiz' specifies the size of the memory of both memtables beyond which writers wait for
+   the running flush, or 0 for four times `flushsiz'. Writers never wait below it.
+   `cmethod' and `opts' are given to `ssftbltune' for the table files.
+   The return value is 0 for success, or -1 on failure. */
+int sslsmtune(SSLSM *lsm, uint64_t flushsiz, uint64_t maxmsiz, int cmethod, int opts);
+
+/* Set the capacity of the block cache shared by the table files.
+   `lsm' specifies the object, which must not be open.
+   `capsiz' specifies the capacity in bytes.
+   The return value is 0 for success, or -1 on failure. */
+int sslsmsetcache(SSLSM *lsm, uint64_t capsiz);
+
+/* Open a log-structured table object.
+   `lsm' specifies the object.
+   `path' specifies the directory of the table files, which is created if missing. Table
+   files left there by an earlier object are opened as readers.
+   The return value is 0 for success, or -1 on failure. */
+int sslsmopen(SSLSM *lsm, const char *path);
+
+/* Close a log-structured table object.
+   `lsm' specifies the object.
+   The records still in memory are flushed first.
+   The return value is 0 for success, or -1 on failure. */
+int sslsmclose(SSLSM *lsm);
+
+/* Store a record into a log-structured table object.
+   `lsm' specifies the object.
+   `kbuf' and `ksiz' specify the key, and `vbuf' and `vsiz' specify the value.
+   If a record with the same key exists, it is overwritten. Any threads may put concurrently.
+   The return value is 0 for success, or -1 on failure, which includes a failed flush while
+   the memory limit is exceeded. An empty key or value is refused with `SSEINVALID', as table
+   files cannot hold it. */
+int sslsmput(SSLSM *lsm, const void *kbuf, int ksiz, const void *vbuf, int vsiz);
+
+/* Retrieve a record in a log-structured table object.
+   `lsm' specifies the object.
+   `kbuf' and `ksiz' specify the key.
+   `sp' specifies the pointer to the variable into which the size of the value is assigned.
+   The return value is the value allocated with `malloc', or `NULL' if no record corresponds.
+   Any threads may retrieve concurrently with puts and flushes. */
+void *sslsmget(SSLSM *lsm, const void *kbuf, int ksiz, int *sp);
+
+/* Flush the records in memory and wait until they are in table files.
+   `lsm' specifies the object.
+   The return value is 0 for success, or -1 on failure. */
+int sslsmsync(SSLSM *lsm);
+
+SSLSM_CLINKAGEEND
+#endif
@@ -0,0 +1,187 @@
+#include <sslsm.h>
+
+#include <map>
+#include <string>
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define LSMTESTPATH "./sslsmtest"
+
+namespace {
+void remove_dir(const char *path) {
+  DIR *dir = opendir(path);
+  if (dir == NULL) return;
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL) {
+    if (ent->d_name[0] == '.') continue;
+    unlink((string(path) + "/" + ent->d_name).c_str());
+  }
+  closedir(dir);
+  rmdir(path);
+}
+
+string get(SSLSM *lsm, const string &key) {
+  int vsiz;
+  char *vbuf = (char *)sslsmget(lsm, key.data(), key.size(), &vsiz);
+  if (vbuf == NULL) return "(none)";
+  string val(vbuf, vsiz);
+  free(vbuf);
+  return val;
+}
+
+struct put_arg {
+  SSLSM *lsm;
+  int id;
+  int num;
+};
+
+void *put_worker(void *p) {
+  put_arg *arg = (put_arg *)p;
+  char kbuf[32], vbuf[128];
+  for (int i = 0; i < arg->num; i++) {
+    int ksiz = sprintf(kbuf, "key%02d_%06d", arg->id, i);
+    int vsiz = sprintf(vbuf, "val%02d_%06d_%064d", arg->id, i, 0);
+    if (sslsmput(arg->lsm, kbuf, ksiz, vbuf, vsiz) != 0) return (void *)1;
+  }
+  return NULL;
+}
+}
+
+class SSLSMTestFixture : public testing::Test {
+protected:
+  void SetUp() {
+    remove_dir(LSMTESTPATH);
+    lsm = sslsmnew();
+    ASSERT_TRUE(lsm != NULL);
+    /* small memtables, so that several flushes happen while the writers run */
+    ASSERT_EQ(0, sslsmtune(lsm, 256 * 1024, 0, 0, 0));
+    ASSERT_EQ(0, sslsmsetcache(lsm, 4 * 1024 * 1024));
+    ASSERT_EQ(0, sslsmopen(lsm, LSMTESTPATH));
+  }
+  void TearDown() {
+    if (lsm->open) {
+      ASSERT_EQ(0, sslsmclose(lsm));
+    }
+    sslsmdel(lsm);
+    remove_dir(LSMTESTPATH);
+  }
+  SSLSM *lsm;
+};
+
+TEST_F(SSLSMTestFixture, put_get) {
+  ASSERT_EQ(0, sslsmput(lsm, "key", 3, "val", 3));
+  EXPECT_EQ("val", get(lsm, "key"));
+  EXPECT_EQ("(none)", get(lsm, "nokey"));
+  ASSERT_EQ(0, sslsmsync(lsm));
+  EXPECT_EQ(1U, lsm->ftnum);
+  EXPECT_EQ("val", get(lsm, "key"));
+}
+
+TEST_F(SSLSMTestFixture, put_empty) {
+  /* table files hold no empty key or value, so they never reach a flush */
+  EXPECT_EQ(-1, sslsmput(lsm, "", 0, "val", 3));
+  EXPECT_EQ(SSEINVALID, lsm->ecode);
+  EXPECT_EQ(-1, sslsmput(lsm, "key", 3, "", 0));
+  EXPECT_EQ(SSEINVALID, lsm->ecode);
+  EXPECT_EQ("(none)", get(lsm, "key"));
+  ASSERT_EQ(0, sslsmput(lsm, "key", 3, "val", 3));
+  ASSERT_EQ(0, sslsmsync(lsm));
+  EXPECT_EQ("val", get(lsm, "key"));
+}
+
+TEST_F(SSLSMTestFixture, crashed_flush) {
+  /* the temporary file of a flush cut short is removed instead of failing the open */
+  ASSERT_EQ(0, sslsmput(lsm, "key", 3, "val", 3));
+  ASSERT_EQ(0, sslsmclose(lsm));
+  string tpath = string(LSMTESTPATH) + "/00000000000000ff.tmp.sstbl";
+  FILE *fp = fopen(tpath.c_str(), "wb");
+  ASSERT_TRUE(fp != NULL);
+  fputs("truncated", fp);
+  fclose(fp);
+  ASSERT_EQ(0, sslsmopen(lsm, LSMTESTPATH));
+  EXPECT_NE(0, access(tpath.c_str(), F_OK));
+  EXPECT_EQ(1U, lsm->ftnum);
+  EXPECT_EQ("val", get(lsm, "key"));
+  ASSERT_EQ(0, sslsmput(lsm, "key2", 4, "val2", 4));
+  ASSERT_EQ(0, sslsmsync(lsm));
+  EXPECT_EQ(2U, lsm->ftnum);
+  EXPECT_EQ("val2", get(lsm, "key2"));
+}
+
+TEST_F(SSLSMTestFixture, overwrite_across_tables) {
+  /* the newest value wins, in memory, in the newest table, and after reopening */
+  ASSERT_EQ(0, sslsmput(lsm, "key", 3, "val1", 4));
+  ASSERT_EQ(0, sslsmsync(lsm));
+  ASSERT_EQ(0, sslsmput(lsm, "key", 3, "val2", 4));
+  EXPECT_EQ("val2", get(lsm, "key"));
+  ASSERT_EQ(0, sslsmsync(lsm));
+  EXPECT_EQ(2U, lsm->ftnum);
+  EXPECT_EQ("val2", get(lsm, "key"));
+  ASSERT_EQ(0, sslsmclose(lsm));
+  ASSERT_EQ(0, sslsmopen(lsm, LSMTESTPATH));
+  EXPECT_EQ(2U, lsm->ftnum);
+  EXPECT_EQ("val2", get(lsm, "key"));
+  ASSERT_EQ(0, sslsmput(lsm, "key", 3, "val3", 4));
+  ASSERT_EQ(0, sslsmsync(lsm));
+  EXPECT_EQ(3U, lsm->ftnum);
+  EXPECT_EQ("val3", get(lsm, "key"));
+}
+
+TEST_F(SSLSMTestFixture, concurrent_put_with_flushes) {
+  const int tnum = 4, num = 10000;
+  pthread_t ths[tnum];
+  put_arg args[tnum];
+  for (int i = 0; i < tnum; i++) {
+    args[i].lsm = lsm;
+    args[i].id = i;
+    args[i].num = num;
+    ASSERT_EQ(0, pthread_create(ths + i, NULL, put_worker, args + i));
+  }
+  /* records are found while they move from the memtables to the tables */
+  for (int n = 0; n < 2000; n++) {
+    char kbuf[32];
+    sprintf(kbuf, "key%02d_%06d", n % tnum, 0);
+    string val = get(lsm, kbuf);
+    ASSERT_TRUE(val == "(none)" || val.compare(0, 12, string("val") + (kbuf + 3)) == 0);
+  }
+  for (int i = 0; i < tnum; i++) {
+    void *r;
+    pthread_join(ths[i], &r);
+    ASSERT_TRUE(r == NULL);
+  }
+  EXPECT_LT(1U, lsm->ftnum);
+  for (int i = 0; i < tnum; i++) {
+    for (int j = 0; j < num; j++) {
+      char kbuf[32], vbuf[128];
+      sprintf(kbuf, "key%02d_%06d", i, j);
+      sprintf(vbuf, "val%02d_%06d_%064d", i, j, 0);
+      ASSERT_EQ(string(vbuf), get(lsm, kbuf));
+    }
+  }
+  ASSERT_EQ(0, sslsmclose(lsm));
+  ASSERT_EQ(0, sslsmopen(lsm, LSMTESTPATH));
+  for (int i = 0; i < tnum; i++) {
+    char kbuf[32], vbuf[128];
+    sprintf(kbuf, "key%02d_%06d", i, num - 1);
+    sprintf(vbuf, "val%02d_%06d_%064d", i, num - 1, 0);
+    ASSERT_EQ(string(vbuf), get(lsm, kbuf));
+  }
+}
+
+TEST_F(SSLSMTestFixture, memory_limit) {
+  /* writers over the limit wait for the flush instead of growing the memtables */
+  ASSERT_EQ(0, sslsmclose(lsm));
+  ASSERT_EQ(0, sslsmtune(lsm, 64 * 1024, 128 * 1024, 0, 0));
+  ASSERT_EQ(0, sslsmopen(lsm, LSMTESTPATH));
+  put_arg arg;
+  arg.lsm = lsm;
+  arg.id = 0;
+  arg.num = 20000;
+  ASSERT_TRUE(put_worker(&arg) == NULL);
+  EXPECT_LT(10U, lsm->ftnum);
+  EXPECT_EQ(string("val00_000123_") + string(64, '0'), get(lsm, "key00_000123"));
+}
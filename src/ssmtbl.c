@@ -1,10 +1,49 @@
 #include <ssutil.h>
 #include <ssmtbl.h>
 
-#include <tcutil.h>
+/* const or default parameters */
+#define MTBLMAXLEVEL   16               /* maximum number of levels of the skiplist */
+#define MTBLBRANCH     4                /* inverse of the probability of a node to go higher */
+#define MTBLCHUNKSIZ   (1 << 20)        /* size of a chunk of the arena */
+#define MTBLALIGN      8                /* alignment of allocations from the arena */
+
+typedef struct SSMTBLCHUNK_ {    /* chunk of the arena */
+  struct SSMTBLCHUNK_ *next;     /* chunk linked before this one */
+  uint64_t siz;                  /* capacity of the chunk */
+  uint64_t off;                  /* bytes handed out, going past `siz' once the chunk is full */
+  char buf[];                    /* data */
+} SSMTBLCHUNK;
+
+typedef struct {                 /* value of a record */
+  int vsiz;                      /* size of the value */
+  char vbuf[];                   /* value data */
+} SSMTBLVAL;
+
+typedef struct SSMTBLNODE_ {     /* node of the skiplist, followed by its key */
+  SSMTBLVAL *val;                /* latest value, swapped atomically by overwrites */
+  int ksiz;                      /* size of the key */
+  int level;                     /* number of levels the node is linked in */
+  struct SSMTBLNODE_ *next[];    /* successors at each level */
+} SSMTBLNODE;
+
+/* private macros */
+#define MTBLNODEKBUF(node)  ((const char *)((node)->next + (node)->level))
+#define MTBLLOADACQ(p)      __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define MTBLSTORERLX(p, v)  __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define MTBLCAS(p, ep, v) \
+  __atomic_compare_exchange_n(p, ep, v, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)
 
 /* private function prototypes */
 static void ssmtblclear(SSMTBL *tbl);
+static SSMTBLNODE *ssmtblseek(SSMTBL *tbl, const void *kbuf, int ksiz,
+                              SSMTBLNODE **preds, SSMTBLNODE **succs);
+static SSMTBLNODE *ssmtblsplice(SSMTBLNODE *pred, int level, const void *kbuf, int ksiz,
+                                SSMTBLNODE **pp);
+static int ssmtblrandlevel(void);
+static void *ssmtblalloc(SSMTBL *tbl, uint64_t siz);
+static void ssmtbllinkchunk(SSMTBL *tbl, SSMTBLCHUNK *chunk);
+static void ssmtblsetval(SSMTBLNODE *node, SSMTBLVAL *val);
+static int ssmtblkeycmp(const char *s1, size_t n1, const char *s2, size_t n2);
 static void ssmtblsetecode(SSMTBL *tbl, int ecode);
 
 /*-----------------------------------------------------------------------------
@@ -13,10 +52,17 @@ static void ssmtblsetecode(SSMTBL *tbl, int ecode);
 SSMTBL *ssmtblnew(void) {
   SSMTBL *tbl;
   SSMALLOC(tbl, sizeof(SSMTBL));
+  if (tbl == NULL) return NULL;
   ssmtblclear(tbl);
-  tbl->mdb = tcmdbnew();
-  if (pthread_rwlock_init(&tbl->mtx, NULL) != 0)
-    goto err;
+  /* the head stays out of the arena, so an empty table has no chunk */
+  SSMTBLNODE *head;
+  SSMALLOC(head, sizeof(SSMTBLNODE) + sizeof(SSMTBLNODE *) * MTBLMAXLEVEL);
+  if (head == NULL) goto err;
+  head->val = NULL;
+  head->ksiz = 0;
+  head->level = MTBLMAXLEVEL;
+  memset(head->next, 0, sizeof(SSMTBLNODE *) * MTBLMAXLEVEL);
+  tbl->head = head;
   return tbl;
 err:
   if (tbl) ssmtbldel(tbl);
@@ -25,72 +71,275 @@ err:
 
 void ssmtbldel(SSMTBL *tbl) {
   assert(tbl);
-  if (tbl->mdb)
-    tcmdbdel(tbl->mdb);
-  pthread_rwlock_destroy(&tbl->mtx);
+  SSMTBLCHUNK *chunk = tbl->chunks;
+  while (chunk) {
+    SSMTBLCHUNK *next = chunk->next;
+    SSFREE(chunk);
+    chunk = next;
+  }
+  if (tbl->head) SSFREE(tbl->head);
   SSFREE(tbl);
 }
 
 uint64_t ssmtblmsiz(SSMTBL *tbl) {
-  uint64_t ret = 0;
   assert(tbl);
-  if (pthread_rwlock_rdlock(&tbl->mtx)) {
-    ssmtblsetecode(tbl, SSETHREAD);
-    return 0;
-  }
-  ret = tbl->msiz;
-  pthread_rwlock_unlock(&tbl->mtx);
-  return ret;
+  return MTBLLOADACQ(&tbl->msiz);
 }
 
 uint64_t ssmtblrnum(SSMTBL *tbl) {
-  uint64_t ret = 0;
   assert(tbl);
-  if (pthread_rwlock_rdlock(&tbl->mtx)) {
-    ssmtblsetecode(tbl, SSETHREAD);
-    return 0;
-  }
-  ret = tbl->rnum;
-  pthread_rwlock_unlock(&tbl->mtx);
-  return ret;
+  return MTBLLOADACQ(&tbl->rnum);
 }
 
 int ssmtblput(SSMTBL *tbl, const void *kbuf, int ksiz, const void *vbuf, int vsiz) {
-  assert(tbl && tbl->mdb && kbuf && ksiz >= 0 && vbuf && vsiz >= 0);
-  if (pthread_rwlock_wrlock(&tbl->mtx)) {
-    ssmtblsetecode(tbl, SSETHREAD);
+  assert(tbl && tbl->head && kbuf && ksiz >= 0 && vbuf && vsiz >= 0);
+  SSMTBLVAL *val = ssmtblalloc(tbl, sizeof(SSMTBLVAL) + vsiz);
+  if (val == NULL) {
+    ssmtblsetecode(tbl, SSEMISC);
     return -1;
   }
-  tcmdbput(tbl->mdb, kbuf, ksiz, vbuf, vsiz);
-  tbl->msiz = tcmdbmsiz(tbl->mdb);
-  tbl->rnum = tcmdbrnum(tbl->mdb);
-  pthread_rwlock_unlock(&tbl->mtx);
+  val->vsiz = vsiz;
+  memcpy(val->vbuf, vbuf, vsiz);
+  SSMTBLNODE *preds[MTBLMAXLEVEL], *succs[MTBLMAXLEVEL];
+  SSMTBLNODE *node = ssmtblseek(tbl, kbuf, ksiz, preds, succs);
+  if (node && ssmtblkeycmp(MTBLNODEKBUF(node), node->ksiz, kbuf, ksiz) == 0) {
+    ssmtblsetval(node, val);
+    return 0;
+  }
+  int level = ssmtblrandlevel(), i;
+  node = ssmtblalloc(tbl, sizeof(SSMTBLNODE) + sizeof(SSMTBLNODE *) * level + ksiz);
+  if (node == NULL) {
+    ssmtblsetecode(tbl, SSEMISC);
+    return -1;
+  }
+  node->val = val;
+  node->ksiz = ksiz;
+  node->level = level;
+  memcpy(node->next + level, kbuf, ksiz);
+  int height = MTBLLOADACQ(&tbl->height);
+  while (height < level && !MTBLCAS(&tbl->height, &height, level));
+  /* link from the bottom up, so a node reachable at any level is in the list at level 0 */
+  for (i = 0; i < level; i++) {
+    while (1) {
+      SSMTBLNODE *succ = succs[i];
+      MTBLSTORERLX(&node->next[i], succ);
+      if (MTBLCAS(&preds[i]->next[i], &succ, node)) break;
+      /* another writer linked a node right after the predecessor, which stays before the key
+         as nodes are never removed, so the search goes on from there */
+      succs[i] = ssmtblsplice(preds[i], i, kbuf, ksiz, &preds[i]);
+      if (i == 0 && succs[0] &&
+          ssmtblkeycmp(MTBLNODEKBUF(succs[0]), succs[0]->ksiz, kbuf, ksiz) == 0) {
+        /* the same key was put concurrently and won; this node was never reachable and its
+           space is left in the arena */
+        ssmtblsetval(succs[0], val);
+        return 0;
+      }
+    }
+  }
+  __atomic_add_fetch(&tbl->rnum, 1, __ATOMIC_RELEASE);
   return 0;
 }
 
 void *ssmtblget(SSMTBL *tbl, const void *kbuf, int ksiz, int *sp) {
-  void *p = NULL;
-  assert(tbl && tbl->mdb && kbuf && ksiz >= 0 && sp);
-  if (pthread_rwlock_rdlock(&tbl->mtx)) {
-    ssmtblsetecode(tbl, SSETHREAD);
+  assert(tbl && tbl->head && kbuf && ksiz >= 0 && sp);
+  SSMTBLNODE *node = ssmtblseek(tbl, kbuf, ksiz, NULL, NULL);
+  if (node == NULL || ssmtblkeycmp(MTBLNODEKBUF(node), node->ksiz, kbuf, ksiz) != 0) {
+    ssmtblsetecode(tbl, SSENOREC);
+    return NULL;
+  }
+  SSMTBLVAL *val = MTBLLOADACQ(&node->val);
+  char *p;
+  SSMALLOC(p, val->vsiz + 1);
+  if (p == NULL) {
+    ssmtblsetecode(tbl, SSEMISC);
     return NULL;
   }
-  p = tcmdbget(tbl->mdb, kbuf, ksiz, sp);
-  pthread_rwlock_unlock(&tbl->mtx);
+  memcpy(p, val->vbuf, val->vsiz);
+  p[val->vsiz] = '\0';
+  *sp = val->vsiz;
   return p;
 }
 
+SSMTBLCUR *ssmtblcurnew(SSMTBL *tbl) {
+  assert(tbl);
+  SSMTBLCUR *cur;
+  SSMALLOC(cur, sizeof(SSMTBLCUR));
+  if (cur == NULL) return NULL;
+  cur->tbl = tbl;
+  cur->node = NULL;
+  return cur;
+}
+
+void ssmtblcurdel(SSMTBLCUR *cur) {
+  assert(cur);
+  SSFREE(cur);
+}
+
+int ssmtblcurfirst(SSMTBLCUR *cur) {
+  assert(cur);
+  SSMTBLNODE *head = cur->tbl->head;
+  cur->node = MTBLLOADACQ(&head->next[0]);
+  if (cur->node == NULL) {
+    ssmtblsetecode(cur->tbl, SSENOREC);
+    return -1;
+  }
+  return 0;
+}
+
+int ssmtblcurjump(SSMTBLCUR *cur, const void *kbuf, int ksiz) {
+  assert(cur && kbuf && ksiz >= 0);
+  cur->node = ssmtblseek(cur->tbl, kbuf, ksiz, NULL, NULL);
+  if (cur->node == NULL) {
+    ssmtblsetecode(cur->tbl, SSENOREC);
+    return -1;
+  }
+  return 0;
+}
+
+int ssmtblcurnext(SSMTBLCUR *cur) {
+  assert(cur);
+  SSMTBLNODE *node = cur->node;
+  if (node) cur->node = MTBLLOADACQ(&node->next[0]);
+  if (cur->node == NULL) {
+    ssmtblsetecode(cur->tbl, SSENOREC);
+    return -1;
+  }
+  return 0;
+}
+
+const void *ssmtblcurkey(SSMTBLCUR *cur, int *sp) {
+  assert(cur && sp);
+  SSMTBLNODE *node = cur->node;
+  if (node == NULL) return NULL;
+  *sp = node->ksiz;
+  return MTBLNODEKBUF(node);
+}
+
+const void *ssmtblcurval(SSMTBLCUR *cur, int *sp) {
+  assert(cur && sp);
+  SSMTBLNODE *node = cur->node;
+  if (node == NULL) return NULL;
+  SSMTBLVAL *val = MTBLLOADACQ(&node->val);
+  *sp = val->vsiz;
+  return val->vbuf;
+}
+
 /*-----------------------------------------------------------------------------
  * private functions
  */
 static void ssmtblclear(SSMTBL *tbl) {
   assert(tbl);
-  tbl->mdb = NULL;
+  tbl->head = NULL;
+  tbl->height = 1;
+  tbl->chunk = NULL;
+  tbl->chunks = NULL;
   tbl->msiz = 0;
   tbl->rnum = 0;
   tbl->ecode = SSESUCCESS;
 }
 
+static SSMTBLNODE *ssmtblseek(SSMTBL *tbl, const void *kbuf, int ksiz,
+                              SSMTBLNODE **preds, SSMTBLNODE **succs) {
+  /* find the first node not less than the key, and its neighbors at each level if asked;
+     levels above a stale height may already hold nodes of a concurrent insert, so every
+     level is searched */
+  SSMTBLNODE *pred = tbl->head, *succ = NULL;
+  int i;
+  for (i = MTBLMAXLEVEL - 1; i >= 0; i--) {
+    succ = ssmtblsplice(pred, i, kbuf, ksiz, &pred);
+    if (preds) {
+      preds[i] = pred;
+      succs[i] = succ;
+    }
+  }
+  return succ;
+}
+
+static SSMTBLNODE *ssmtblsplice(SSMTBLNODE *pred, int level, const void *kbuf, int ksiz,
+                                SSMTBLNODE **pp) {
+  /* move right at a level while the next node is less than the key */
+  SSMTBLNODE *next = MTBLLOADACQ(&pred->next[level]);
+  while (next && ssmtblkeycmp(MTBLNODEKBUF(next), next->ksiz, kbuf, ksiz) < 0) {
+    pred = next;
+    next = MTBLLOADACQ(&pred->next[level]);
+  }
+  *pp = pred;
+  return next;
+}
+
+static int ssmtblrandlevel(void) {
+  /* each thread draws from its own xorshift generator, seeded by the address of its state */
+  static __thread uint32_t seed = 0;
+  if (seed == 0) seed = (uint32_t)(uintptr_t)&seed | 1;
+  int level = 1;
+  while (level < MTBLMAXLEVEL) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    if (seed % MTBLBRANCH != 0) break;
+    level++;
+  }
+  return level;
+}
+
+static void *ssmtblalloc(SSMTBL *tbl, uint64_t siz) {
+  /* bump an offset in the current chunk, and replace the chunk once it runs out */
+  siz = (siz + MTBLALIGN - 1) & ~(uint64_t)(MTBLALIGN - 1);
+  SSMTBLCHUNK *chunk;
+  if (siz > MTBLCHUNKSIZ / 4) {
+    /* a large record gets a chunk of its own instead of wasting the rest of the current one */
+    SSMALLOC(chunk, sizeof(SSMTBLCHUNK) + siz);
+    if (chunk == NULL) return NULL;
+    chunk->siz = siz;
+    chunk->off = siz;
+    ssmtbllinkchunk(tbl, chunk);
+    __atomic_add_fetch(&tbl->msiz, siz, __ATOMIC_RELEASE);
+    return chunk->buf;
+  }
+  while (1) {
+    SSMTBLCHUNK *cur = MTBLLOADACQ((SSMTBLCHUNK **)&tbl->chunk);
+    if (cur) {
+      uint64_t off = __atomic_fetch_add(&cur->off, siz, __ATOMIC_RELAXED);
+      if (off + siz <= cur->siz) {
+        __atomic_add_fetch(&tbl->msiz, siz, __ATOMIC_RELEASE);
+        return cur->buf + off;
+      }
+    }
+    SSMALLOC(chunk, sizeof(SSMTBLCHUNK) + MTBLCHUNKSIZ);
+    if (chunk == NULL) return NULL;
+    chunk->siz = MTBLCHUNKSIZ;
+    chunk->off = siz;
+    if (MTBLCAS((SSMTBLCHUNK **)&tbl->chunk, &cur, chunk)) {
+      ssmtbllinkchunk(tbl, chunk);
+      __atomic_add_fetch(&tbl->msiz, siz, __ATOMIC_RELEASE);
+      return chunk->buf;
+    }
+    /* another thread replaced the chunk first, so its new chunk is tried instead */
+    SSFREE(chunk);
+  }
+}
+
+static void ssmtbllinkchunk(SSMTBL *tbl, SSMTBLCHUNK *chunk) {
+  chunk->next = MTBLLOADACQ((SSMTBLCHUNK **)&tbl->chunks);
+  while (!MTBLCAS((SSMTBLCHUNK **)&tbl->chunks, &chunk->next, chunk));
+}
+
+static void ssmtblsetval(SSMTBLNODE *node, SSMTBLVAL *val) {
+  /* readers may still hold the replaced value, which stays in the arena */
+  __atomic_store_n(&node->val, val, __ATOMIC_RELEASE);
+}
+
+static int ssmtblkeycmp(const char *s1, size_t n1, const char *s2, size_t n2) {
+  /* same order as the keys of SSFTBL */
+  size_t min = (n1 < n2) ? n1 : n2;
+  int r = memcmp(s1, s2, min);
+  if (r == 0) {
+    if (n1 == n2) return 0;
+    return (n1 < n2) ? -1 : 1;
+  }
+  return r;
+}
+
 static void ssmtblsetecode(SSMTBL *tbl, int ecode) {
   assert(tbl);
   tbl->ecode = ecode;
@@ -11,28 +11,42 @@
 SSMTBL_CLINKAGEBEGIN
 
 #include <stdint.h>
-#include <pthread.h>
 
 typedef struct {
-  void *mdb;            /* memory database */
-  uint64_t msiz;        /* total size of memory database */
-  uint64_t rnum;        /* total number of records */
-  pthread_rwlock_t mtx; /* mutex for record */
+  void *head;           /* head node of the skiplist, with a successor at every level */
+  int height;           /* number of levels in use, raised atomically */
+  void *chunk;          /* chunk of the arena records are carved from, replaced atomically */
+  void *chunks;         /* every chunk of the arena, freed together on deletion */
+  uint64_t msiz;        /* bytes handed out by the arena, updated atomically */
+  uint64_t rnum;        /* total number of records, updated atomically */
   int ecode;            /* error code */
 } SSMTBL;
 
+typedef struct {        /* cursor over the records of an on-memory SSTable */
+  SSMTBL *tbl;          /* table of the cursor */
+  void *node;           /* node of the current record, or NULL */
+} SSMTBLCUR;
+
 /* Create an on-memory SSTable object.
    The return value is the new on-memory SSTable object.
-   The object can be shared by any threads because of the internal mutex. */
+   Records are kept in a skiplist in the order of the keys as `ssftblappend' requires them,
+   that is by `memcmp' with a shorter key before a longer one sharing its bytes. The object
+   can be shared by any threads without locks: puts link records with compare-and-swap, and
+   gets and cursors only follow links. Keys, values and nodes are carved out of large chunks
+   by bumping an atomic offset, and every chunk is freed at once when the object is deleted.
+   Records are never removed, and a value replaced by an overwrite is kept until then. */
 SSMTBL *ssmtblnew(void);
 
-/* Delete an on-memory hash database object.
-   `tbl' specifies the on-memory SSTable object. */
+/* Delete an on-memory SSTable object.
+   `tbl' specifies the on-memory SSTable object.
+   The memory of all records is released in one pass over the chunks of the arena. */
 void ssmtbldel(SSMTBL *tbl);
 
 /* Get the total size of memory used in an on-memory SSTable object.
    `tbl' specifies the on-memory SSTable object.
-   The return value is the total size of memory used in the table. */
+   The return value is the total size of memory used in the table, which is the number of
+   bytes handed out by the arena including alignment. It is read without a lock, and the
+   chunks hold at most one partly used chunk more. */
 uint64_t ssmtblmsiz(SSMTBL *tbl);
 
 /* Get the number of records stored in an on-memory SSTable object.
@@ -63,5 +77,48 @@ int ssmtblput(SSMTBL *tbl, const void *kbuf, int ksiz, const void *vbuf, int vsi
    it is no longer in use. */
 void *ssmtblget(SSMTBL *tbl, const void *kbuf, int ksiz, int *sp);
 
+/* Create a cursor object of an on-memory SSTable object.
+   `tbl' specifies the on-memory SSTable object.
+   The return value is the new cursor object, which points at nothing until `ssmtblcurfirst'
+   or `ssmtblcurjump' is called. A cursor must not be shared by threads, but records may be
+   put while it moves, and those put ahead of it are visited. */
+SSMTBLCUR *ssmtblcurnew(SSMTBL *tbl);
+
+/* Delete a cursor object.
+   `cur' specifies the cursor object. */
+void ssmtblcurdel(SSMTBLCUR *cur);
+
+/* Move a cursor object to the first record.
+   `cur' specifies the cursor object.
+   The return value is 0 for success, or -1 if there is no record. */
+int ssmtblcurfirst(SSMTBLCUR *cur);
+
+/* Move a cursor object to the first record not less than a key.
+   `cur' specifies the cursor object.
+   `kbuf' specifies the pointer to the region of the key.
+   `ksiz' specifies the size of the region of the key.
+   The return value is 0 for success, or -1 if there is no such record. */
+int ssmtblcurjump(SSMTBLCUR *cur, const void *kbuf, int ksiz);
+
+/* Move a cursor object to the next record.
+   `cur' specifies the cursor object.
+   The return value is 0 for success, or -1 at the end of the table, in which case the error
+   code is `SSENOREC'. */
+int ssmtblcurnext(SSMTBLCUR *cur);
+
+/* Get the key of the record at a cursor object.
+   `cur' specifies the cursor object.
+   `sp' specifies the pointer to the variable into which the size of the key is assigned.
+   The return value is the key, or `NULL' if the cursor points at nothing. The region is
+   valid until the table is deleted, and must not be freed. */
+const void *ssmtblcurkey(SSMTBLCUR *cur, int *sp);
+
+/* Get the value of the record at a cursor object.
+   `cur' specifies the cursor object.
+   `sp' specifies the pointer to the variable into which the size of the value is assigned.
+   The return value is the latest value of the record, or `NULL' if the cursor points at
+   nothing. The region is valid until the table is deleted, and must not be freed. */
+const void *ssmtblcurval(SSMTBLCUR *cur, int *sp);
+
 SSMTBL_CLINKAGEEND
 #endif
@@ -1,8 +1,11 @@
 #include <ssmtbl.h>
 
+#include <algorithm>
+#include <map>
 #include <vector>
 #include <string>
 #include <gtest/gtest.h>
+#include <pthread.h>
 
 using namespace std;
 
@@ -95,3 +98,128 @@ TEST_F(SSMTBLTestFixture, put_get_1000) {
     EXPECT_EQ(string((const char*)p), s);
   }
 }
+
+TEST_F(SSMTBLTestFixture, cursor_order) {
+  map<string, string> m;
+  for (int i = 0; i < 5000; i++) {
+    string k;
+    int len = rand() % 12;
+    for (int j = 0; j < len; j++)
+      k += 'a' + rand() % 4;
+    string v = k + "_" + (char)('0' + i % 10);
+    m[k] = v;
+    ASSERT_EQ(0, ssmtblput(mtbl, k.data(), k.size(), v.data(), v.size()));
+  }
+  EXPECT_EQ(m.size(), ssmtblrnum(mtbl));
+  SSMTBLCUR *cur = ssmtblcurnew(mtbl);
+  ASSERT_EQ(0, ssmtblcurfirst(cur));
+  for (map<string, string>::iterator it = m.begin(); it != m.end(); it++) {
+    int ksiz, vsiz;
+    const char *kbuf = (const char *)ssmtblcurkey(cur, &ksiz);
+    const char *vbuf = (const char *)ssmtblcurval(cur, &vsiz);
+    ASSERT_TRUE(kbuf != NULL && vbuf != NULL);
+    ASSERT_EQ(it->first, string(kbuf, ksiz));
+    ASSERT_EQ(it->second, string(vbuf, vsiz));
+    ssmtblcurnext(cur);
+  }
+  int ksiz;
+  ASSERT_TRUE(ssmtblcurkey(cur, &ksiz) == NULL);
+  ASSERT_EQ(-1, ssmtblcurnext(cur));
+  /* jumping lands on the first key not less than the given one */
+  ASSERT_EQ(0, ssmtblcurjump(cur, "abc", 3));
+  const char *kbuf = (const char *)ssmtblcurkey(cur, &ksiz);
+  ASSERT_EQ(m.lower_bound("abc")->first, string(kbuf, ksiz));
+  ASSERT_EQ(-1, ssmtblcurjump(cur, "e", 1));
+  ssmtblcurdel(cur);
+}
+
+TEST_F(SSMTBLTestFixture, msiz) {
+  /* usage covers keys and values with little overhead, and grows with every put */
+  uint64_t dsiz = 0, last = 0;
+  char kbuf[32];
+  string val(100, 'v');
+  for (int i = 0; i < 20000; i++) {
+    int ksiz = sprintf(kbuf, "key%08d", i);
+    ASSERT_EQ(0, ssmtblput(mtbl, kbuf, ksiz, val.data(), val.size()));
+    dsiz += ksiz + val.size();
+    ASSERT_LT(last, ssmtblmsiz(mtbl));
+    last = ssmtblmsiz(mtbl);
+  }
+  EXPECT_LE(dsiz, last);
+  EXPECT_GT(dsiz * 2, last);
+}
+
+TEST_F(SSMTBLTestFixture, put_large) {
+  /* values larger than a chunk of the arena, between small ones */
+  string large(3 << 20, 'l');
+  ASSERT_EQ(0, ssmtblput(mtbl, "a", 1, "small", 5));
+  ASSERT_EQ(0, ssmtblput(mtbl, "b", 1, large.data(), large.size()));
+  ASSERT_EQ(0, ssmtblput(mtbl, "c", 1, "small", 5));
+  EXPECT_LT(large.size(), ssmtblmsiz(mtbl));
+  int sp;
+  void *p = ssmtblget(mtbl, "b", 1, &sp);
+  ASSERT_TRUE(p != NULL);
+  EXPECT_EQ(large, string((const char *)p, sp));
+  free(p);
+  p = ssmtblget(mtbl, "c", 1, &sp);
+  ASSERT_TRUE(p != NULL);
+  EXPECT_EQ(string("small"), string((const char *)p, sp));
+  free(p);
+}
+
+namespace {
+struct put_arg {
+  SSMTBL *mtbl;
+  int id;
+};
+
+void *put_worker(void *p) {
+  /* every thread puts the shared keys and its own ones, interleaved */
+  put_arg *arg = (put_arg *)p;
+  char kbuf[32], vbuf[32];
+  for (int i = 0; i < 20000; i++) {
+    int ksiz = (i % 2) ? sprintf(kbuf, "shared%05d", i / 2) : sprintf(kbuf, "t%d_%05d", arg->id, i);
+    int vsiz = sprintf(vbuf, "%d", arg->id);
+    if (ssmtblput(arg->mtbl, kbuf, ksiz, vbuf, vsiz) != 0) return (void *)1;
+  }
+  return NULL;
+}
+}
+
+TEST_F(SSMTBLTestFixture, concurrent_put) {
+  const int tnum = 8;
+  pthread_t ths[tnum];
+  put_arg args[tnum];
+  for (int i = 0; i < tnum; i++) {
+    args[i].mtbl = mtbl;
+    args[i].id = i;
+    ASSERT_EQ(0, pthread_create(ths + i, NULL, put_worker, args + i));
+  }
+  for (int i = 0; i < tnum; i++) {
+    void *r;
+    pthread_join(ths[i], &r);
+    ASSERT_TRUE(r == NULL);
+  }
+  ASSERT_EQ((uint64_t)(10000 + tnum * 10000), ssmtblrnum(mtbl));
+  SSMTBLCUR *cur = ssmtblcurnew(mtbl);
+  ASSERT_EQ(0, ssmtblcurfirst(cur));
+  string prev;
+  uint64_t num = 0;
+  do {
+    int ksiz;
+    const char *kbuf = (const char *)ssmtblcurkey(cur, &ksiz);
+    string key(kbuf, ksiz);
+    if (num > 0) {
+      ASSERT_LT(prev, key);
+    }
+    prev = key;
+    num++;
+  } while (ssmtblcurnext(cur) == 0);
+  ASSERT_EQ(ssmtblrnum(mtbl), num);
+  ssmtblcurdel(cur);
+  int sp;
+  void *p = ssmtblget(mtbl, "t3_00004", 8, &sp);
+  ASSERT_TRUE(p != NULL);
+  EXPECT_EQ(string("3"), string((const char *)p, sp));
+  free(p);
+}
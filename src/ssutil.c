@@ -42,3 +42,58 @@ int ssread(int fd, void *buf, size_t size) {
   }
   return (nbytes == size) ? 0 : -1;
 }
+
+int sspwritev(int fd, const struct iovec *iov, int iovcnt, uint64_t off) {
+  assert(fd >= 0 && iov && iovcnt >= 0);
+  struct iovec vec[SSIOVMAX];
+  size_t skip = 0; /* bytes of `iov[0]' already written */
+  while (iovcnt > 0) {
+    int num = (iovcnt < SSIOVMAX) ? iovcnt : SSIOVMAX, i;
+    for (i = 0; i < num; i++)
+      vec[i] = iov[i];
+    vec[0].iov_base = (char *)vec[0].iov_base + skip;
+    vec[0].iov_len -= skip;
+    ssize_t n = -1;
+    SSSYS_NOINTR(n, pwritev(fd, vec, num, off));
+    if (n < 0) return -1;
+    if (n == 0) {
+      /* nothing to write only if every region left is empty */
+      for (i = 0; i < num; i++)
+        if (vec[i].iov_len > 0) return -1;
+    }
+    off += n;
+    /* a short write leaves the rest of a region and the regions after it */
+    for (i = 0; i < num && (size_t)n >= vec[i].iov_len; i++)
+      n -= vec[i].iov_len;
+    skip = (i == 0) ? skip + n : (size_t)n;
+    iov += i;
+    iovcnt -= i;
+  }
+  return 0;
+}
+
+int ssvnumput(char *buf, uint64_t num) {
+  assert(buf);
+  unsigned char *p = (unsigned char *)buf;
+  while (num >= 0x80) {
+    *(p++) = (unsigned char)(num | 0x80);
+    num >>= 7;
+  }
+  *(p++) = (unsigned char)num;
+  return (char *)p - buf;
+}
+
+int ssvnumget(const char *buf, size_t size, uint64_t *np) {
+  assert(buf && np);
+  const unsigned char *p = (const unsigned char *)buf;
+  uint64_t num = 0;
+  size_t i;
+  for (i = 0; i < size && i < SSVNUMMAXSIZ; i++) {
+    num |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+    if (!(p[i] & 0x80)) {
+      *np = num;
+      return i + 1;
+    }
+  }
+  return 0; /* truncated or too long */
+}
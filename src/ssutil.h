@@ -17,6 +17,7 @@ __SSUTIL_CLINKAGEBEGIN
 #include <string.h>
 #include <pthread.h>
 #include <errno.h>
+#include <sys/uio.h>
 
 /* error codes */
 enum {                                   /* enumeration for error codes */
@@ -43,6 +44,7 @@ enum {                                   /* enumeration for error codes */
   SSERMDIR,                              /* rmdir error */
   SSEKEEP,                               /* existing record */
   SSENOREC,                              /* no record found */
+  SSECHKSUM,                             /* checksum mismatch */
   SSEMISC = 9999                         /* miscellaneous error */
 };
 
@@ -72,8 +74,17 @@ enum {                                   /* enumeration for error codes */
   } while (1)
 
 /* I/O */
+#define SSIOVMAX 64 /* regions passed to one vectored system call */
 int sswrite(int fd, const void *buf, size_t size);
 int ssread(int fd, void *buf, size_t size);
+/* Write regions gathered from `iov' at `off' with as few `pwritev' calls as it takes.
+   The return value is 0 if every byte was written, or -1 otherwise. */
+int sspwritev(int fd, const struct iovec *iov, int iovcnt, uint64_t off);
+
+/* variable-length numbers (little-endian base 128) */
+#define SSVNUMMAXSIZ 10 /* maximum size of an encoded 64-bit number */
+int ssvnumput(char *buf, uint64_t num);
+int ssvnumget(const char *buf, size_t size, uint64_t *np);
 
 /* MISC */
 #define SSMIN(a, b) (((a) < (b)) ? a : b);